@@ -20,6 +20,23 @@ fftw_plan mkGCFLayer(
   , double w
   );
 
+// Generates num_layers layers at once, in parallel. Layers get
+//   stored one after another in dst, layer l taking
+//   [OVER][OVER][supports[l]][supports[l]]; table gets
+//   OVER*OVER entries per layer. Any plan passed in should come
+//   from a previous call with the same max_support and src_pad.
+fftw_plan mkGCFLayers(
+    fftw_plan p
+  , complexd dst[]
+  , complexd * table[]
+  , int num_layers
+  , const int supports[]
+  , int max_support
+  , int src_pad
+  , double t2
+  , const double ws[]
+  );
+
 void calcAccums(
     const Double3 uvw[]
   // We retain separate sum and num of points info
@@ -33,6 +33,11 @@ ull gridKernelCPU##hgcfSuff(                              \
 gridKernelCPUDecl(HalfGCF, true)
 gridKernelCPUDecl(FullGCF, false)
 
+// Same as above, but threads share a single grid, owning strips of
+// it in turn. Needs much less memory with many threads.
+gridKernelCPUDecl(StripsHalfGCF, true)
+gridKernelCPUDecl(StripsFullGCF, false)
+
 EXTERNC
 void grid0(
     const Double3 uvw[]
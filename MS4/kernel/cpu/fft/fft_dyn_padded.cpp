@@ -56,23 +56,44 @@ fftw_plan fft_plan_cc(
 }
 
 template <int dir> struct plan_traits{};
-#define __plan_trait(dir, fun, sta, dta, st, dt) \
+#define __plan_trait(dir, fun, exe, sta, dta, st, dt) \
 template <> struct plan_traits<dir>{    \
   static fftw_plan_s* fft_plan(int a, const fftw_iodim *b, int c, const fftw_iodim* d, sta *e, dta *f, unsigned int g) { \
       return fun(a, b, c, d, e, f, g);  \
   }                                     \
+  static void fft_execute(fftw_plan_s* p, sta *e, dta *f) { \
+      exe(p, e, f);                     \
+  }                                     \
   typedef st srcTy;                     \
   typedef dt dstTy;                     \
 }
 
-__plan_trait(-1, fft_plan_cc<-1>       , fftw_complex, fftw_complex, complexd, complexd);
-__plan_trait( 0, fftw_plan_guru_dft_r2c, double,       fftw_complex, double  , complexd);
-__plan_trait( 1, fft_plan_cc<1>        , fftw_complex, fftw_complex, complexd, complexd);
-__plan_trait( 2, fftw_plan_guru_dft_c2r, fftw_complex, double,       complexd,   double);
+__plan_trait(-1, fft_plan_cc<-1>       , fftw_execute_dft    , fftw_complex, fftw_complex, complexd, complexd);
+__plan_trait( 0, fftw_plan_guru_dft_r2c, fftw_execute_dft_r2c, double,       fftw_complex, double  , complexd);
+__plan_trait( 1, fft_plan_cc<1>        , fftw_execute_dft    , fftw_complex, fftw_complex, complexd, complexd);
+__plan_trait( 2, fftw_plan_guru_dft_c2r, fftw_execute_dft_c2r, fftw_complex, double,       complexd,   double);
 
 inline fftw_complex * fftw_cast(complexd * const & p){return reinterpret_cast<fftw_complex *>(p);}
 inline double * fftw_cast(double * const & p){return p;}
 
+// Only plans, doesn't touch the data (we use FFTW_ESTIMATE). The
+// plan can be executed concurrently on any data with the same layout
+// and alignment.
+template <int dir>
+fftw_plan __fft_plan_inplace_even(void * data, int size, int pitch){
+  fftw_iodim trans_dims[2] = {
+      {size, pitch, pitch}
+    , {size, 1, 1}
+    };
+  return plan_traits<dir>::fft_plan(
+      2, trans_dims
+    , 0, NULL
+    , fftw_cast(reinterpret_cast<typename plan_traits<dir>::srcTy *>(data))
+    , fftw_cast(reinterpret_cast<typename plan_traits<dir>::dstTy *>(data))
+    , FFTW_ESTIMATE
+    );
+}
+
 template <int dir>
 fftw_plan __fft_inplace_even(fftw_plan p, void * data, int size, int pitch){
   // This does not quite work. Don't understand why yet.
@@ -82,28 +103,32 @@ fftw_plan __fft_inplace_even(fftw_plan p, void * data, int size, int pitch){
 
   fftshift_even(src, size, pitch);
 
-  if (p == NULL) {
-    fftw_iodim trans_dims[2] = {
-        {size, pitch, pitch}
-      , {size, 1, 1}
-      };
-    p = plan_traits<dir>::fft_plan(
-        2, trans_dims
-      , 0, NULL
-      , fftw_cast(src)
-      , fftw_cast(dst)
-      , FFTW_ESTIMATE
-      );
-  }
-  fftw_execute(p);
+  if (p == NULL) p = __fft_plan_inplace_even<dir>(data, size, pitch);
+  // Plans get reused for different data of the same layout, so
+  // always tell FFTW which array to work on.
+  plan_traits<dir>::fft_execute(p, fftw_cast(src), fftw_cast(dst));
 
   fftshift_even(dst, size, pitch);
 
   return p;
+  #undef src
+  #undef dst
 }
 
 fftw_plan fft_inplace_even(fftw_plan p, int sign, void * data, int size, int pitch){
-  #define __sw(d) case d: __fft_inplace_even<d>(p, data, size, pitch); return p;
+  #define __sw(d) case d: return __fft_inplace_even<d>(p, data, size, pitch);
+  switch(sign){
+    __sw(-1);
+    __sw( 0);
+    __sw( 1);
+    __sw( 2);
+    default: return nullptr;
+  }
+  #undef __sw
+}
+
+fftw_plan fft_plan_inplace_even(int sign, void * data, int size, int pitch){
+  #define __sw(d) case d: return __fft_plan_inplace_even<d>(data, size, pitch);
   switch(sign){
     __sw(-1);
     __sw( 0);
@@ -111,6 +136,7 @@ fftw_plan fft_inplace_even(fftw_plan p, int sign, void * data, int size, int pit
     __sw( 2);
     default: return nullptr;
   }
+  #undef __sw
 }
 
 void fftInitThreading() {
@@ -4,9 +4,7 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
 #include <cstring>
-#ifdef _MSC_VER
 #include <vector>
-#endif
 
 #include "metrix.h"
 #include "fft_dyn_padded.h"
@@ -55,23 +53,14 @@ void __transpose_and_normalize_and_extract(
 //   because it does not depend on w and can be reused for
 //   all layers, but we don't bother with caching and copying them
 //   over and thus recalculate them each time
-template <int over>
-fftw_plan __mkGCFLayer(
-    fftw_plan p
-  , complexd dst[]   // [over][over][support][support]
-  , complexd * table[]
-  , complexd arena[] // Full oversampled layer padded [max_support*over][max_support*over+src_pad]
-  , int support
+void __fillWLayer(
+    complexd arena[] // Full oversampled layer padded [max_support*over][max_support*over+src_pad]
+  , int size
+  , int pitch
   , int max_support
-  , int src_pad      // padding value
   , double t2
   , double w
   ){
-  int
-      size = max_support * over
-    , pitch = size + src_pad
-    ;
-
   int radius = max_support / 2;
   double normer = t2 / double (radius);
 
@@ -82,7 +71,9 @@ fftw_plan __mkGCFLayer(
     ;
 
   memset(arena, 0, size * pitch * sizeof(complexd));
-  // #pragma omp parallel for // WRONG USAGE!
+  // Not parallelised: we either have one layer only and it's cheap
+  //   compared to FFT, or we generate several layers in parallel
+  //   (see mkGCFLayers).
   for(int i = -radius; i < radiuspos; i++) {
     for(int j = -radius; j < radiuspos; j++) {
       double x, y, ph;
@@ -95,6 +86,35 @@ fftw_plan __mkGCFLayer(
     }
     currp += istep;
   }
+}
+
+template <int over>
+void __fillTable(complexd * table[], complexd dst[], int support){
+  complexd * tp = dst;
+  for (int i=0; i < over * over; i++) {
+    table[i] = tp;
+    tp += support * support;
+  }
+}
+
+template <int over>
+fftw_plan __mkGCFLayer(
+    fftw_plan p
+  , complexd dst[]   // [over][over][support][support]
+  , complexd * table[]
+  , complexd arena[] // Full oversampled layer padded [max_support*over][max_support*over+src_pad]
+  , int support
+  , int max_support
+  , int src_pad      // padding value
+  , double t2
+  , double w
+  ){
+  int
+      size = max_support * over
+    , pitch = size + src_pad
+    ;
+
+  __fillWLayer(arena, size, pitch, max_support, t2, w);
 
   fftw_plan plan = fft_inplace_even(p, FFTW_BACKWARD, arena, size, pitch);
 
@@ -106,16 +126,67 @@ fftw_plan __mkGCFLayer(
     , src_pad
     );
 
-  // Fill layers table
-  complexd * tp = dst;
-  for (int i=0; i < over * over; i++) {
-    table[i] = tp;
-    tp += support * support;
-  }
+  __fillTable<over>(table, dst, support);
 
   return plan;
 }
 
+// Batched version. All layers share a single FFTW plan, which every
+// thread executes on an arena of its own.
+template <int over>
+fftw_plan __mkGCFLayers(
+    fftw_plan p
+  , complexd dst[]   // [num_layers][over][over][support_i][support_i]
+  , complexd * table[] // [num_layers][over*over]
+  , int num_layers
+  , const int supports[]
+  , int max_support
+  , int src_pad
+  , double t2
+  , const double ws[]
+  ){
+  int
+      size = max_support * over
+    , pitch = size + src_pad
+    , nthreads = omp_get_max_threads()
+    ;
+
+  // Offsets of the layers in dst
+  vector<size_t> offs(num_layers);
+  size_t off = 0;
+  for (int l = 0; l < num_layers; l++) {
+    offs[l] = off;
+    off += size_t(over * over) * supports[l] * supports[l];
+  }
+
+  // fftw_malloc, so all arenas have the same alignment as the one
+  // we plan on.
+  vector<complexd *> arenas(nthreads);
+  for (int t = 0; t < nthreads; t++)
+    arenas[t] = reinterpret_cast<complexd *>(fftw_malloc(sizeof(complexd) * size * pitch));
+  if (p == NULL) p = fft_plan_inplace_even(FFTW_BACKWARD, arenas[0], size, pitch);
+
+  // Note that a multithreaded plan won't spawn more threads here,
+  //   as we don't allow nested parallelism.
+  #pragma omp parallel for schedule(dynamic)
+  for (int l = 0; l < num_layers; l++) {
+    complexd * arena = arenas[omp_get_thread_num()];
+    __fillWLayer(arena, size, pitch, max_support, t2, ws[l]);
+    fft_inplace_even(p, FFTW_BACKWARD, arena, size, pitch);
+    __transpose_and_normalize_and_extract<over>(
+        dst + offs[l]
+      , arena
+      , supports[l]
+      , max_support
+      , src_pad
+      );
+    __fillTable<over>(table + over * over * l, dst + offs[l], supports[l]);
+  }
+
+  for (int t = 0; t < nthreads; t++) fftw_free(arenas[t]);
+  return p;
+}
+
 // Inst
 fftw_plan mkGCFLayer(
     fftw_plan p
@@ -141,6 +212,30 @@ fftw_plan mkGCFLayer(
       );
 }
 
+fftw_plan mkGCFLayers(
+    fftw_plan p
+  , complexd dst[]
+  , complexd * table[]
+  , int num_layers
+  , const int supports[]
+  , int max_support
+  , int src_pad
+  , double t2
+  , const double ws[]
+  ){
+  return __mkGCFLayers<OVER>(
+        p
+      , dst
+      , table
+      , num_layers
+      , supports
+      , max_support
+      , src_pad
+      , t2
+      , ws
+      );
+}
+
 // This function is required to
 //   correctly calculate GCF, namely we
 //   need to know the correct w's mean value
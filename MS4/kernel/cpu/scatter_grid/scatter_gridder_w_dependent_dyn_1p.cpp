@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstring>
 #include <vector>
 
@@ -5,6 +6,7 @@
 #include <omp.h>
 #else
 #define omp_get_thread_num()  0
+#define omp_get_max_threads() 1
 #endif
 
 #ifdef _MSC_VER
@@ -46,6 +48,45 @@ void addGrids(
 #define VIS_MOD
 #endif
 
+// Pregrid a visibility and find the GCF layer to use for it.
+// Returns whether the visibility is out of bounds.
+template <
+    int over
+  , bool is_half_gcf
+  >
+inline
+bool pregridGCF(
+    double scale
+  , double wstep
+  , const Double3 & uvw
+  , int max_supp_here
+  , const complexd * gcf[]
+  , const int gcf_supps[]
+  , int grid_size
+  , Pregridded & pa
+  , complexd * & gcflp
+  , int & gcfsupp
+  ) {
+  pregridPoint<over, is_half_gcf>(scale, wstep, uvw, max_supp_here, pa, grid_size);
+  int index;
+  index = pa.gcf_layer_index;
+  if (is_half_gcf) {
+    if (index < 0)
+      gcflp = const_cast<complexd *>(gcf[-index]);
+    else
+      gcflp = const_cast<complexd *>(gcf[index]);
+  } else {
+      gcflp = const_cast<complexd *>(gcf[index]);
+  }
+  // Correction
+  gcfsupp = gcf_supps[pa.w_plane];
+  gcflp += (gcfsupp - max_supp_here) / 2 * (gcfsupp + 1);
+
+  return
+       pa.u < 0 || pa.u >= grid_size - max_supp_here
+    || pa.v < 0 || pa.v >= grid_size - max_supp_here;
+}
+
 template <
     int over
   , bool is_half_gcf
@@ -124,24 +165,9 @@ void gridKernel_scatter(
 #else
         vis[n] = {0.0, 0.0};
 #endif
-        pregridPoint<over, is_half_gcf>(scale, wstep, uvw[n], max_supp_here, pa[n], grid_size);
-        int index;
-        index = pa[n].gcf_layer_index;
-        if (is_half_gcf) {
-          if (index < 0)
-            gcflp[n] = const_cast<complexd *>(gcf[-index]);
-          else
-            gcflp[n] = const_cast<complexd *>(gcf[index]);
-        } else {
-            gcflp[n] = const_cast<complexd *>(gcf[index]);
-        }
-        // Correction
-        gcfsupp[n] = gcf_supps[pa[n].w_plane];
-        gcflp[n] += (gcfsupp[n] - max_supp_here) / 2 * (gcfsupp[n] + 1);
-  
-        not_inbound[n] =
-             pa[n].u < 0 || pa[n].u >= grid_size - max_supp_here
-          || pa[n].v < 0 || pa[n].v >= grid_size - max_supp_here;
+        not_inbound[n] = pregridGCF<over, is_half_gcf>(
+            scale, wstep, uvw[n], max_supp_here, gcf, gcf_supps, grid_size
+          , pa[n], gcflp[n], gcfsupp[n]);
       }
       for (int su = 0; su < max_supp_here; su++) { // Moved from 2-levels below according to Romein
         for (int i = 0; i < ts_ch; i++) {
@@ -265,6 +291,136 @@ ull gridKernelCPU##hgcfSuff(                              \
 gridKernelCPU(HalfGCF, true)
 gridKernelCPU(FullGCF, false)
 
+// Number of strips per thread for the strip gridder. More strips give
+// better load balance, but baselines crossing strip borders get
+// pregridded once per strip they touch.
+#define STRIPS_PER_THREAD 4
+
+// Memory-lean alternative to gridKernel_scatter_full. Instead of
+// giving every thread a private grid and adding them up afterwards,
+// threads work directly on the shared grid, each owning a strip of
+// grid rows (u) at a time. Baselines get routed to the strips their
+// uv track touches. This way we only need a single grid.
+template <
+    int over
+  , bool is_half_gcf
+  >
+ull gridKernel_scatter_strips(
+    double scale
+  , double wstep
+  , int baselines
+  , const int bl_supps[/* baselines */]
+  , complexd grid[]
+  , const complexd * gcf[]
+  , const Double3 * _uvw[]
+  , const complexd * _vis[]
+  , int ts_ch
+  , int grid_pitch
+  , int grid_size
+  , int gcf_supps[]
+  ) {
+  memset(grid, 0, sizeof(complexd) * grid_size * grid_pitch);
+
+  // Find the range of grid rows every baseline touches
+  std::vector<int> bl_umin(baselines), bl_umax(baselines);
+#pragma omp parallel for schedule(dynamic,23)
+  for(int bl = 0; bl < baselines; bl++) {
+    int max_supp_here = bl_supps[bl];
+    int umin = grid_size, umax = 0;
+    for(int n=0; n<ts_ch; n++) {
+      Pregridded pa;
+      complexd * gcflp;
+      int gcfsupp;
+      if (pregridGCF<over, is_half_gcf>(scale, wstep, _uvw[bl][n], max_supp_here, gcf, gcf_supps, grid_size
+                                        , pa, gcflp, gcfsupp)) continue;
+      umin = std::min(umin, int(pa.u));
+      umax = std::max(umax, pa.u + max_supp_here);
+    }
+    bl_umin[bl] = umin;
+    bl_umax[bl] = umax;
+  }
+
+  int
+      nstrips = STRIPS_PER_THREAD * omp_get_max_threads()
+    , strip_size = (grid_size + nstrips - 1) / nstrips
+    ;
+  ull ops = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:ops)
+  for(int strip = 0; strip < nstrips; strip++) {
+    int
+        strip_min = strip * strip_size
+      , strip_max = std::min(grid_size, strip_min + strip_size)
+      ;
+    complexd * _sgrid = grid;
+    __ACC(complexd, sgrid, grid_pitch);
+
+    std::vector<Pregridded> pa(ts_ch);
+    std::vector<complexd*> gcflp(ts_ch);
+    std::vector<int> gcfsupp(ts_ch);
+    std::vector<char> not_inbound(ts_ch);
+
+    for(int bl = 0; bl < baselines; bl++) {
+      if (bl_umax[bl] <= strip_min || bl_umin[bl] >= strip_max) continue;
+      int max_supp_here = bl_supps[bl];
+      const Double3 * uvw = _uvw[bl];
+      const complexd * vis = _vis[bl];
+      for(int n=0; n<ts_ch; n++)
+        not_inbound[n] = pregridGCF<over, is_half_gcf>(
+            scale, wstep, uvw[n], max_supp_here, gcf, gcf_supps, grid_size
+          , pa[n], gcflp[n], gcfsupp[n]);
+
+      // Same as gridKernel_scatter, except that we skip rows outside
+      // of our strip.
+      for (int su = 0; su < max_supp_here; su++) {
+        for (int i = 0; i < ts_ch; i++) {
+          if (not_inbound[i]) continue;
+          Pregridded p;
+          p = pa[i];
+          int gsu;
+          gsu = p.u + su;
+          if (gsu < strip_min || gsu >= strip_max) continue;
+          for (int sv = 0; sv < max_supp_here; sv++) {
+            int gsv;
+            gsv = p.v + sv;
+            complexd supportPixel;
+            if (is_half_gcf && p.gcf_layer_index < 0) {
+              supportPixel = conj(gcflp[i][su * gcfsupp[i] + sv]);
+            } else {
+              supportPixel = gcflp[i][su * gcfsupp[i] + sv];
+            }
+            sgrid[gsu][gsv] += vis[i] * supportPixel;
+          }
+          ops += max_supp_here;
+        }
+      }
+    }
+  }
+  return ops;
+}
+
+#define gridKernelCPUStrips(hgcfSuff, isHgcf)             \
+ull gridKernelCPUStrips##hgcfSuff(                        \
+    double scale                                          \
+  , double wstep                                          \
+  , int baselines                                         \
+  , const int bl_supps[/* baselines */]                   \
+  , complexd grid[]                                       \
+  , const complexd * gcf[]                                \
+  , const Double3 * uvw[]                                 \
+  , const complexd * vis[]                                \
+  , int ts_ch                                             \
+  , int grid_pitch                                        \
+  , int grid_size                                         \
+  , int gcf_supps[]                                       \
+  ){                                                      \
+  return gridKernel_scatter_strips<OVER, isHgcf>          \
+    ( scale, wstep, baselines, bl_supps, grid, gcf        \
+    , uvw, vis, ts_ch, grid_pitch, grid_size, gcf_supps); \
+}
+
+gridKernelCPUStrips(HalfGCF, true)
+gridKernelCPUStrips(FullGCF, false)
+
 void grid0(
     const Double3 uvw[]
   , const complexd vis[]
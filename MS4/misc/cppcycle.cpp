@@ -9,6 +9,12 @@
 #include "hogbom.h"
 #include "stats_n_utils.h"
 
+// Build with -DSTRIP_GRIDDER to grid into a single shared grid
+// instead of one grid per thread.
+#ifdef STRIP_GRIDDER
+#define gridKernelCPUFullGCF gridKernelCPUStripsFullGCF
+#endif
+
 // Config
 const double wstep = 10000.0;
 const double t2 = 0.02/2.0;
@@ -0,0 +1,89 @@
+// Compares generating w-planes one by one (mkGCFLayer, as in
+// cppcycle) against the batched mkGCFLayers.
+//
+// Usage: gcfbench [num of planes [max support]]
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include <omp.h>
+
+#include "common.h"
+#include "metrix.h"
+#include "GCF.h"
+#include "fft_dyn_padded.h"
+
+// Config, mostly the same as in cppcycle
+const double wstep = 1000.0;
+const double t2 = 0.02/2.0;
+const int over = OVER;
+const int over2 = over*over;
+const int pad = 2;
+const int gcfGrowth = 16;
+const int gcfMinSize = 3;
+
+int main(int argc, char * argv[])
+{
+  int numOfPlanes = argc > 1 ? atoi(argv[1]) : 59;
+  int gcfMaxSize = argc > 2 ? atoi(argv[2]) : 128;
+  int maxWPlane = numOfPlanes / 2;
+
+  typedef std::vector<complexd> cdv;
+  typedef std::vector<complexd*> cdpv;
+
+  std::vector<int> lsizes(numOfPlanes);
+  std::vector<double> ws(numOfPlanes);
+  size_t gcfDataSize = 0;
+  for (int l = 0; l < numOfPlanes; l++) {
+    lsizes[l] = std::min(gcfMaxSize, gcfMinSize + gcfGrowth * abs(l - maxWPlane));
+    ws[l] = wstep * (l - maxWPlane);
+    gcfDataSize += size_t(over2) * lsizes[l] * lsizes[l];
+  }
+  printf("%d w-planes, max support %d, over %d, %d threads\n",
+         numOfPlanes, gcfMaxSize, over, omp_get_max_threads());
+
+  fftInitThreading();
+
+  // One by one
+  cdv gcfData(gcfDataSize);
+  cdpv gcfTable(over2 * numOfPlanes);
+  double start = omp_get_wtime();
+  {
+    cdv arena(over * gcfMaxSize * (over * gcfMaxSize + pad));
+    fftw_plan plan = NULL;
+    complexd * dptr = gcfData.data();
+    complexd ** tptr = gcfTable.data();
+    for (int l = 0; l < numOfPlanes; l++) {
+      plan = mkGCFLayer(plan, dptr, tptr, arena.data(),
+                        lsizes[l], gcfMaxSize, pad, t2, ws[l]);
+      dptr += over2 * lsizes[l] * lsizes[l];
+      tptr += over2;
+    }
+    fftw_destroy_plan(plan);
+  }
+  double tloop = omp_get_wtime() - start;
+  printf("mkGCFLayer loop: %8.3f s\n", tloop);
+
+  // Batched
+  cdv gcfDataB(gcfDataSize);
+  cdpv gcfTableB(over2 * numOfPlanes);
+  start = omp_get_wtime();
+  fftw_plan plan = mkGCFLayers(NULL, gcfDataB.data(), gcfTableB.data(), numOfPlanes,
+                               lsizes.data(), gcfMaxSize, pad, t2, ws.data());
+  fftw_destroy_plan(plan);
+  double tbatch = omp_get_wtime() - start;
+  printf("mkGCFLayers:     %8.3f s (x%.2f)\n", tbatch, tloop / tbatch);
+
+  // Check we got the same thing. Might not be bit-identical, as FFTW
+  //   can pick different codelets depending on alignment.
+  double maxDiff = 0;
+  for (size_t i = 0; i < gcfDataSize; i++)
+    maxDiff = std::max(maxDiff, std::abs(gcfData[i] - gcfDataB[i]));
+  bool tablesOk = true;
+  for (int i = 0; i < over2 * numOfPlanes; i++)
+    tablesOk = tablesOk && gcfTable[i] - gcfData.data() == gcfTableB[i] - gcfDataB.data();
+  printf("Max difference: %e, tables %s\n", maxDiff, tablesOk ? "match" : "DIFFER");
+
+  return (maxDiff < 1e-9 && tablesOk) ? 0 : 1;
+}
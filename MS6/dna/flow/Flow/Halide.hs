@@ -20,8 +20,8 @@ module Flow.Halide
   , Dim, Dim0, Dim1, Dim2, Dim3, Dim4
   , dim0, dim1, (:.)(..), Z(..), nOfElements
     -- * Kernel wrappers
-  , halideKernel0, halideKernel1, halideKernel2, halideKernel3
-  , halideKernel1Write, halideKernel2Write
+  , halideKernel0, halideKernel1, halideKernel2, halideKernel3, halideKernel4
+  , halideKernel1Write, halideKernel2Write, halideKernel3Write, halideKernel4Write
   , halideBind, HalideBind
   , halidePrint, halideDump, halideReadDump
   , halideTextDump2D, halideTextDump4D
@@ -292,6 +292,23 @@ halideKernel3 name rep0 rep1 rep2 repR code = mergingKernel name (rep0 :. rep1 :
          return $ castVector $ arrayBuffer vecR
         code' _ _ = fail "halideKernel3: Received wrong number of input buffers!"
 
+halideKernel4 :: forall rr r0 r1 r2 r3. (HalideReprClass rr, HalideReprClass r0, HalideReprClass r1,
+                                         HalideReprClass r2, HalideReprClass r3)
+              => String
+              -> r0 -> r1 -> r2 -> r3 -> rr
+              -> HalideFun '[r0, r1, r2, r3] rr
+              -> Flow (ReprType r0) -> Flow (ReprType r1) -> Flow (ReprType r2) -> Flow (ReprType r3)
+              -> Kernel (ReprType rr)
+halideKernel4 name rep0 rep1 rep2 rep3 repR code = mergingKernel name (rep0 :. rep1 :. rep2 :. rep3 :. Z) repR code'
+  where code' [(v0,d0), (v1,d1), (v2,d2), (v3,d3)] ds = do
+         vecR <- halrCall repR (Proxy :: Proxy '[r0, r1, r2, r3]) code ds
+                          (Array (halrDim rep0 d0) (castVector v0))
+                          (Array (halrDim rep1 d1) (castVector v1))
+                          (Array (halrDim rep2 d2) (castVector v2))
+                          (Array (halrDim rep3 d3) (castVector v3))
+         return $ castVector $ arrayBuffer vecR
+        code' _ _ = fail "halideKernel4: Received wrong number of input buffers!"
+
 halideKernel1Write
   :: forall rr r0. (HalideReprClass rr, HalideReprClass r0)
   => String
@@ -321,6 +338,43 @@ halideKernel2Write name rep0 rep1 repR code = foldingKernel name (rep0 :. rep1 :
          return $ castVector $ arrayBuffer vecR
         code' _ _ _ = fail "halideKernel2Write: Received wrong number of input buffers!"
 
+halideKernel3Write
+  :: forall rr r0 r1 r2. (HalideReprClass rr, HalideReprClass r0,
+                          HalideReprClass r1, HalideReprClass r2)
+  => String
+  -> r0 -> r1 -> r2 -> rr
+  -> HalideFun '[r0, r1, r2] rr
+  -> Flow (ReprType r0) -> Flow (ReprType r1) -> Flow (ReprType r2) -> Flow (ReprType rr)
+  -> Kernel (ReprType rr)
+halideKernel3Write name rep0 rep1 rep2 repR code = foldingKernel name (rep0 :. rep1 :. rep2 :. (halrWrite repR) :. Z) code'
+  where code' [(v0,d0),(v1,d1),(v2,d2)] v3 ds = do
+         vecR <- halrCallWrite repR (Proxy :: Proxy '[r0, r1, r2]) code
+                               (Array (halrDim rep0 d0) (castVector v0))
+                               (Array (halrDim rep1 d1) (castVector v1))
+                               (Array (halrDim rep2 d2) (castVector v2))
+                               (Array (halrDim repR ds) (castVector v3))
+         return $ castVector $ arrayBuffer vecR
+        code' _ _ _ = fail "halideKernel3Write: Received wrong number of input buffers!"
+
+halideKernel4Write
+  :: forall rr r0 r1 r2 r3. (HalideReprClass rr, HalideReprClass r0, HalideReprClass r1,
+                             HalideReprClass r2, HalideReprClass r3)
+  => String
+  -> r0 -> r1 -> r2 -> r3 -> rr
+  -> HalideFun '[r0, r1, r2, r3] rr
+  -> Flow (ReprType r0) -> Flow (ReprType r1) -> Flow (ReprType r2) -> Flow (ReprType r3)
+  -> Flow (ReprType rr) -> Kernel (ReprType rr)
+halideKernel4Write name rep0 rep1 rep2 rep3 repR code = foldingKernel name (rep0 :. rep1 :. rep2 :. rep3 :. (halrWrite repR) :. Z) code'
+  where code' [(v0,d0),(v1,d1),(v2,d2),(v3,d3)] v4 ds = do
+         vecR <- halrCallWrite repR (Proxy :: Proxy '[r0, r1, r2, r3]) code
+                               (Array (halrDim rep0 d0) (castVector v0))
+                               (Array (halrDim rep1 d1) (castVector v1))
+                               (Array (halrDim rep2 d2) (castVector v2))
+                               (Array (halrDim rep3 d3) (castVector v3))
+                               (Array (halrDim repR ds) (castVector v4))
+         return $ castVector $ arrayBuffer vecR
+        code' _ _ _ = fail "halideKernel4Write: Received wrong number of input buffers!"
+
 -- | Simple kernel that shows the contents of a buffer as text
 halidePrint :: forall r. (HalideReprClass r, Show (HalrVal r))
             => r -> String -> Flow (ReprType r) -> Kernel ()
@@ -0,0 +1,30 @@
+#ifndef __CPU_THREADS_H
+#define __CPU_THREADS_H
+
+// Threading helpers shared by the hand-written CPU kernels
+
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+// Number of threads to use. We follow the Halide runtime and honour
+// HL_NUM_THREADS if it is set.
+inline
+int numThreads() {
+  const char * env = getenv("HL_NUM_THREADS");
+  int n = env ? atoi(env) : int(std::thread::hardware_concurrency());
+  return std::max(1, n);
+}
+
+// FFTW planning is not thread-safe, executing plans is. The planner
+// (including the thread count set by fftw_plan_with_nthreads) is
+// global to the process, so everybody creating FFTW plans has to hold
+// this lock, and leave the thread count at 1 when done.
+inline
+std::mutex & fftwPlannerMutex() {
+  static std::mutex m;
+  return m;
+}
+
+#endif
@@ -0,0 +1,247 @@
+// GCF service: Generates w-kernels on demand instead of reading a
+// precomputed one from a file. This way every w-bin can get the
+// kernel for its own w instead of the closest one we happen to have
+// lying around.
+//
+// Generation follows "mkGCFLayer" from MS4 (see
+// MS4/kernel/cpu/gcf/GCF.cpp): We fill the centre of an oversampled
+// arena with the w phase screen, inverse FFT it and extract
+// normalised layers for every oversampling offset.
+//
+// Generated kernels get kept in an in-memory LRU cache. Additionally,
+// if given a cache directory, we write every kernel we generate to a
+// file there, and memory-map files found there on later calls. The
+// files have the same layout as the "gcf<N>.dat" files, so they can
+// be used as such as well.
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <fftw3.h>
+
+#include "cpu_threads.h"
+
+typedef std::complex<double> complexd;
+
+// ** Generation
+
+// Both fftshift and ifftshift for even sizes
+static void fftshift_even(complexd * data, int size) {
+  int half = size / 2;
+  for (int i = 0; i < half; i++) {
+    for (int j = 0; j < size; j++) {
+      std::swap(data[i * size + j],
+                data[(i + half) * size + (j + half) % size]);
+    }
+  }
+}
+
+// Plans get created once per arena size and kept around, see
+// "fftwPlannerMutex"
+static std::map<int, fftw_plan> plans;
+
+static fftw_plan getPlan(int size, complexd * arena) {
+  std::lock_guard<std::mutex> lock(fftwPlannerMutex());
+  fftw_plan & p = plans[size];
+  if (p == NULL) {
+    fftw_complex * a = reinterpret_cast<fftw_complex *>(arena);
+    p = fftw_plan_dft_2d(size, size, a, a, FFTW_BACKWARD, FFTW_ESTIMATE);
+  }
+  return p;
+}
+
+// Output layout is [over][over][support][support] as the Halide
+// kernels expect it: The oversampling offset for u varies faster than
+// the one for v, and u is the inner coordinate of every layer. The
+// support has to be even, callers round odd sizes up (see "gcfSizer"
+// in Kernel/IO.hs).
+static int generate(double w, int support, int over, double t2, complexd * dst) {
+  if (support < 2 || support % 2 != 0 || over < 1) return -777;
+  const int size = support * over;
+  const int radius = support / 2;
+  const double normer = t2 / radius;
+
+  complexd * arena = reinterpret_cast<complexd *>(fftw_malloc(sizeof(complexd) * size * size));
+  if (arena == NULL) return -777;
+  std::fill(arena, arena + size * size, complexd(0, 0));
+
+  // Phase screen, centered in the arena. Unlike mkGCFLayer we split
+  // the edge samples between -radius and +radius, which makes the
+  // kernel exactly symmetric (see gcf_halide.h for why that matters).
+  // This is only possible with oversampling, otherwise +radius falls
+  // outside of the arena.
+  complexd * centre = arena + (size / 2) * (size + 1);
+  const int rmax = over > 1 ? radius : radius - 1;
+  for (int i = -radius; i <= rmax; i++) {
+    for (int j = -radius; j <= rmax; j++) {
+      double x = i * normer, y = j * normer;
+      double ph = w * (1 - sqrt(1 - x*x - y*y));
+      double amp = 1.0;
+      if (over > 1 && abs(i) == radius) amp /= 2;
+      if (over > 1 && abs(j) == radius) amp /= 2;
+      centre[i * size + j] = std::polar(amp, -2 * M_PI * ph);
+    }
+  }
+
+  fftshift_even(arena, size);
+  fftw_execute_dft(getPlan(size, arena),
+                   reinterpret_cast<fftw_complex *>(arena),
+                   reinterpret_cast<fftw_complex *>(arena));
+  fftshift_even(arena, size);
+
+  // Normalise every layer to sum up to one, and extract. Arena
+  // coordinates are (supp * over + overoff) in both dimensions, with
+  // v being the outer one.
+  std::vector<double> sums(over * over, 0.0);
+  for (int v = 0; v < size; v++)
+    for (int u = 0; u < size; u++)
+      sums[(v % over) * over + u % over] += arena[v * size + u].real();
+  for (int overv = 0; overv < over; overv++)
+  for (int overu = 0; overu < over; overu++) {
+    double sum = sums[overv * over + overu];
+    for (int suppv = 0; suppv < support; suppv++)
+    for (int suppu = 0; suppu < support; suppu++)
+      *dst++ = arena[(suppv * over + overv) * size + suppu * over + overu] / sum;
+  }
+
+  fftw_free(arena);
+  return 0;
+}
+
+// ** Caching
+
+// A kernel we have in memory. Either owned or mapped from a file.
+struct GCFEntry {
+  std::vector<complexd> owned;
+  void * mapped;
+  size_t mappedSize;
+
+  GCFEntry() : mapped(NULL), mappedSize(0) {}
+  ~GCFEntry() { if (mapped) munmap(mapped, mappedSize); }
+  const complexd * data() const {
+    return mapped ? reinterpret_cast<const complexd *>(mapped) : owned.data();
+  }
+};
+
+// Version of the generated kernels. Bump whenever generation
+// changes its output (sampling, normalisation, layout), so stale
+// kernels in the disk cache do not get picked up.
+static const int gcfFormat = 2;
+
+typedef std::tuple<int, double, int, int, double> GCFKey; // (format, w, support, over, t2)
+typedef std::list<std::pair<GCFKey, std::shared_ptr<GCFEntry> > > LRUList;
+
+static std::mutex lruMutex;
+static LRUList lru; // most recently used first
+static std::map<GCFKey, LRUList::iterator> lruIndex;
+
+static std::shared_ptr<GCFEntry> lruGet(const GCFKey & key) {
+  std::lock_guard<std::mutex> lock(lruMutex);
+  auto it = lruIndex.find(key);
+  if (it == lruIndex.end()) return nullptr;
+  lru.splice(lru.begin(), lru, it->second);
+  return it->second->second;
+}
+
+static void lruPut(const GCFKey & key, std::shared_ptr<GCFEntry> entry, int capacity) {
+  std::lock_guard<std::mutex> lock(lruMutex);
+  if (lruIndex.find(key) == lruIndex.end()) {
+    lru.emplace_front(key, entry);
+    lruIndex[key] = lru.begin();
+  }
+  // Entries that are still in use by somebody stay alive until they
+  // are done with them, thanks to shared_ptr.
+  while (lru.size() > size_t(std::max(capacity, 1))) {
+    lruIndex.erase(lru.back().first);
+    lru.pop_back();
+  }
+}
+
+static std::string cachePath(const char * dir, const GCFKey & key) {
+  char name[256];
+  snprintf(name, sizeof(name), "/gcf_v%d_w%.17g_s%d_o%d_t%.17g.dat",
+           std::get<0>(key), std::get<1>(key), std::get<2>(key), std::get<3>(key),
+           std::get<4>(key));
+  return std::string(dir) + name;
+}
+
+// Map a kernel from the disk cache. Files of the wrong size get
+// ignored (and overwritten later).
+static std::shared_ptr<GCFEntry> diskGet(const std::string & path, size_t bytes) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return nullptr;
+  std::shared_ptr<GCFEntry> entry;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && size_t(st.st_size) == bytes) {
+    void * p = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    if (p != MAP_FAILED) {
+      entry = std::make_shared<GCFEntry>();
+      entry->mapped = p;
+      entry->mappedSize = bytes;
+    }
+  }
+  close(fd);
+  return entry;
+}
+
+// Write a kernel to the disk cache. We write to a temporary file
+// first, so concurrent readers never see partial kernels. Failing to
+// write is not an error, we just won't be able to reuse the kernel.
+static void diskPut(const std::string & path, const GCFEntry & entry, size_t bytes) {
+  std::string tmp = path + ".XXXXXX";
+  int fd = mkstemp(&tmp[0]);
+  if (fd < 0) return;
+  fchmod(fd, 0644);
+  FILE * f = fdopen(fd, "wb");
+  if (f == NULL) { close(fd); remove(tmp.c_str()); return; }
+  bool ok = fwrite(entry.data(), 1, bytes, f) == bytes;
+  ok = (fclose(f) == 0) && ok;
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) remove(tmp.c_str());
+}
+
+// Writes the w-kernel with the given parameters to "dst", which must
+// have room for over*over*support*support complex numbers. "t2" is
+// half the field of view in direction cosines. "cache_dir" can be
+// NULL or empty to disable the disk cache; "lru_size" is the number
+// of kernels we keep in memory.
+extern "C"
+int gcf_get(const double w, const int32_t support, const int32_t over, const double t2,
+            const char * cache_dir, const int32_t lru_size, double * dst) {
+
+  GCFKey key(gcfFormat, w, support, over, t2);
+  const size_t bytes = sizeof(complexd) * over * over * support * support;
+
+  std::shared_ptr<GCFEntry> entry = lruGet(key);
+  if (!entry) {
+    bool useDisk = cache_dir != NULL && cache_dir[0] != 0;
+    std::string path = useDisk ? cachePath(cache_dir, key) : "";
+    if (useDisk) entry = diskGet(path, bytes);
+    if (!entry) {
+      entry = std::make_shared<GCFEntry>();
+      entry->owned.resize(over * over * support * support);
+      int res = generate(w, support, over, t2, entry->owned.data());
+      if (res != 0) return res;
+      if (useDisk) diskPut(path, *entry, bytes);
+    }
+    lruPut(key, entry, lru_size);
+  }
+
+  memcpy(dst, entry->data(), bytes);
+  return 0;
+}
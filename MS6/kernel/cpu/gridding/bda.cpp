@@ -0,0 +1,156 @@
+// Baseline-dependent averaging. Consecutive visibilities of a
+// baseline move slowly through the uv-plane - especially for short
+// baselines - so we can average them until the run would smear over
+// more than the given fraction of a grid cell. This gets applied to
+// raw visibilities (see "rawVisRepr"), before binning.
+//
+// Runs never cross baselines. The reader puts all time steps of a
+// baseline next to each other (see "oskarReadCode" in Kernel/IO.hs),
+// so given the number of time steps per baseline we know where every
+// baseline starts. Within a baseline, a run gets closed as soon as the
+// next visibility leaves the smearing limit in u, v or w. For w we
+// allow the same phase error at the corner of the field that the u/v
+// limit allows at its edge, so the averaged w stays within the
+// smearing limit of the w-kernel it gets gridded with.
+//
+// An averaged record stands for all visibilities of its run, so we
+// write out the mean u, v and w, but the sum of the visibilities. This
+// way gridding it with unit weight is the same as gridding the run
+// with natural weighting. For the PSF we sum unit visibilities
+// instead, so the PSF visibility is the run length (see
+// "kern_bda_psf_vis").
+//
+// The output has the same size as the input. Every baseline gets its
+// averaged visibilities compacted to its start, with the remaining
+// records marked as unused by setting u, v and w to NaN. The binner
+// (see Kernel/Binning.hs) skips those, so the gridder only ever sees
+// averaged visibilities. Threads work on whole baselines, so the
+// output does not depend on the number of threads.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "halide_buf.h"
+#include "cpu_threads.h"
+
+// Visibility fields, see scatter.cpp
+enum VisFields { _U=0, _V, _W, _R, _I,  _VIS_FIELDS };
+
+// Average visibilities [i0, i1) of "in", which must belong to the
+// same baseline, writing runs starting at "out + i0".
+static void averageRange(const double * in, double * out, int64_t stride,
+                         int32_t i0, int32_t i1,
+                         double scale, double smear, double maxDW, int32_t maxRun, bool psf) {
+
+  int32_t o = i0;
+  for (int32_t i = i0; i < i1; ) {
+    const double * first = in + i * stride;
+    double sum[_VIS_FIELDS] = { 0, 0, 0, 0, 0 };
+    int32_t j = i;
+    for (; j < i1 && j - i < maxRun; j++) {
+      const double * v = in + j * stride;
+      if (std::fabs(v[_U] - first[_U]) * scale > smear ||
+          std::fabs(v[_V] - first[_V]) * scale > smear ||
+          std::fabs(v[_W] - first[_W]) > maxDW)
+        break;
+      for (int f = _U; f <= _W; f++) sum[f] += v[f];
+      sum[_R] += psf ? 1 : v[_R];
+      sum[_I] += psf ? 0 : v[_I];
+    }
+    // Write out mean coordinates and summed visibility. Note that we
+    // have made at least one step, as the first visibility is always
+    // within the limit.
+    double * v = out + o * stride;
+    for (int f = _U; f <= _W; f++) v[f] = sum[f] / (j - i);
+    v[_R] = sum[_R]; v[_I] = sum[_I];
+    o++;
+    i = j;
+  }
+
+  // Mark the rest as unused
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  for (int32_t i = o; i < i1; i++) {
+    double * v = out + i * stride;
+    v[_U] = v[_V] = v[_W] = nan;
+    v[_R] = v[_I] = 0;
+  }
+}
+
+extern "C"
+int kern_bda(const double _scale, const double _smear, const int32_t _max_run,
+             const int32_t _times, const int32_t _psf,
+             buffer_t *_vis_buffer, buffer_t *_out_buffer) {
+
+  const int32_t nvis = _vis_buffer->extent[1];
+  const int64_t stride = _vis_buffer->stride[1];
+  const double * vis = reinterpret_cast<const double *>(_vis_buffer->host);
+  double * out = reinterpret_cast<double *>(_out_buffer->host);
+  if (_vis_buffer->stride[0] != 1 || _out_buffer->stride[0] != 1 ||
+      _vis_buffer->extent[0] != _VIS_FIELDS ||
+      _out_buffer->extent[1] != nvis || _out_buffer->stride[1] != stride)
+    return -999;
+  if (_max_run < 1 || _smear < 0 || _times < 1) return -999;
+
+  // Largest w difference. The u/v limit allows a phase change of
+  // smear/2 turns at the edge of the field (l = scale/2), we allow the
+  // same for the w-term at its corner.
+  const double maxDW = _smear / 2 / (1 - std::sqrt(1 - _scale * _scale / 2));
+
+  // Baselines in the buffer. The buffer minimum is the index of the
+  // first visibility in the data set, so the buffer might start in
+  // the middle of a baseline.
+  const int32_t lead = (_times - _vis_buffer->min[1] % _times) % _times;
+  const int32_t nbl = (lead > 0 ? 1 : 0) + (nvis - lead + _times - 1) / _times;
+  auto baselineStart = [&](int32_t bl) {
+    if (bl == 0) return int32_t(0);
+    int64_t i = lead > 0 ? lead + int64_t(bl - 1) * _times : int64_t(bl) * _times;
+    return int32_t(std::min<int64_t>(i, nvis));
+  };
+
+  // Split baselines between threads
+  const int nthreads = std::max(1, std::min(numThreads(), std::min(nbl, nvis / 1024)));
+  auto work = [&](int t) {
+    int32_t bl0 = int32_t(int64_t(nbl) * t / nthreads),
+            bl1 = int32_t(int64_t(nbl) * (t + 1) / nthreads);
+    for (int32_t bl = bl0; bl < bl1; bl++)
+      averageRange(vis, out, stride, baselineStart(bl), baselineStart(bl + 1),
+                   _scale, _smear, maxDW, _max_run, _psf != 0);
+  };
+  if (nthreads == 1) work(0);
+  else {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nthreads; t++) threads.push_back(std::thread(work, t));
+    for (std::thread & t : threads) t.join();
+  }
+  return 0;
+}
+
+// PSF visibilities for averaged data. Replaces "kern_psf_vis" (see
+// psf_vis.cpp), which would set every visibility to 1 and so lose the
+// run length. Rotation only changed the phase, so the amplitude is
+// still the run length we put there in "kern_bda".
+extern "C"
+int kern_bda_psf_vis(buffer_t *_vis_buffer, buffer_t *_out_buffer) {
+
+  const int32_t nvis = _vis_buffer->extent[1];
+  const int64_t stride = _vis_buffer->stride[1];
+  const double * vis = reinterpret_cast<const double *>(_vis_buffer->host);
+  double * out = reinterpret_cast<double *>(_out_buffer->host);
+  if (_vis_buffer->stride[0] != 1 || _out_buffer->stride[0] != 1 ||
+      _vis_buffer->extent[0] != _VIS_FIELDS ||
+      _out_buffer->extent[1] != nvis || _out_buffer->stride[1] != stride)
+    return -999;
+
+  for (int32_t i = 0; i < nvis; i++) {
+    const double * v = vis + i * stride;
+    double * o = out + i * stride;
+    o[_U] = v[_U]; o[_V] = v[_V]; o[_W] = v[_W];
+    o[_R] = std::hypot(v[_R], v[_I]);
+    o[_I] = 0;
+  }
+  return 0;
+}
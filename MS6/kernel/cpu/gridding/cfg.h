@@ -1,6 +1,8 @@
 #ifndef __GCF_CFG_H
 #define __GCF_CFG_H
 
+// Oversampling factor of the GPU kernels. The CPU kernels in
+// scatter.cpp and degrid.cpp get generated for several factors.
 const int OVER = 8;
 
 const int
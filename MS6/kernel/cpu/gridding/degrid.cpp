@@ -7,15 +7,43 @@
 #endif
 
 #include "utils.h"
+#include "gcf_halide.h"
 
 using namespace Halide;
 
-std::string mkKernelName(const std::string & prefix, int GCF_SIZE){
-  return prefix + "_" + std::to_string(GCF_SIZE);
+// A GCF_SIZE of zero stands for a kernel that takes the GCF size at
+// runtime. Kernels for an oversampling factor other than 8 (our
+// default) get it added to their name, e.g. "kern_degrid_o16_32".
+std::string mkKernelName(const std::string & prefix, int GCF_SIZE, int OVER = 8){
+  std::string name = prefix;
+  if (OVER != 8) name += "_o" + std::to_string(OVER);
+  if (GCF_SIZE == 0) return name + "_dyn";
+  return name + "_" + std::to_string(GCF_SIZE);
 }
 
-Module degridKernel(Target target, int GCF_SIZE) {
-  const int OVER = 8;
+// Oversampling factors we generate kernels for
+const std::vector<int> overs = { 4, 8, 16, 32 };
+
+// "storeT" is the type visibilities and GCF are stored as. The grid
+// stays double precision, and so does the accumulation of the
+// degridded visibility. For "quadrant", NPOL and "soa" see
+// scatter.cpp. With "soa" the output uses the same layout as the input.
+//
+// With "par" set, we use a schedule that works on chunks of
+// visibilities in parallel - degridding only ever writes the
+// visibility it works on, so there are no conflicts. Every GCF row
+// gets multiplied with the grid in vectors of VEC complex numbers,
+// accumulating VEC partial sums per visibility that we only add up at
+// the end. This changes the order of summation, so results are not
+// bit-identical to the sequential kernel.
+//
+// With "rot" set, visibilities get rotated to the facet on the fly,
+// using parameters from "kern_rotate_params" (see rotate.cpp). The
+// output visibilities are rotated, so this replaces running
+// "kern_rotate" first.
+Module degridKernel(Target target, int GCF_SIZE, Type storeT = Float(64), int OVER = 8,
+                    bool quadrant = false, int NPOL = 1, bool soa = false,
+                    bool par = false, bool rot = false) {
 
   // ** Input
 
@@ -23,42 +51,68 @@ Module degridKernel(Target target, int GCF_SIZE) {
   Param<int> grid_size("grid_size");
   Param<int> margin_size("margin_size");
 
-  // Visibilities: Array of 5-pairs, packed together with UVW
+  // Visibilities: Array of 5-pairs, packed together with UVW. With
+  // multiple polarisations, we have more real/imaginary pairs.
   enum VisFields { _U=0, _V, _W, _R, _I,  _VIS_FIELDS };
-  ImageParam vis(type_of<double>(), 2, "vis");
-  vis.set_min(0,0).set_stride(0,1).set_extent(0,_VIS_FIELDS)
-     .set_stride(1,_VIS_FIELDS);
+  const int visFields = _VIS_FIELDS + _CPLX_FIELDS * (NPOL - 1);
+  ImageParam vis(storeT, 2, "vis");
+  Func visRaw("visRaw"), visF("visF"); Var vf("vf"), vt("vt");
+  if (!soa) {
+    vis.set_min(0,0).set_stride(0,1).set_extent(0,visFields)
+       .set_stride(1,visFields);
+    visRaw(vf, vt) = vis(vf, vt);
+  } else {
+    vis.set_stride(0,1)
+       .set_min(1,0).set_extent(1,visFields).set_stride(1,vis.extent(0));
+    visRaw(vf, vt) = vis(vt, vf);
+  }
+
+  // Facet rotation parameters
+  ImageParam rotp(type_of<double>(), 1, "rot");
+  rotp.set_min(0,0).set_stride(0,1).set_extent(0,_MATRIX_FIELDS+_VECTOR_FIELDS);
+  if (rot) {
+    visF(vf, vt) = rotateVisField(rotp, visRaw, vf, vt);
+  } else {
+    visF(vf, vt) = visRaw(vf, vt);
+  }
 
   // GCF: Array of OxOxSxS complex numbers. We "fuse" two dimensions
-  // as Halide only supports up to 4 dimensions.
-  ImageParam gcf_fused(type_of<double>(), 4, "gcf");
+  // as Halide only supports up to 4 dimensions. Without a fixed
+  // GCF_SIZE, S is whatever the buffer says.
+  ImageParam gcf_fused(storeT, 4, "gcf");
+  Expr gcf_size = GCF_SIZE > 0 ? Expr(GCF_SIZE) : gcf_fused.extent(1);
   gcf_fused
      .set_min(0,0).set_stride(0,1).set_extent(0,_CPLX_FIELDS)
-     .set_min(1,0).set_stride(1,_CPLX_FIELDS).set_extent(1,GCF_SIZE)
-     .set_min(2,0).set_stride(2,_CPLX_FIELDS*GCF_SIZE).set_extent(2,GCF_SIZE)
-     .set_min(3,0).set_stride(3,_CPLX_FIELDS*GCF_SIZE*GCF_SIZE).set_extent(3,OVER*OVER);
+     .set_min(1,0).set_stride(1,_CPLX_FIELDS)
+     .set_min(2,0).set_stride(2,_CPLX_FIELDS*gcf_size).set_extent(2,gcf_size)
+     .set_min(3,0).set_stride(3,_CPLX_FIELDS*gcf_size*gcf_size).set_extent(3,gcfLayers(OVER, quadrant));
+  if (GCF_SIZE > 0) gcf_fused.set_extent(1,GCF_SIZE);
 
   // Get grid limits. This limits the uv pixel coordinates we accept
   // for the top-left corner of the GCF.
   ImageParam uvg(type_of<double>(), 3, "uvg");
-  uvg.set_stride(0,1).set_extent(0,_CPLX_FIELDS)
-     .set_stride(1,_CPLX_FIELDS);
-  Expr gcf_margin = max(0, (margin_size - GCF_SIZE) / 2);
+  uvg.set_stride(0,1).set_extent(0,_CPLX_FIELDS*NPOL)
+     .set_stride(1,_CPLX_FIELDS*NPOL);
+  Expr gcf_margin = max(0, (margin_size - gcf_size) / 2);
   Expr min_u = uvg.min(1) + gcf_margin;
-  Expr max_u = uvg.min(1) + uvg.extent(1) - GCF_SIZE - 1 - gcf_margin;
+  Expr max_u = uvg.min(1) + uvg.extent(1) - gcf_size - 1 - gcf_margin;
   Expr min_v = uvg.min(2) + gcf_margin;
-  Expr max_v = uvg.min(2) + uvg.extent(2) - GCF_SIZE - 1 - gcf_margin;
+  Expr max_v = uvg.min(2) + uvg.extent(2) - gcf_size - 1 - gcf_margin;
 
-  std::vector<Halide::Argument> args = { scale, grid_size, margin_size, gcf_fused, uvg, vis };
+  std::vector<Halide::Argument> args = { scale, grid_size, margin_size };
+  if (rot) args.push_back(rotp);
+  args.push_back(gcf_fused);
+  args.push_back(uvg);
+  args.push_back(vis);
 
   // ** Helpers
 
   // Coordinate preprocessing
   Func uvs("uvs"), uv("uv"), overc("overc");
   Var uvdim("uvdim"), tdim("tdim3");
-  uvs(uvdim, tdim) = vis(uvdim, tdim) * scale;
+  uvs(uvdim, tdim) = cast<double>(visF(uvdim, tdim)) * scale;
   overc(uvdim, tdim) = clamp(cast<int>(round(OVER * (uvs(uvdim, tdim) - floor(uvs(uvdim, tdim))))), 0, OVER-1);
-  uv(uvdim, tdim) = cast<int>(round(uvs(uvdim, tdim)) + grid_size / 2 - GCF_SIZE / 2);
+  uv(uvdim, tdim) = cast<int>(round(uvs(uvdim, tdim)) + grid_size / 2 - gcf_size / 2);
 
   // Visibilities to ignore due to being out of bounds
   Func inBound("inBound");
@@ -70,53 +124,164 @@ Module degridKernel(Target target, int GCF_SIZE) {
   Func gcf("gcf");
   Var suppx("suppx"), suppy("suppy"), overx("overx"), overy("overy");
   gcf(suppx, suppy, tdim)
-      = Complex(gcf_fused(_REAL, suppx, suppy, overc(_U, tdim) + OVER * overc(_V, tdim)),
-                gcf_fused(_IMAG, suppx, suppy, overc(_U, tdim) + OVER * overc(_V, tdim)));
+      = gcfLookup(gcf_fused, Float(64), gcf_size, OVER, quadrant,
+                  suppx, suppy, overc(_U, tdim), overc(_V, tdim));
 
   // ** Output
 
+  if (par) {
+    // Partial sums per vector lane. For GCF sizes that are not a
+    // multiple of the vector size, we mask out lanes beyond the GCF.
+    const int VEC = 4;
+    Var lane("lane");
+    RDom rrow(0, (gcf_size + VEC - 1) / VEC, 0, gcf_size);
+    Expr gx = rrow.x * VEC + lane;
+    Expr valid = GCF_SIZE > 0 && GCF_SIZE % VEC == 0 ? const_true() : gx < gcf_size;
+    Expr gxc = GCF_SIZE > 0 && GCF_SIZE % VEC == 0 ? gx : min(gx, gcf_size - 1);
+    Expr u = gxc + clamp(uv(_U, tdim), min_u, max_u);
+    Expr v = rrow.y + clamp(uv(_V, tdim), min_v, max_v);
+    Complex prod = Complex(uvg(_REAL, u, v), uvg(_IMAG, u, v)) *
+                   Complex(gcf(gxc, rrow.y, tdim));
+    Func lanes("lanes");
+    Expr zero = cast<double>(0);
+    lanes(lane, tdim) = Tuple(zero, zero);
+    lanes(lane, tdim) = Tuple(lanes(lane, tdim)[0] + select(valid, prod.real, zero),
+                              lanes(lane, tdim)[1] + select(valid, prod.imag, zero));
+    Expr sumR = lanes(0, tdim)[0], sumI = lanes(0, tdim)[1];
+    for (int l = 1; l < VEC; l++) {
+      sumR += lanes(l, tdim)[0];
+      sumI += lanes(l, tdim)[1];
+    }
+
+    Func vis_out("vis_out");
+    Expr visv = cast<double>(visF(uvdim, tdim));
+    vis_out(uvdim, tdim) = select(inBound(tdim) && uvdim == _R, visv - sumR,
+                                  inBound(tdim) && uvdim == _I, visv - sumI,
+                                  visv);
+
+    // Parallelise over chunks of visibilities
+    Var to("to"), ti("ti");
+    vis_out.bound(uvdim, 0, visFields).unroll(uvdim)
+           .split(tdim, to, ti, 64).parallel(to);
+    overc.compute_at(vis_out, ti);
+    uv.compute_at(vis_out, ti);
+    inBound.compute_at(vis_out, ti);
+    lanes.compute_at(vis_out, ti).vectorize(lane, VEC);
+    lanes.update().vectorize(lane, VEC);
+
+    std::string prefix = quadrant ? "kern_degrid_par_q" : "kern_degrid_par";
+    return vis_out.compile_to_module(args, mkKernelName(prefix, GCF_SIZE, OVER), target);
+  }
+
   // We cannot change "vis" as "uv" depends on it, so we have to make
   // a copy.
   Func vis_out("vis_out");
-  vis_out(uvdim, tdim) = vis(uvdim, tdim);
-  vis_out.bound(uvdim, 0, _VIS_FIELDS);
+  if (!soa) {
+    vis_out(uvdim, tdim) = cast<double>(visF(uvdim, tdim));
+  } else {
+    vis_out(tdim, uvdim) = cast<double>(visF(uvdim, tdim));
+  }
+  vis_out.bound(uvdim, 0, visFields);
 
   // Reduction domain.
   RDom red(
-     _R, 2
-    , 0, GCF_SIZE
-    , 0, GCF_SIZE);
+     _R, _CPLX_FIELDS*NPOL
+    , 0, gcf_size
+    , 0, gcf_size);
   RVar rcmplx = red.x, rgcfx = red.y, rgcfy = red.z;
 
+  // Grid fields to use. With multiple polarisations, "rcmplx" also
+  // selects the polarisation.
+  Expr uvgR = _REAL, uvgI = _IMAG, part = rcmplx-_R;
+  if (NPOL > 1) {
+    uvgR = _REAL + (rcmplx-_R) / _CPLX_FIELDS * _CPLX_FIELDS;
+    uvgI = _IMAG + (rcmplx-_R) / _CPLX_FIELDS * _CPLX_FIELDS;
+    part = (rcmplx-_R) % _CPLX_FIELDS;
+  }
+
   // Subtract visibilites in-place
   Expr u = rgcfx + clamp(uv(_U, tdim), min_u, max_u);
   Expr v = rgcfy + clamp(uv(_V, tdim), min_v, max_v);
-  vis_out(rcmplx, tdim) -=
+  Expr contrib =
       select(inBound(tdim),
-             (Complex(uvg(_REAL, u, v), uvg(_IMAG, u, v)) *
-              Complex(gcf(rgcfx, rgcfy, tdim))).unpack(rcmplx-_R),
+             (Complex(uvg(uvgR, u, v), uvg(uvgI, u, v)) *
+              Complex(gcf(rgcfx, rgcfy, tdim))).unpack(part),
              undef<double>());
+  if (!soa) {
+    vis_out(rcmplx, tdim) -= contrib;
+  } else {
+    vis_out(tdim, rcmplx) -= contrib;
+  }
 
-  // Compute UV & oversampling coordinates per visibility
-  overc.compute_at(vis_out, tdim);
-  uv.compute_at(vis_out, tdim);
-  inBound.compute_at(vis_out, tdim);
-  vis_out.unroll(uvdim);
+  // Compute UV & oversampling coordinates per visibility. For SoA,
+  // do it up-front, vectorised across visibilities (see scatter.cpp).
+  if (!soa) {
+    if (rot) visF.compute_at(vis_out, tdim).bound(vf, 0, _VIS_FIELDS).unroll(vf);
+    overc.compute_at(vis_out, tdim);
+    uv.compute_at(vis_out, tdim);
+    inBound.compute_at(vis_out, tdim);
+    vis_out.unroll(uvdim);
+  } else {
+    overc.compute_root().bound(uvdim, 0, 2).reorder(uvdim, tdim).unroll(uvdim).vectorize(tdim, 4);
+    uv.compute_root().bound(uvdim, 0, 2).reorder(uvdim, tdim).unroll(uvdim).vectorize(tdim, 4);
+    inBound.compute_root().vectorize(tdim, 4);
+    vis_out.vectorize(tdim, 4);
+  }
   vis_out.update().unroll(rcmplx);
 
-  return vis_out.compile_to_module(args, mkKernelName("kern_degrid", GCF_SIZE), target);
+  // Convert back to storage type, if required
+  if (storeT.bits() == 32) {
+    Func vis_cast("vis_cast");
+    vis_cast(uvdim, tdim) = cast(storeT, vis_out(uvdim, tdim));
+    vis_cast.bound(uvdim, 0, visFields).unroll(uvdim);
+    vis_out.compute_at(vis_cast, tdim);
+    return vis_cast.compile_to_module(args, mkKernelName("kern_degrid_f32", GCF_SIZE, OVER), target);
+  }
+
+  std::string prefix = quadrant ? "kern_degrid_q" : "kern_degrid";
+  if (NPOL > 1) prefix += "_pol" + std::to_string(NPOL);
+  if (soa) prefix += "_soa";
+  if (rot) prefix += "_rot";
+  return vis_out.compile_to_module(args, mkKernelName(prefix, GCF_SIZE, OVER), target);
 }
 
 int main(int argc, char **argv)
 {
     if (argc < 2) return 1;
     Target target(get_target_from_environment().os, Target::X86, 64, { Target::SSE41, Target::AVX });
-    std::vector<Module> modules =
-      { degridKernel(target,  8)
-      , degridKernel(target, 16)
-      , degridKernel(target, 32)
-      , degridKernel(target, 64)
+    std::vector<Module> modules;
+    for (int over : overs) {
+      for (int size : { 8, 16, 32, 64, 0 }) {
+        modules.push_back(degridKernel(target, size, Float(64), over));
+        modules.push_back(degridKernel(target, size, Float(64), over, true));
+      }
+    }
+    // Mixed precision only for the default oversampling factor
+    std::vector<Module> f32modules =
+      { degridKernel(target,  8, Float(32))
+      , degridKernel(target, 16, Float(32))
+      , degridKernel(target, 32, Float(32))
+      , degridKernel(target, 64, Float(32))
       };
+    modules.insert(modules.end(), f32modules.begin(), f32modules.end());
+    // Full polarisation, again only for the default oversampling factor
+    for (int size : { 8, 16, 32, 64, 0 }) {
+      modules.push_back(degridKernel(target, size, Float(64), 8, false, 4));
+    }
+    // Structure-of-arrays visibilities, likewise
+    for (int size : { 8, 16, 32, 64, 0 }) {
+      modules.push_back(degridKernel(target, size, Float(64), 8, false, 1, true));
+    }
+    // Parallel degridder, for the default oversampling factor
+    for (int size : { 8, 16, 32, 64, 0 }) {
+      modules.push_back(degridKernel(target, size, Float(64), 8, false, 1, false, true));
+      modules.push_back(degridKernel(target, size, Float(64), 8, true, 1, false, true));
+    }
+    // Degridder rotating visibilities on the fly, likewise
+    for (int size : { 8, 16, 32, 64, 0 }) {
+      modules.push_back(degridKernel(target, size, Float(64), 8, false, 1, false, false, true));
+      modules.push_back(degridKernel(target, size, Float(64), 8, true, 1, false, false, true));
+    }
     Module linked = link_modules("kern_degrids", modules);
     compile_module_to_c_header(linked, std::string(argv[1]) + ".h");
     compile_module_to_object(linked, argv[1]);
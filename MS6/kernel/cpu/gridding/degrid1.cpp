@@ -1,19 +1,118 @@
 #include "gcf_common.h"
 
 extern "C" {
-int kern_degrid_8(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer, buffer_t *_vis_buffer, buffer_t *_vis_out_buffer);
-int kern_degrid_16(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer, buffer_t *_vis_buffer, buffer_t *_vis_out_buffer);
-int kern_degrid_32(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer, buffer_t *_vis_buffer, buffer_t *_vis_out_buffer);
-int kern_degrid_64(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer, buffer_t *_vis_buffer, buffer_t *_vis_out_buffer);
+#define __DECL(name) int name(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer, buffer_t *_vis_buffer, buffer_t *_vis_out_buffer);
+#define __DECL_SIZES(pre) __DECL(pre ## _8) __DECL(pre ## _16) __DECL(pre ## _32) __DECL(pre ## _64) __DECL(pre ## _dyn)
+__DECL_SIZES(kern_degrid)
+__DECL_SIZES(kern_degrid_o4)
+__DECL_SIZES(kern_degrid_o16)
+__DECL_SIZES(kern_degrid_o32)
+__DECL_SIZES(kern_degrid_q)
+__DECL_SIZES(kern_degrid_q_o4)
+__DECL_SIZES(kern_degrid_q_o16)
+__DECL_SIZES(kern_degrid_q_o32)
+__DECL_SIZES(kern_degrid_pol4)
+__DECL_SIZES(kern_degrid_soa)
+__DECL_SIZES(kern_degrid_par)
+__DECL_SIZES(kern_degrid_par_q)
+__DECL(kern_degrid_f32_8)
+__DECL(kern_degrid_f32_16)
+__DECL(kern_degrid_f32_32)
+__DECL(kern_degrid_f32_64)
+
+#define __CALL(name) name(_scale, _grid_size, _margin_size, _gcf_buffer, _uvg_buffer, _vis_buffer, _vis_out_buffer)
+#define __I_CASE(pre, siz) case siz: return __CALL(pre ## _ ## siz);
+// Other sizes go to the slower generic kernel
+#define __SIZES(pre)   \
+  switch( size ) {     \
+    __I_CASE(pre,  8)  \
+    __I_CASE(pre, 16)  \
+    __I_CASE(pre, 32)  \
+    __I_CASE(pre, 64)  \
+  }                    \
+  if (size > 0) return __CALL(pre ## _dyn);
 
 int kern_degrid(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer, buffer_t *_vis_buffer, buffer_t *_vis_out_buffer) {
   int32_t size = checkSize(*_gcf_buffer);
-  #define __I_CASE(siz) case siz: return kern_degrid_ ## siz (_scale, _grid_size, _margin_size, _gcf_buffer, _uvg_buffer, _vis_buffer, _vis_out_buffer);
+  switch( checkOver(*_gcf_buffer) ) {
+    case  4: __SIZES(kern_degrid_o4)  break;
+    case  8: __SIZES(kern_degrid)     break;
+    case 16: __SIZES(kern_degrid_o16) break;
+    case 32: __SIZES(kern_degrid_o32) break;
+  }
+  // Otherwise it might be a quadrant GCF (see gcf_halide.h)
+  switch( checkOverQ(*_gcf_buffer) ) {
+    case  4: __SIZES(kern_degrid_q_o4)  break;
+    case  8: __SIZES(kern_degrid_q)     break;
+    case 16: __SIZES(kern_degrid_q_o16) break;
+    case 32: __SIZES(kern_degrid_q_o32) break;
+  }
+  return -555;
+}
+
+// Single-precision visibilities and GCF, double-precision grid.
+// Bench-only, see kern_scatter_f32.
+int kern_degrid_f32(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer, buffer_t *_vis_buffer, buffer_t *_vis_out_buffer) {
+  int32_t size = checkSize(*_gcf_buffer);
   switch( size ) {
-    __I_CASE( 8)
-    __I_CASE(16)
-    __I_CASE(32)
-    __I_CASE(64)
+    __I_CASE(kern_degrid_f32,  8)
+    __I_CASE(kern_degrid_f32, 16)
+    __I_CASE(kern_degrid_f32, 32)
+    __I_CASE(kern_degrid_f32, 64)
+  }
+  return -555;
+}
+
+// Full polarisation: Visibilities have four complex values (XX, XY,
+// YX, YY), which go to four interleaved grids in one pass.
+int kern_degrid_pol4(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer, buffer_t *_vis_buffer, buffer_t *_vis_out_buffer) {
+  int32_t size = checkSize(*_gcf_buffer);
+  if (checkOver(*_gcf_buffer) == 8) {
+    __SIZES(kern_degrid_pol4)
+  }
+  return -555;
+}
+
+
+// Structure-of-arrays visibilities: One plane each for u, v, w, real
+// and imaginary part (see scatter.cpp).
+int kern_degrid_soa(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer, buffer_t *_vis_buffer, buffer_t *_vis_out_buffer) {
+  int32_t size = checkSize(*_gcf_buffer);
+  if (checkOver(*_gcf_buffer) == 8) {
+    __SIZES(kern_degrid_soa)
+  }
+  return -555;
+}
+
+// Parallel degridder with vectorised GCF rows (see degrid.cpp). Only
+// for the default oversampling factor.
+int kern_degrid_par(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer, buffer_t *_vis_buffer, buffer_t *_vis_out_buffer) {
+  int32_t size = checkSize(*_gcf_buffer);
+  if (checkOver(*_gcf_buffer) == 8) {
+    __SIZES(kern_degrid_par)
+  }
+  if (checkOverQ(*_gcf_buffer) == 8) {
+    __SIZES(kern_degrid_par_q)
+  }
+  return -555;
+}
+
+// Degridder rotating visibilities on the fly (see degrid.cpp). Takes
+// the facet rotation parameters in addition.
+#undef __DECL
+#undef __CALL
+#define __DECL(name) int name(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_rot_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer, buffer_t *_vis_buffer, buffer_t *_vis_out_buffer);
+#define __CALL(name) name(_scale, _grid_size, _margin_size, _rot_buffer, _gcf_buffer, _uvg_buffer, _vis_buffer, _vis_out_buffer)
+__DECL_SIZES(kern_degrid_rot)
+__DECL_SIZES(kern_degrid_q_rot)
+
+int kern_degrid_rot(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_rot_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer, buffer_t *_vis_buffer, buffer_t *_vis_out_buffer) {
+  int32_t size = checkSize(*_gcf_buffer);
+  if (checkOver(*_gcf_buffer) == 8) {
+    __SIZES(kern_degrid_rot)
+  }
+  if (checkOverQ(*_gcf_buffer) == 8) {
+    __SIZES(kern_degrid_q_rot)
   }
   return -555;
 }
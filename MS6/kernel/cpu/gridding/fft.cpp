@@ -237,8 +237,9 @@ Func W(int N, double sign) {
 }
 
 // Compute the N point DFT of dimension 1 (columns) of x using
-// radix R.
-Func fft_dim1(Func x, const std::vector<int> &NR, double sign, int group_size = 4) {
+// radix R. With "parallel" set, groups of DFTs get distributed
+// across threads.
+Func fft_dim1(Func x, const std::vector<int> &NR, double sign, int group_size = 4, bool parallel = false) {
     int N = product(NR);
     Var n0("n0"), n1("n1");
 
@@ -315,6 +316,9 @@ Func fft_dim1(Func x, const std::vector<int> &NR, double sign, int group_size =
     // group.
     Var group("g");
     x.update().split(n0, group, n0, group_size).reorder(n0, r_, s_, group).vectorize(n0);
+    if (parallel) {
+        x.update().parallel(group);
+    }
     for (size_t i = 0; i < stages.size() - 1; i++) {
         stages[i].compute_at(x, group).update().vectorize(n0);
     }
@@ -331,10 +335,24 @@ Func transpose(Func f) {
     return fT;
 }
 
+// Schedule a transpose computed at "at" in square tiles, so reads
+// and writes both stay within a few cache lines. Rows of tiles get
+// distributed across threads.
+void tile_transpose(Func fT, Func at, int group) {
+    const int tile = 4 * group;
+    Var a = fT.args()[0], b = fT.args()[1];
+    Var ao("ao"), bo("bo"), ai("ai"), bi("bi");
+    fT.compute_at(at, outermost(at))
+      .tile(a, b, ao, bo, ai, bi, tile, tile)
+      .vectorize(ai, group)
+      .parallel(bo);
+}
+
 // Compute the N0 x N1 2D complex DFT of x using radixes R0, R1.
 // sign = -1 indicates a forward DFT, sign = 1 indicates an inverse
-// DFT.
-Func fft2d_c2c(Func x, const std::vector<int> &R0, const std::vector<int> &R1, double sign) {
+// DFT. With "parallel" set, both passes and the transposes between
+// them get distributed across threads.
+Func fft2d_c2c(Func x, const std::vector<int> &R0, const std::vector<int> &R1, double sign, bool parallel = false) {
     // Vectorization width.
     const int group = 4;
 
@@ -342,19 +360,24 @@ Func fft2d_c2c(Func x, const std::vector<int> &R0, const std::vector<int> &R1, d
     Func xT = transpose(x);
 
     // Compute the DFT of dimension 1 (originally dimension 0).
-    Func dft1T = fft_dim1(xT, R0, sign, group);
+    Func dft1T = fft_dim1(xT, R0, sign, group, parallel);
 
     // Transpose back.
     Func dft1 = transpose(dft1T);
 
     // Compute the DFT of dimension 1.
-    Func dft = fft_dim1(dft1, R1, sign, group);
+    Func dft = fft_dim1(dft1, R1, sign, group, parallel);
     dft.bound(dft.args()[0], 0, product(R0));
     dft.bound(dft.args()[1], 0, product(R1));
 
     Var n0 = xT.args()[0];
     Var n1 = xT.args()[1];
-    xT.compute_at(dft, outermost(dft)).vectorize(n1).unroll(n0);
+    if (parallel) {
+        tile_transpose(xT, dft, group);
+        tile_transpose(dft1, dft, group);
+    } else {
+        xT.compute_at(dft, outermost(dft)).vectorize(n1).unroll(n0);
+    }
 
     dft1T.compute_at(dft, outermost(dft));
     dft.compute_root();
@@ -364,7 +387,7 @@ Func fft2d_c2c(Func x, const std::vector<int> &R0, const std::vector<int> &R1, d
 // Compute the N0 x N1 2D real DFT of x using radixes R0, R1.
 // The transform domain has dimensions N0 x N1/2 + 1 due to the
 // conjugate symmetry of real DFTs.
-Func fft2d_r2c(Func r, Func cat, const std::vector<int> &R0, const std::vector<int> &R1) {
+Func fft2d_r2c(Func r, Func cat, const std::vector<int> &R0, const std::vector<int> &R1, bool parallel = false) {
     // How many columns to group together in one FFT. This is the
     // vectorization width.
     const int group = 4;
@@ -388,7 +411,7 @@ Func fft2d_r2c(Func r, Func cat, const std::vector<int> &R0, const std::vector<i
                               r(clamp(n0 + zip_n, 0, N0 - 1), n1, _));
 
     // DFT down the columns first.
-    Func dft1 = fft_dim1(zipped, R1, -1.0f, group);
+    Func dft1 = fft_dim1(zipped, R1, -1.0f, group, parallel);
 
     // Unzip the DFTs of the columns.
     Func unzipped("unzipped");
@@ -408,7 +431,7 @@ Func fft2d_r2c(Func r, Func cat, const std::vector<int> &R0, const std::vector<i
     Func unzippedT = transpose(unzipped);
 
     // DFT down the columns again (the rows of the original).
-    Func dftT = fft_dim1(unzippedT, R0, -1.0f, group);
+    Func dftT = fft_dim1(unzippedT, R0, -1.0f, group, parallel);
     // Transpose back.
     Func dft = transpose(dftT);
     //dft.bound(dft.args()[0], 0, N0);
@@ -420,6 +443,9 @@ Func fft2d_r2c(Func r, Func cat, const std::vector<int> &R0, const std::vector<i
     dft1.compute_at(dftT, outermost(cat));
     dftT.compute_at(cat, outermost(cat));
     //dft.compute_at(cat, outermost(cat));
+    if (parallel) {
+        tile_transpose(dft, cat, group);
+    }
 
     return dft;
 }
@@ -427,7 +453,7 @@ Func fft2d_r2c(Func r, Func cat, const std::vector<int> &R0, const std::vector<i
 // Compute the N0 x N1 2D inverse DFT of x using radixes R0, R1.
 // The DFT domain should have dimensions N0 x N1/2 + 1 due to the
 // conjugate symmetry of real FFTs.
-Func fft2d_c2r(Func c, Func cat, const std::vector<int> &R0, const std::vector<int> &R1) {
+Func fft2d_c2r(Func c, Func cat, const std::vector<int> &R0, const std::vector<int> &R1, bool parallel = false) {
     // How many columns to group together in one FFT. This is the
     // vectorization width.
     const int group = 4;
@@ -440,7 +466,7 @@ Func fft2d_c2r(Func c, Func cat, const std::vector<int> &R0, const std::vector<i
     // Transpose the input.
     Func cT = transpose(c);
     // Take the inverse DFT of the columns (rows in the final result).
-    Func dft0T = fft_dim1(cT, R0, 1.0f, group);
+    Func dft0T = fft_dim1(cT, R0, 1.0f, group, parallel);
 
     // Transpose so we can take the DFT of the columns again.
     Func dft0 = transpose(dft0T);
@@ -472,7 +498,7 @@ Func fft2d_c2r(Func c, Func cat, const std::vector<int> &R0, const std::vector<i
     zipped(n0, n1, _) = add(X, mul(Tuple(0.0f, 1.0f), Y));
 
     // Take the inverse DFT of the columns again.
-    Func dft = fft_dim1(zipped, R1, 1.0f, group);
+    Func dft = fft_dim1(zipped, R1, 1.0f, group, parallel);
 
     // Extract the real inverse DFTs.
     Func unzipped("unzipped");
@@ -482,7 +508,12 @@ Func fft2d_c2r(Func c, Func cat, const std::vector<int> &R0, const std::vector<i
     //unzipped.bound(n0, 0, N0);
     //unzipped.bound(n1, 0, N1);
 
-    dft0.compute_at(dft, outermost(dft)).vectorize(dft0.args()[0], group).unroll(dft0.args()[0],MAX_UNROLL);
+    if (parallel) {
+        tile_transpose(cT, dft, group);
+        tile_transpose(dft0, dft, group);
+    } else {
+        dft0.compute_at(dft, outermost(dft)).vectorize(dft0.args()[0], group).unroll(dft0.args()[0],MAX_UNROLL);
+    }
     dft0T.compute_at(dft, outermost(dft));
     dft.compute_at(cat, outermost(cat));
 
@@ -510,16 +541,16 @@ std::vector<int> radix_factor(int N) {
 
 // Compute the N0 x N1 2D complex DFT of x. sign = -1 indicates a
 // forward DFT, sign = 1 indicates an inverse DFT.
-Func fft2d_c2c(Func c, int N0, int N1, double sign) {
-    return fft2d_c2c(c, radix_factor(N0), radix_factor(N1), sign);
+Func fft2d_c2c(Func c, int N0, int N1, double sign, bool parallel = false) {
+    return fft2d_c2c(c, radix_factor(N0), radix_factor(N1), sign, parallel);
 }
 
 // Compute N0 x N1 real DFTs.
-Func fft2d_r2c(Func r, Func cat, int N0, int N1) {
-    return fft2d_r2c(r, cat, radix_factor(N0), radix_factor(N1));
+Func fft2d_r2c(Func r, Func cat, int N0, int N1, bool parallel = false) {
+    return fft2d_r2c(r, cat, radix_factor(N0), radix_factor(N1), parallel);
 }
-Func fft2d_c2r(Func c, Func cat, int N0, int N1) {
-    return fft2d_c2r(c, cat, radix_factor(N0), radix_factor(N1));
+Func fft2d_c2r(Func c, Func cat, int N0, int N1, bool parallel = false) {
+    return fft2d_c2r(c, cat, radix_factor(N0), radix_factor(N1), parallel);
 }
 
 
@@ -543,32 +574,63 @@ double log2(double x) {
     return log(x)/log(2.0);
 }
 
-Module ifftKernel(Target target, int WIDTH, int HEIGHT) {
+// With "half" set, we get a grid that only has rows v >= HEIGHT/2
+// (v >= 0 in uv terms) plus a margin of rows below, as produced by
+// the half-plane gridder (see scatter.cpp). Margin rows hold
+// contributions that spilled over from the v >= 0 side, so we fold
+// them back conjugated. This is all the c2r FFT needs to see, as it
+// only ever looks at half of the (shifted) field.
+//
+// With "parallel" set, we generate "kern_ifft_par", which splits
+// both FFT passes as well as the transposes across threads.
+Module ifftKernel(Target target, int WIDTH, int HEIGHT, bool half = false, bool parallel = false) {
 
     // ** Input field
 
     ImageParam uvg(type_of<double>(), 3, "uvg");
     uvg.set_min(0,0).set_stride(0,1).set_extent(0,2)
-       .set_min(1,0).set_stride(1,2).set_extent(1,WIDTH)
-       .set_min(2,0).set_extent(2,HEIGHT);
+       .set_min(1,0).set_stride(1,2).set_extent(1,WIDTH);
+    if (!half) uvg.set_min(2,0).set_extent(2,HEIGHT);
 
     std::vector<Halide::Argument> args = { uvg };
 
     // ** Definition
 
-    // Hermitise the field and convert complex numbers into Tuples
-    Func herm("herm"); Var u("u"), v("v");
-    herm(u,v) = Tuple((uvg(0,u,v) + uvg(0,WIDTH-u-1,HEIGHT-v-1))/2,
-                      (uvg(1,u,v) - uvg(1,WIDTH-u-1,HEIGHT-v-1))/2);
+    Func shifted("shifted"); Var u("u"), v("v");
+    if (!half) {
 
-    // Shift the field
-    Func tiled = BoundaryConditions::repeat_image(herm, 0, WIDTH, 0,HEIGHT);
-    Func shifted("shifted");
-    shifted(u,v) = tiled(u+WIDTH/2,v+HEIGHT/2);
+        // Hermitise the field and convert complex numbers into Tuples
+        Func herm("herm");
+        herm(u,v) = Tuple((uvg(0,u,v) + uvg(0,WIDTH-u-1,HEIGHT-v-1))/2,
+                          (uvg(1,u,v) - uvg(1,WIDTH-u-1,HEIGHT-v-1))/2);
+
+        // Shift the field
+        Func tiled = BoundaryConditions::repeat_image(herm, 0, WIDTH, 0,HEIGHT);
+        shifted(u,v) = tiled(u+WIDTH/2,v+HEIGHT/2);
+
+    } else {
+
+        // Row v of the shifted field is grid row HEIGHT/2+v, its
+        // Hermitian counterpart row HEIGHT/2-v, which only exists
+        // in the margin. The row for v = HEIGHT/2 is out of the
+        // grid on both sides, so it ends up zero.
+        Expr vmin = uvg.min(2), vmax = uvg.min(2) + uvg.extent(2) - 1;
+        Expr vp = HEIGHT/2 + v, vm = HEIGHT/2 - v;
+        Expr um = (WIDTH - u) % WIDTH;
+        Expr zero = cast<double>(0.0f);
+        Func herm("herm");
+        herm(u,v) = Tuple((select(vp <= vmax, uvg(0,u,clamp(vp,vmin,vmax)), zero) +
+                           select(vm >= vmin, uvg(0,um,clamp(vm,vmin,vmax)), zero))/2,
+                          (select(vp <= vmax, uvg(1,u,clamp(vp,vmin,vmax)), zero) -
+                           select(vm >= vmin, uvg(1,um,clamp(vm,vmin,vmax)), zero))/2);
+
+        // Shift the field (in u only)
+        shifted(u,v) = herm((u+WIDTH/2)%WIDTH,v);
+    }
 
     // Compute inverse dft
     Func img_shifted("img_shifted");
-    Func image = fft2d_c2r(shifted, img_shifted, WIDTH, HEIGHT);
+    Func image = fft2d_c2r(shifted, img_shifted, WIDTH, HEIGHT, parallel);
     image.output_buffer()
          .set_min(0,0).set_stride(0,1).set_extent(0,WIDTH)
          .set_min(1,0).set_extent(0,WIDTH);
@@ -589,6 +651,7 @@ Module ifftKernel(Target target, int WIDTH, int HEIGHT) {
         .split(u, uo, ui, WIDTH/2)
         .unroll(uo)
         .vectorize(ui,4);
+    if (parallel) img_shifted.parallel(vi);
 
     // The above split is *almost* enough to make Halide generate
     // specialised code for all four quarters of the image. However,
@@ -600,10 +663,64 @@ Module ifftKernel(Target target, int WIDTH, int HEIGHT) {
     // surplus "select". Let's hope LLVM is smart enough to eliminate
     // it...
 
-    return img_shifted.compile_to_module(args, mkKernelName("kern_ifft", WIDTH, HEIGHT), target);
+    std::string name = half ? "kern_ifft_half" : "kern_ifft";
+    if (parallel) name += "_par";
+    return img_shifted.compile_to_module(args, mkKernelName(name, WIDTH, HEIGHT), target);
+}
+
+// Complex-to-complex inverse FFT. In contrast to "ifftKernel" we do
+// not assume the grid to be Hermitian, and return the complex
+// image. This is what w-stacking needs, as an individual w-plane is
+// not Hermitian.
+Module ifftC2CKernel(Target target, int WIDTH, int HEIGHT) {
+
+    // ** Input field
+
+    ImageParam uvg(type_of<double>(), 3, "uvg");
+    uvg.set_min(0,0).set_stride(0,1).set_extent(0,2)
+       .set_min(1,0).set_stride(1,2).set_extent(1,WIDTH)
+       .set_min(2,0).set_extent(2,HEIGHT);
+
+    std::vector<Halide::Argument> args = { uvg };
+
+    // ** Definition
+
+    // Convert complex numbers into Tuples and shift the field
+    Func cmplx("cmplx"); Var u("u"), v("v"), c("c");
+    cmplx(u,v) = Tuple(uvg(0,u,v), uvg(1,u,v));
+    Func tiled = BoundaryConditions::repeat_image(cmplx, 0, WIDTH, 0,HEIGHT);
+    Func shifted("shifted");
+    shifted(u,v) = tiled(u+WIDTH/2,v+HEIGHT/2);
+
+    // Compute inverse dft
+    Func image = fft2d_c2c(shifted, WIDTH, HEIGHT, 1.0);
+
+    // Shift back, convert to array. Normalisation is the same as
+    // for "ifftKernel".
+    Func img_tiled = BoundaryConditions::repeat_image(image, 0, WIDTH, 0,HEIGHT);
+    Func img_cshifted("img_cshifted");
+    img_cshifted(c,u,v) = select(c == 0, img_tiled(u+WIDTH/2,v+HEIGHT/2)[0],
+                                         img_tiled(u+WIDTH/2,v+HEIGHT/2)[1]) / cast<double>(WIDTH);
+
+    // ** Strategy
+
+    Var ui, uo, vi, vo;
+    img_cshifted.output_buffer()
+        .set_min(0,0).set_stride(0,1).set_extent(0,2)
+        .set_min(1,0).set_stride(1,2).set_extent(1,WIDTH)
+        .set_min(2,0).set_extent(2,HEIGHT);
+    img_cshifted
+        .split(v, vo, vi, HEIGHT/2)
+        .unroll(vo)
+        .split(u, uo, ui, WIDTH/2)
+        .unroll(uo)
+        .unroll(c);
+
+    return img_cshifted.compile_to_module(args, mkKernelName("kern_ifft_c2c", WIDTH, HEIGHT), target);
 }
 
-Module fftKernel(Target target, int WIDTH, int HEIGHT) {
+// See "ifftKernel" for "parallel"
+Module fftKernel(Target target, int WIDTH, int HEIGHT, bool parallel = false) {
 
     ImageParam img(type_of<double>(), 2, "image");
     img.set_min(0,0).set_stride(0,1).set_extent(0,WIDTH)
@@ -618,7 +735,7 @@ Module fftKernel(Target target, int WIDTH, int HEIGHT) {
 
     // Compute dft
     Func uvg_herm("uvg_herm");
-    Func uvg = fft2d_r2c(img_shifted, uvg_herm, WIDTH, HEIGHT);
+    Func uvg = fft2d_r2c(img_shifted, uvg_herm, WIDTH, HEIGHT, parallel);
 
     // Convert tuples to arrays
     Var c("c");
@@ -645,13 +762,14 @@ Module fftKernel(Target target, int WIDTH, int HEIGHT) {
        .split(u, uo, ui, WIDTH/2)
        .unroll(uo)
        .unroll(c);
+    if (parallel) uvg_herm.parallel(vi);
 
     // As with ifftKernel, this leaves quite a few "select" in the
     // code. Not quite sure whether or not they give rise to actual
     // branches...
 
     // uvg_herm.compile_to_lowered_stmt("kern_fft.html", args, HTML, target);
-    return uvg_herm.compile_to_module(args, mkKernelName("kern_fft", WIDTH, HEIGHT), target);
+    return uvg_herm.compile_to_module(args, mkKernelName(parallel ? "kern_fft_par" : "kern_fft", WIDTH, HEIGHT), target);
 }
 
 int main(int argc, char **argv)
@@ -661,16 +779,46 @@ int main(int argc, char **argv)
     std::vector<Module> modules =
       { ifftKernel(target, 1024, 1024)
       ,  fftKernel(target, 1024, 1024)
+      , ifftC2CKernel(target, 1024, 1024)
+      , ifftKernel(target, 1024, 1024, true)
+      , ifftKernel(target, 1024, 1024, false, true)
+      ,  fftKernel(target, 1024, 1024, true)
+      , ifftKernel(target, 1024, 1024, true, true)
       , ifftKernel(target, 2048, 2048)
       ,  fftKernel(target, 2048, 2048)
+      , ifftC2CKernel(target, 2048, 2048)
+      , ifftKernel(target, 2048, 2048, true)
+      , ifftKernel(target, 2048, 2048, false, true)
+      ,  fftKernel(target, 2048, 2048, true)
+      , ifftKernel(target, 2048, 2048, true, true)
       , ifftKernel(target, 3072, 3072)
       ,  fftKernel(target, 3072, 3072)
+      , ifftC2CKernel(target, 3072, 3072)
+      , ifftKernel(target, 3072, 3072, true)
+      , ifftKernel(target, 3072, 3072, false, true)
+      ,  fftKernel(target, 3072, 3072, true)
+      , ifftKernel(target, 3072, 3072, true, true)
       , ifftKernel(target, 4096, 4096)
       ,  fftKernel(target, 4096, 4096)
+      , ifftC2CKernel(target, 4096, 4096)
+      , ifftKernel(target, 4096, 4096, true)
+      , ifftKernel(target, 4096, 4096, false, true)
+      ,  fftKernel(target, 4096, 4096, true)
+      , ifftKernel(target, 4096, 4096, true, true)
       , ifftKernel(target, 6144, 6144)
       ,  fftKernel(target, 6144, 6144)
+      , ifftC2CKernel(target, 6144, 6144)
+      , ifftKernel(target, 6144, 6144, true)
+      , ifftKernel(target, 6144, 6144, false, true)
+      ,  fftKernel(target, 6144, 6144, true)
+      , ifftKernel(target, 6144, 6144, true, true)
       , ifftKernel(target, 8192, 8192)
       ,  fftKernel(target, 8192, 8192)
+      , ifftC2CKernel(target, 8192, 8192)
+      , ifftKernel(target, 8192, 8192, true)
+      , ifftKernel(target, 8192, 8192, false, true)
+      ,  fftKernel(target, 8192, 8192, true)
+      , ifftKernel(target, 8192, 8192, true, true)
       };
     Module linked = link_modules("kern_ffts", modules);
     // compile_module_to_c_header(linked, std::string(argv[1]) + ".h");
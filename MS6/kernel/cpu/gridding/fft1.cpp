@@ -10,6 +10,30 @@ inline int32_t checkSize(const buffer_t & b_real, const buffer_t & b_cmplx) {
   return -1;
 }
 
+inline int32_t checkSizeC2C(const buffer_t & b_uvg, const buffer_t & b_img) {
+  int32_t size = b_img.extent[1];
+  if (  b_img.extent[0] == 2
+     && b_img.extent[2] == size
+     && b_uvg.extent[0] == 2
+     && b_uvg.extent[1] == size
+     && b_uvg.extent[2] == size
+     ) return size;
+  return -1;
+}
+
+// Half-plane grid: Rows from somewhere below size/2 up to the end
+// (see "kern_ifft_half" in fft.cpp)
+inline int32_t checkSizeHalf(const buffer_t & b_real, const buffer_t & b_cmplx) {
+  int32_t size = b_real.extent[0];
+  if (  b_real.extent[1] == size
+     && b_cmplx.extent[0] == 2
+     && b_cmplx.extent[1] == size
+     && b_cmplx.min[2] <= size / 2
+     && b_cmplx.min[2] + b_cmplx.extent[2] == size
+     ) return size;
+  return -1;
+}
+
 extern "C" {
 int kern_ifft_1024x1024(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
 int kern_ifft_2048x2048(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
@@ -25,6 +49,52 @@ int kern_fft_4096x4096(buffer_t *_image_buffer, buffer_t *_uvg_herm_buffer);
 int kern_fft_6144x6144(buffer_t *_image_buffer, buffer_t *_uvg_herm_buffer);
 int kern_fft_8192x8192(buffer_t *_image_buffer, buffer_t *_uvg_herm_buffer);
 
+int kern_ifft_half_1024x1024(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+int kern_ifft_half_2048x2048(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+int kern_ifft_half_3072x3072(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+int kern_ifft_half_4096x4096(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+int kern_ifft_half_6144x6144(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+int kern_ifft_half_8192x8192(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+
+int kern_ifft_c2c_1024x1024(buffer_t *_uvg_buffer, buffer_t *_img_cshifted_buffer);
+int kern_ifft_c2c_2048x2048(buffer_t *_uvg_buffer, buffer_t *_img_cshifted_buffer);
+int kern_ifft_c2c_3072x3072(buffer_t *_uvg_buffer, buffer_t *_img_cshifted_buffer);
+int kern_ifft_c2c_4096x4096(buffer_t *_uvg_buffer, buffer_t *_img_cshifted_buffer);
+int kern_ifft_c2c_6144x6144(buffer_t *_uvg_buffer, buffer_t *_img_cshifted_buffer);
+int kern_ifft_c2c_8192x8192(buffer_t *_uvg_buffer, buffer_t *_img_cshifted_buffer);
+
+int kern_ifft_par_1024x1024(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+int kern_ifft_par_2048x2048(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+int kern_ifft_par_3072x3072(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+int kern_ifft_par_4096x4096(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+int kern_ifft_par_6144x6144(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+int kern_ifft_par_8192x8192(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+
+int kern_fft_par_1024x1024(buffer_t *_image_buffer, buffer_t *_uvg_herm_buffer);
+int kern_fft_par_2048x2048(buffer_t *_image_buffer, buffer_t *_uvg_herm_buffer);
+int kern_fft_par_3072x3072(buffer_t *_image_buffer, buffer_t *_uvg_herm_buffer);
+int kern_fft_par_4096x4096(buffer_t *_image_buffer, buffer_t *_uvg_herm_buffer);
+int kern_fft_par_6144x6144(buffer_t *_image_buffer, buffer_t *_uvg_herm_buffer);
+int kern_fft_par_8192x8192(buffer_t *_image_buffer, buffer_t *_uvg_herm_buffer);
+
+int kern_ifft_half_par_1024x1024(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+int kern_ifft_half_par_2048x2048(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+int kern_ifft_half_par_3072x3072(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+int kern_ifft_half_par_4096x4096(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+int kern_ifft_half_par_6144x6144(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+int kern_ifft_half_par_8192x8192(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+
+// Runtime-sized fallbacks for all other sizes, as well as for
+// inverse FFTs producing only a window of the image (see fft_dyn.cpp).
+// The multi-threaded kernels have threaded fallbacks of their own.
+int kern_ifft_dyn(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+int kern_fft_dyn(buffer_t *_image_buffer, buffer_t *_uvg_herm_buffer);
+int kern_ifft_par_dyn(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+int kern_fft_par_dyn(buffer_t *_image_buffer, buffer_t *_uvg_herm_buffer);
+int kern_ifft_half_dyn(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+int kern_ifft_half_par_dyn(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer);
+int kern_ifft_c2c_dyn(buffer_t *_uvg_buffer, buffer_t *_img_cshifted_buffer);
+
 
 int kern_ifft(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer){
   int32_t size = checkSize(*_img_shifted_buffer, *_uvg_buffer);
@@ -37,7 +107,7 @@ int kern_ifft(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer){
     __I_CASE(4096)
     __I_CASE(8192)
   }
-  return -666;
+  return kern_ifft_dyn(_uvg_buffer, _img_shifted_buffer);
 }
 
 int kern_fft(buffer_t *_image_buffer, buffer_t *_uvg_herm_buffer){
@@ -51,7 +121,78 @@ int kern_fft(buffer_t *_image_buffer, buffer_t *_uvg_herm_buffer){
     __R_CASE(4096)
     __R_CASE(8192)
   }
-  return -666;
+  return kern_fft_dyn(_image_buffer, _uvg_herm_buffer);
+}
+
+int kern_ifft_c2c(buffer_t *_uvg_buffer, buffer_t *_img_cshifted_buffer){
+  int32_t size = checkSizeC2C(*_uvg_buffer, *_img_cshifted_buffer);
+  #define __C_CASE(siz) case siz: return kern_ifft_c2c_ ## siz ## x ## siz (_uvg_buffer, _img_cshifted_buffer);
+  switch( size ) {
+    __C_CASE(2048)
+    __C_CASE(3072)
+    __C_CASE(6144)
+    __C_CASE(1024)
+    __C_CASE(4096)
+    __C_CASE(8192)
+  }
+  return kern_ifft_c2c_dyn(_uvg_buffer, _img_cshifted_buffer);
+}
+
+int kern_ifft_half(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer){
+  int32_t size = checkSizeHalf(*_img_shifted_buffer, *_uvg_buffer);
+  #define __H_CASE(siz) case siz: return kern_ifft_half_ ## siz ## x ## siz (_uvg_buffer, _img_shifted_buffer);
+  switch( size ) {
+    __H_CASE(2048)
+    __H_CASE(3072)
+    __H_CASE(6144)
+    __H_CASE(1024)
+    __H_CASE(4096)
+    __H_CASE(8192)
+  }
+  return kern_ifft_half_dyn(_uvg_buffer, _img_shifted_buffer);
+}
+
+// Multi-threaded FFTs (see "parallel" in fft.cpp)
+int kern_ifft_par(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer){
+  int32_t size = checkSize(*_img_shifted_buffer, *_uvg_buffer);
+  #define __IP_CASE(siz) case siz: return kern_ifft_par_ ## siz ## x ## siz (_uvg_buffer, _img_shifted_buffer);
+  switch( size ) {
+    __IP_CASE(2048)
+    __IP_CASE(3072)
+    __IP_CASE(6144)
+    __IP_CASE(1024)
+    __IP_CASE(4096)
+    __IP_CASE(8192)
+  }
+  return kern_ifft_par_dyn(_uvg_buffer, _img_shifted_buffer);
+}
+
+int kern_fft_par(buffer_t *_image_buffer, buffer_t *_uvg_herm_buffer){
+  int32_t size = checkSize(*_image_buffer, *_uvg_herm_buffer);
+  #define __RP_CASE(siz) case siz: return kern_fft_par_ ## siz ## x ## siz (_image_buffer, _uvg_herm_buffer);
+  switch( size ) {
+    __RP_CASE(2048)
+    __RP_CASE(3072)
+    __RP_CASE(6144)
+    __RP_CASE(1024)
+    __RP_CASE(4096)
+    __RP_CASE(8192)
+  }
+  return kern_fft_par_dyn(_image_buffer, _uvg_herm_buffer);
+}
+
+int kern_ifft_half_par(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer){
+  int32_t size = checkSizeHalf(*_img_shifted_buffer, *_uvg_buffer);
+  #define __HP_CASE(siz) case siz: return kern_ifft_half_par_ ## siz ## x ## siz (_uvg_buffer, _img_shifted_buffer);
+  switch( size ) {
+    __HP_CASE(2048)
+    __HP_CASE(3072)
+    __HP_CASE(6144)
+    __HP_CASE(1024)
+    __HP_CASE(4096)
+    __HP_CASE(8192)
+  }
+  return kern_ifft_half_par_dyn(_uvg_buffer, _img_shifted_buffer);
 }
 
 }
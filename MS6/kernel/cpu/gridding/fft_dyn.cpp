@@ -0,0 +1,492 @@
+// FFTW-based FFT kernels, with the same transformations (shifts,
+// Hermitisation, normalisation) and buffer layouts as the Halide
+// kernels in fft.cpp. They serve two purposes:
+//
+//  * "kern_*_dyn": The Halide kernels have the grid size baked in at
+//    compile time, so we only generate them for a handful of square
+//    sizes. Everything else - other sizes, non-square grids, inverse
+//    FFTs for a window of the image - gets dispatched here by
+//    fft1.cpp. These use quick FFTW_ESTIMATE plans and a single
+//    thread, just like the kernels they stand in for.
+//
+//  * "kern_*_par_dyn": The same for the multi-threaded Halide kernels
+//    ("fft_type: cpu_par"). Still FFTW_ESTIMATE plans, so we never
+//    measure nor touch wisdom, but threaded like the kernels they
+//    stand in for (HL_NUM_THREADS, see cpu_threads.h).
+//
+//  * "kern_fft_fftw", "kern_ifft_fftw": Alternative to the Halide
+//    kernels for all sizes ("fft_type: fftw"). These use threaded
+//    plans (HL_NUM_THREADS, see cpu_threads.h) and the planner
+//    given in MS6_FFTW_PLANNER ("estimate", "measure" - the default -
+//    or "patient"). As measuring is expensive, we keep FFTW wisdom in
+//    a per-host file (MS6_FFTW_WISDOM, default
+//    "~/.ms6_fftw_wisdom.<host>", empty to disable), so planning is
+//    paid once per machine rather than once per run.
+//
+// Note that just like the Halide kernels we halve the v dimension for
+// real-to-complex transforms, so we look at the same half of the
+// field. FFTW halves the last dimension it is given, which is why u
+// comes first in all plans below.
+//
+// Buffers are accessed through their strides, so rows can be padded
+// (see "gridPitch" in Kernel/Config.hs).
+
+#include <algorithm>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <unistd.h>
+
+#include <fftw3.h>
+
+#include "halide_buf.h"
+#include "cpu_threads.h"
+
+typedef std::complex<double> complexd;
+
+// Two-dimensional transforms, plus the two passes of a pruned
+// inverse real FFT (see "ifftPruned")
+enum FFTKind { FFT_R2C, FFT_C2R, FFT_C2C_INV, FFT_C2C_INV_ROWS, FFT_C2R_COLS };
+
+// Runtime-sized fallbacks (single-threaded or threaded) vs. tuned
+// FFTW kernels, see above
+enum PlanMode { PLAN_QUICK, PLAN_QUICK_PAR, PLAN_TUNED };
+
+// Run "f(lo, hi)" for disjoint ranges covering [0, n) in parallel
+template <typename F>
+static void parallelRanges(int nthreads, int32_t n, F f) {
+  if (nthreads == 1) { f(0, n); return; }
+  std::vector<std::thread> threads;
+  for (int t = 0; t < nthreads; t++)
+    threads.push_back(std::thread(f, int32_t(int64_t(n) * t / nthreads),
+                                  int32_t(int64_t(n) * (t + 1) / nthreads)));
+  for (std::thread & t : threads) t.join();
+}
+
+// ** Planning
+
+// Plans get created under "fftwPlannerMutex". Scratch arrays all
+// come from fftw_malloc and have rows of exactly "width" elements, so
+// one plan per kind and size can be executed on any of them.
+static std::map<std::tuple<int, int, int32_t, int32_t>, fftw_plan> plans;
+
+// Only touched with fftwPlannerMutex held
+static bool threadsInit = false;
+static bool tunedInit = false;
+static unsigned tunedFlags = FFTW_MEASURE;
+static std::string wisdomFile;
+
+static void initThreads() {
+  if (threadsInit) return;
+  threadsInit = true;
+  fftw_init_threads();
+}
+
+static void initTuned() {
+  if (tunedInit) return;
+  tunedInit = true;
+
+  const char * planner = getenv("MS6_FFTW_PLANNER");
+  if (planner && strcmp(planner, "estimate") == 0) tunedFlags = FFTW_ESTIMATE;
+  if (planner && strcmp(planner, "patient") == 0) tunedFlags = FFTW_PATIENT;
+
+  const char * wisdom = getenv("MS6_FFTW_WISDOM");
+  if (wisdom) {
+    wisdomFile = wisdom;
+  } else {
+    const char * home = getenv("HOME");
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    wisdomFile = std::string(home ? home : ".") + "/.ms6_fftw_wisdom." + host;
+  }
+  // Initialising threads registers more planning strategies, and
+  // FFTW rejects wisdom that does not match the registered ones. So
+  // this has to happen before importing wisdom we exported after
+  // threaded planning.
+  initThreads();
+  if (!wisdomFile.empty())
+    fftw_import_wisdom_from_filename(wisdomFile.c_str());
+}
+
+// Write wisdom to a temporary file first, so concurrent runs on the
+// same host never see a partially written file.
+static void saveWisdom() {
+  if (wisdomFile.empty() || tunedFlags == FFTW_ESTIMATE) return;
+  std::string tmp = wisdomFile + "." + std::to_string(getpid());
+  if (fftw_export_wisdom_to_filename(tmp.c_str()))
+    rename(tmp.c_str(), wisdomFile.c_str());
+  else
+    remove(tmp.c_str());
+}
+
+static fftw_plan getPlan(FFTKind kind, PlanMode mode, int32_t width, int32_t height) {
+  std::lock_guard<std::mutex> lock(fftwPlannerMutex());
+  fftw_plan & p = plans[std::make_tuple(int(kind), int(mode), width, height)];
+  if (p != NULL) return p;
+
+  unsigned flags = FFTW_ESTIMATE;
+  if (mode == PLAN_TUNED) {
+    initTuned();
+    flags = tunedFlags;
+  }
+  if (mode != PLAN_QUICK) {
+    initThreads();
+    fftw_plan_with_nthreads(numThreads());
+  }
+
+  // Measuring overwrites the arrays, so plan on arrays of our own
+  const int64_t n = int64_t(width) * height;
+  complexd * in = reinterpret_cast<complexd *>(fftw_malloc(sizeof(complexd) * n));
+  complexd * out = reinterpret_cast<complexd *>(fftw_malloc(sizeof(complexd) * n));
+  fftw_iodim dims[2] = {
+      { width, 1, 1 }
+    , { height, width, width }
+    };
+  // One-dimensional transforms along rows (of which the first
+  // height/2+1 are used) or columns, respectively
+  fftw_iodim rows = { height / 2 + 1, width, width };
+  fftw_iodim cols = { width, 1, 1 };
+  if (in != NULL && out != NULL) {
+    switch (kind) {
+    case FFT_R2C:
+      p = fftw_plan_guru_dft_r2c(2, dims, 0, NULL,
+                                 reinterpret_cast<double *>(in),
+                                 reinterpret_cast<fftw_complex *>(out), flags);
+      break;
+    case FFT_C2R:
+      p = fftw_plan_guru_dft_c2r(2, dims, 0, NULL,
+                                 reinterpret_cast<fftw_complex *>(in),
+                                 reinterpret_cast<double *>(out), flags);
+      break;
+    case FFT_C2C_INV:
+      p = fftw_plan_guru_dft(2, dims, 0, NULL,
+                             reinterpret_cast<fftw_complex *>(in),
+                             reinterpret_cast<fftw_complex *>(in),
+                             FFTW_BACKWARD, flags);
+      break;
+    case FFT_C2C_INV_ROWS:
+      p = fftw_plan_guru_dft(1, &dims[0], 1, &rows,
+                             reinterpret_cast<fftw_complex *>(in),
+                             reinterpret_cast<fftw_complex *>(in),
+                             FFTW_BACKWARD, flags);
+      break;
+    case FFT_C2R_COLS:
+      p = fftw_plan_guru_dft_c2r(1, &dims[1], 1, &cols,
+                                 reinterpret_cast<fftw_complex *>(in),
+                                 reinterpret_cast<double *>(out), flags);
+      break;
+    }
+  }
+  fftw_free(out);
+  fftw_free(in);
+  if (mode != PLAN_QUICK) fftw_plan_with_nthreads(1);
+  if (mode == PLAN_TUNED && p != NULL) saveWisdom();
+  return p;
+}
+
+// ** Kernels
+
+template <typename T>
+static T * alloc(int64_t n) {
+  return reinterpret_cast<T *>(fftw_malloc(sizeof(T) * n));
+}
+
+// Buffer elements by coordinate, respecting buffer minimums
+static inline double & at(const buffer_t & b, int32_t x, int32_t y) {
+  return reinterpret_cast<double *>(b.host)[
+      int64_t(x - b.min[0]) * b.stride[0]
+    + int64_t(y - b.min[1]) * b.stride[1]];
+}
+static inline double & at(const buffer_t & b, int32_t c, int32_t x, int32_t y) {
+  return reinterpret_cast<double *>(b.host)[
+      int64_t(c - b.min[0]) * b.stride[0]
+    + int64_t(x - b.min[1]) * b.stride[1]
+    + int64_t(y - b.min[2]) * b.stride[2]];
+}
+
+// Whether the first "dims" dimensions of the buffer start at zero.
+// Like the Halide kernels, we index grids and images from zero, so
+// anything else is an error unless a kernel says otherwise.
+static bool zeroMin(const buffer_t & b, int dims) {
+  for (int i = 0; i < dims; i++)
+    if (b.min[i] != 0) return false;
+  return true;
+}
+
+// Modulo with non-negative result, same as BoundaryConditions::repeat_image
+static inline int32_t emod(int32_t x, int32_t n) {
+  return ((x % n) + n) % n;
+}
+
+static int threadsFor(PlanMode mode) {
+  return mode != PLAN_QUICK ? numThreads() : 1;
+}
+
+// Inverse real FFT of "shifted", which holds the rows v = 0 .. height/2.
+// Shifts the result back, and normalises.
+static int ifftHalf(PlanMode mode, complexd * shifted, const buffer_t & img, int32_t width, int32_t height) {
+  fftw_plan plan = getPlan(FFT_C2R, mode, width, height);
+  double * image = alloc<double>(int64_t(width) * height);
+  if (plan == NULL || image == NULL) { fftw_free(image); fftw_free(shifted); return -666; }
+  fftw_execute_dft_c2r(plan, reinterpret_cast<fftw_complex *>(shifted), image);
+  parallelRanges(threadsFor(mode), height, [&](int32_t v0, int32_t v1) {
+    for (int32_t v = v0; v < v1; v++) {
+      const double * row = image + int64_t((v + height / 2) % height) * width;
+      for (int32_t u = 0; u < width; u++)
+        at(img, u, v) = row[(u + width / 2) % width] / width;
+    }
+  });
+  fftw_free(image);
+  fftw_free(shifted);
+  return 0;
+}
+
+// Hermitise and shift the field. The c2r transform only ever looks
+// at the first half of the rows, so that is all we generate.
+static complexd * hermitise(PlanMode mode, const buffer_t & uvg, int32_t width, int32_t height) {
+  complexd * shifted = alloc<complexd>(int64_t(width) * (height / 2 + 1));
+  if (shifted == NULL) return NULL;
+  parallelRanges(threadsFor(mode), height / 2 + 1, [&](int32_t v0, int32_t v1) {
+    for (int32_t v = v0; v < v1; v++) {
+      const int32_t sv = (v + height / 2) % height;
+      for (int32_t u = 0; u < width; u++) {
+        const int32_t su = (u + width / 2) % width;
+        shifted[int64_t(v) * width + u] = complexd(
+            (at(uvg, 0, su, sv) + at(uvg, 0, width-su-1, height-sv-1)) / 2,
+            (at(uvg, 1, su, sv) - at(uvg, 1, width-su-1, height-sv-1)) / 2);
+      }
+    }
+  });
+  return shifted;
+}
+
+// Pruned inverse real FFT, for when the output buffer only covers a
+// window of the image (say, a facet that is a fraction of the
+// field). The row pass has to transform all rows in full, but after
+// that we only need the columns that fall into the window. So the
+// column pass - half of the work for a full image - scales with the
+// window width instead.
+//
+// Only columns get pruned: Hermitisation and the row pass still run
+// over the whole grid, and every column gets transformed in full, as
+// each output row depends on all of its inputs. So the window height
+// only saves copying, and cost never drops below about half of a
+// full transform.
+static int ifftPruned(PlanMode mode, const buffer_t & uvg, const buffer_t & img, int32_t width, int32_t height) {
+  const int32_t
+      u0 = img.min[0], cols = img.extent[0]
+    , v0 = img.min[1], rows = img.extent[1]
+    , hrows = height / 2 + 1
+    ;
+  fftw_plan rowPlan = getPlan(FFT_C2C_INV_ROWS, mode, width, height)
+          , colPlan = getPlan(FFT_C2R_COLS, mode, cols, height);
+  complexd * shifted = hermitise(mode, uvg, width, height);
+  complexd * window = alloc<complexd>(int64_t(cols) * hrows);
+  double * image = alloc<double>(int64_t(cols) * height);
+  if (rowPlan == NULL || colPlan == NULL || shifted == NULL || window == NULL || image == NULL) {
+    fftw_free(image); fftw_free(window); fftw_free(shifted);
+    return -666;
+  }
+
+  // Row pass, then pick the columns that end up in the window once
+  // we shift back
+  fftw_execute_dft(rowPlan, reinterpret_cast<fftw_complex *>(shifted),
+                            reinterpret_cast<fftw_complex *>(shifted));
+  const int nthreads = threadsFor(mode);
+  parallelRanges(nthreads, hrows, [&](int32_t r0, int32_t r1) {
+    for (int32_t v = r0; v < r1; v++)
+      for (int32_t j = 0; j < cols; j++)
+        window[int64_t(v) * cols + j] = shifted[int64_t(v) * width + (u0 + j + width / 2) % width];
+  });
+  fftw_free(shifted);
+
+  // Column pass, shift back and normalise
+  fftw_execute_dft_c2r(colPlan, reinterpret_cast<fftw_complex *>(window), image);
+  parallelRanges(nthreads, rows, [&](int32_t r0, int32_t r1) {
+    for (int32_t v = v0 + r0; v < v0 + r1; v++) {
+      const double * row = image + int64_t((v + height / 2) % height) * cols;
+      for (int32_t j = 0; j < cols; j++)
+        at(img, u0 + j, v) = row[j] / width;
+    }
+  });
+  fftw_free(image);
+  fftw_free(window);
+  return 0;
+}
+
+// See "ifftKernel" in fft.cpp. If the output buffer is smaller than
+// the grid, its minimum and extent select the window of the image to
+// produce, see "ifftPruned".
+static int ifft(PlanMode mode, const buffer_t & uvg, const buffer_t & img) {
+  const int32_t width = uvg.extent[1], height = uvg.extent[2];
+  if (uvg.extent[0] != 2 || !zeroMin(uvg, 3) ||
+      img.min[0] < 0 || img.min[0] + img.extent[0] > width ||
+      img.min[1] < 0 || img.min[1] + img.extent[1] > height)
+    return -666;
+  if (img.extent[0] != width || img.extent[1] != height)
+    return ifftPruned(mode, uvg, img, width, height);
+
+  complexd * shifted = hermitise(mode, uvg, width, height);
+  if (shifted == NULL) return -666;
+  return ifftHalf(mode, shifted, img, width, height);
+}
+
+// See "fftKernel" in fft.cpp
+static int fft(PlanMode mode, const buffer_t & img, const buffer_t & uvg) {
+  const int32_t width = img.extent[0], height = img.extent[1];
+  if (uvg.extent[0] != 2 || uvg.extent[1] != width || uvg.extent[2] != height ||
+      !zeroMin(img, 2) || !zeroMin(uvg, 3))
+    return -666;
+
+  // Shift the image
+  fftw_plan plan = getPlan(FFT_R2C, mode, width, height);
+  double * shifted = alloc<double>(int64_t(width) * height);
+  complexd * dft = alloc<complexd>(int64_t(width) * (height / 2 + 1));
+  if (plan == NULL || shifted == NULL || dft == NULL) { fftw_free(shifted); fftw_free(dft); return -666; }
+  const int nthreads = threadsFor(mode);
+  parallelRanges(nthreads, height, [&](int32_t v0, int32_t v1) {
+    for (int32_t v = v0; v < v1; v++) {
+      const int32_t sv = emod(v - height / 2, height);
+      for (int32_t u = 0; u < width; u++)
+        shifted[int64_t(v) * width + u] = at(img, emod(u - width / 2, width), sv);
+    }
+  });
+  fftw_execute_dft_r2c(plan, shifted, reinterpret_cast<fftw_complex *>(dft));
+
+  // Generate the Hermitian shifted grid. We only have the rows up to
+  // height/2, the others count as zero.
+  auto tiled = [&](int32_t u, int32_t v) {
+    u = emod(u, width); v = emod(v, height);
+    return v <= height / 2 ? dft[int64_t(v) * width + u] : complexd(0, 0);
+  };
+  parallelRanges(nthreads, height, [&](int32_t v0, int32_t v1) {
+    for (int32_t v = v0; v < v1; v++) {
+      for (int32_t u = 0; u < width; u++) {
+        const complexd a = tiled(u - width / 2, v - height / 2),
+                       b = tiled(width / 2 - u - 1, height / 2 - v - 1);
+        at(uvg, 0, u, v) = (a.real() + b.real()) / width;
+        at(uvg, 1, u, v) = (a.imag() - b.imag()) / width;
+      }
+    }
+  });
+  fftw_free(dft);
+  fftw_free(shifted);
+  return 0;
+}
+
+extern "C" {
+
+int kern_ifft_dyn(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer) {
+  return ifft(PLAN_QUICK, *_uvg_buffer, *_img_shifted_buffer);
+}
+
+int kern_ifft_fftw(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer) {
+  return ifft(PLAN_TUNED, *_uvg_buffer, *_img_shifted_buffer);
+}
+
+int kern_fft_dyn(buffer_t *_image_buffer, buffer_t *_uvg_herm_buffer) {
+  return fft(PLAN_QUICK, *_image_buffer, *_uvg_herm_buffer);
+}
+
+int kern_fft_fftw(buffer_t *_image_buffer, buffer_t *_uvg_herm_buffer) {
+  return fft(PLAN_TUNED, *_image_buffer, *_uvg_herm_buffer);
+}
+
+int kern_ifft_par_dyn(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer) {
+  return ifft(PLAN_QUICK_PAR, *_uvg_buffer, *_img_shifted_buffer);
+}
+
+int kern_fft_par_dyn(buffer_t *_image_buffer, buffer_t *_uvg_herm_buffer) {
+  return fft(PLAN_QUICK_PAR, *_image_buffer, *_uvg_herm_buffer);
+}
+
+}
+
+// See "ifftKernel" in fft.cpp with "half" set. The grid only needs
+// to start at v = 0 or later (see "gridInitHalf" in Kernel/Gridder.hs).
+static int ifftHalfPlane(PlanMode mode, const buffer_t * _uvg_buffer, const buffer_t * _img_shifted_buffer) {
+  const buffer_t & uvg = *_uvg_buffer;
+  const int32_t
+      width = _img_shifted_buffer->extent[0]
+    , height = _img_shifted_buffer->extent[1]
+    , vmin = uvg.min[2]
+    , vmax = uvg.min[2] + uvg.extent[2] - 1
+    ;
+  if (uvg.extent[0] != 2 || uvg.extent[1] != width || vmin > height / 2 || vmax != height - 1 ||
+      !zeroMin(uvg, 2) || !zeroMin(*_img_shifted_buffer, 2))
+    return -666;
+
+  complexd * shifted = alloc<complexd>(int64_t(width) * (height / 2 + 1));
+  if (shifted == NULL) return -666;
+  parallelRanges(threadsFor(mode), height / 2 + 1, [&](int32_t v0, int32_t v1) {
+    for (int32_t v = v0; v < v1; v++) {
+      const int32_t vp = height / 2 + v, vm = height / 2 - v;
+      for (int32_t u = 0; u < width; u++) {
+        const int32_t su = (u + width / 2) % width, um = (width - su) % width;
+        double re = 0, im = 0;
+        if (vp <= vmax) { re += at(uvg, 0, su, vp); im += at(uvg, 1, su, vp); }
+        if (vm >= vmin) { re += at(uvg, 0, um, vm); im -= at(uvg, 1, um, vm); }
+        shifted[int64_t(v) * width + u] = complexd(re / 2, im / 2);
+      }
+    }
+  });
+  return ifftHalf(mode, shifted, *_img_shifted_buffer, width, height);
+}
+
+extern "C" {
+
+int kern_ifft_half_dyn(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer) {
+  return ifftHalfPlane(PLAN_QUICK, _uvg_buffer, _img_shifted_buffer);
+}
+
+int kern_ifft_half_par_dyn(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer) {
+  return ifftHalfPlane(PLAN_QUICK_PAR, _uvg_buffer, _img_shifted_buffer);
+}
+
+int kern_ifft_half_fftw(buffer_t *_uvg_buffer, buffer_t *_img_shifted_buffer) {
+  return ifftHalfPlane(PLAN_TUNED, _uvg_buffer, _img_shifted_buffer);
+}
+
+// See "ifftC2CKernel" in fft.cpp
+int kern_ifft_c2c_dyn(buffer_t *_uvg_buffer, buffer_t *_img_cshifted_buffer) {
+  const buffer_t & uvg = *_uvg_buffer, & img = *_img_cshifted_buffer;
+  const int32_t width = img.extent[1], height = img.extent[2];
+  if (img.extent[0] != 2 || uvg.extent[0] != 2 ||
+      uvg.extent[1] != width || uvg.extent[2] != height ||
+      !zeroMin(img, 3) || !zeroMin(uvg, 3))
+    return -666;
+
+  fftw_plan plan = getPlan(FFT_C2C_INV, PLAN_QUICK, width, height);
+  complexd * data = alloc<complexd>(int64_t(width) * height);
+  if (plan == NULL || data == NULL) { fftw_free(data); return -666; }
+  for (int32_t v = 0; v < height; v++) {
+    const int32_t sv = (v + height / 2) % height;
+    for (int32_t u = 0; u < width; u++) {
+      const int32_t su = (u + width / 2) % width;
+      data[int64_t(v) * width + u] = complexd(at(uvg, 0, su, sv), at(uvg, 1, su, sv));
+    }
+  }
+  fftw_execute_dft(plan, reinterpret_cast<fftw_complex *>(data),
+                         reinterpret_cast<fftw_complex *>(data));
+  for (int32_t v = 0; v < height; v++) {
+    const complexd * row = data + int64_t((v + height / 2) % height) * width;
+    for (int32_t u = 0; u < width; u++) {
+      const complexd z = row[(u + width / 2) % width] / double(width);
+      at(img, 0, u, v) = z.real();
+      at(img, 1, u, v) = z.imag();
+    }
+  }
+  fftw_free(data);
+  return 0;
+}
+
+}
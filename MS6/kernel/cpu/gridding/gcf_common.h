@@ -13,4 +13,23 @@ int32_t checkSize(const buffer_t & gcf) {
   return -1;
 }
 
+// The GCF stores one layer per oversampled u/v offset pair
+inline
+int32_t checkOver(const buffer_t & gcf) {
+  int32_t layers = gcf.extent[3];
+  for (int32_t over = 1; over * over <= layers; over++)
+    if (over * over == layers) return over;
+  return -1;
+}
+
+// Quadrant GCFs only store layers for offsets 0..over/2 in either
+// direction (see gcf_halide.h)
+inline
+int32_t checkOverQ(const buffer_t & gcf) {
+  int32_t layers = gcf.extent[3];
+  for (int32_t over = 2; (over/2+1) * (over/2+1) <= layers; over += 2)
+    if ((over/2+1) * (over/2+1) == layers) return over;
+  return -1;
+}
+
 #endif
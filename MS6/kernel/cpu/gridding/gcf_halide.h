@@ -0,0 +1,55 @@
+#ifndef GCF_HALIDE_H
+#define GCF_HALIDE_H
+
+// GCF access shared between gridder and degridder kernels
+
+#include "utils.h"
+
+// W-kernels are symmetric: Oversampled GCF position p = S*OVER/2 + d
+// has the same value as S*OVER/2 - d. A tap "supp" at oversampling
+// offset "over" is position supp*OVER + over, so the layer for offset
+// OVER-o is just the layer for o, mirrored:
+//
+//   gcf(supp, OVER-o) = gcf(S-1-supp, o)
+//
+// A "quadrant" GCF therefore only needs to store layers for offsets
+// 0..OVER/2 in either direction, ordered the same way as usual.
+inline int gcfLayers(int OVER, bool quadrant) {
+  return quadrant ? (OVER/2+1)*(OVER/2+1) : OVER*OVER;
+}
+
+// Look up a GCF value given taps and oversampling offsets. The GCF
+// might hold a stack of w-planes, "plane" selects one (see the MFS
+// gridder in scatter.cpp).
+//
+// For quadrant GCFs, a row gets read mirrored for u offsets above
+// OVER/2. Where taps in u are vectorised, deciding this per lane
+// turns the loads into gathers. Callers can therefore decide it
+// themselves by passing "mirrorx", ideally a constant per unrolled
+// loop (see scatter.cpp).
+inline Complex gcfLookup(ImageParam gcf_fused, Type t, Expr gcf_size, int OVER, bool quadrant,
+                         Expr suppx, Expr suppy, Expr overx, Expr overy,
+                         Expr plane = 0, Expr mirrorx = Expr()) {
+  Expr layer = overx + OVER * overy;
+  if (quadrant) {
+    if (!mirrorx.defined()) mirrorx = overx > OVER/2;
+    suppx = select(mirrorx, gcf_size - 1 - suppx, suppx);
+    suppy = select(overy > OVER/2, gcf_size - 1 - suppy, suppy);
+    layer = min(overx, OVER - overx) + (OVER/2+1) * min(overy, OVER - overy);
+  }
+  layer += gcfLayers(OVER, quadrant) * plane;
+  return Complex(cast(t, gcf_fused(_REAL, suppx, suppy, layer)),
+                 cast(t, gcf_fused(_IMAG, suppx, suppy, layer)));
+}
+
+// Look up a separable GCF. Here we only have two OxS arrays of
+// complex numbers, one for u and one for v (the last dimension). The
+// GCF value is their product.
+inline Complex gcfSepLookup(ImageParam gcf_sep, Type t,
+                            Expr suppx, Expr suppy, Expr overx, Expr overy) {
+  Complex gu(cast(t, gcf_sep(_REAL, suppx, overx, 0)), cast(t, gcf_sep(_IMAG, suppx, overx, 0)));
+  Complex gv(cast(t, gcf_sep(_REAL, suppy, overy, 1)), cast(t, gcf_sep(_IMAG, suppy, overy, 1)));
+  return gu * gv;
+}
+
+#endif // GCF_HALIDE_H
@@ -3,8 +3,12 @@
 #include "utils.h"
 using namespace Halide;
 
-int main(int argc, char **argv) {
-  if (argc < 2) return 1;
+// Number of rotation parameters per facet, see "rotateParamsKernel"
+const int _ROT_PARAMS = _MATRIX_FIELDS + _VECTOR_FIELDS;
+
+// With "soa" set, visibilities (input and output) come as one plane
+// per field, see scatter.cpp.
+Module rotateKernel(Target target, bool soa) {
 
   // ** Input
 
@@ -16,8 +20,16 @@ int main(int argc, char **argv) {
   // Visibilities: Array of 5-pairs, packed together with UVW
   enum VisFields { _U=0, _V, _W, _R, _I,  _VIS_FIELDS };
   ImageParam vis(type_of<double>(), 2, "vis");
-  vis.set_min(0,0).set_stride(0,1).set_extent(0,_VIS_FIELDS)
-     .set_stride(1,_VIS_FIELDS);
+  Func visF("visF"); Var vf("vf"), vt("vt");
+  if (!soa) {
+    vis.set_min(0,0).set_stride(0,1).set_extent(0,_VIS_FIELDS)
+       .set_stride(1,_VIS_FIELDS);
+    visF(vf, vt) = vis(vf, vt);
+  } else {
+    vis.set_stride(0,1)
+       .set_min(1,0).set_extent(1,_VIS_FIELDS).set_stride(1,vis.extent(0));
+    visF(vf, vt) = vis(vt, vf);
+  }
 
   std::vector<Halide::Argument> args = {
       in_lon, in_lat,
@@ -32,7 +44,11 @@ int main(int argc, char **argv) {
   // calculate out longitude/latitude from it
   Var uvdim("uvdim"); Var t("t");
   Func rot("rot");
-  rot(uvdim, t) = undef<double>();
+  if (!soa) {
+    rot(uvdim, t) = undef<double>();
+  } else {
+    rot(t, uvdim) = undef<double>();
+  }
   Expr lmin = rot.output_buffer().min(2);
   Expr mmin = rot.output_buffer().min(3);
   Expr out_lon = out_lon0 + lmin * out_lon_incr;
@@ -45,7 +61,7 @@ int main(int argc, char **argv) {
   // UVW vector for a given visibility
   Func uvw("uvw"), newVector("newVector"), mtx("mtx");
   Expr d0 = cast<double>(0), d1 = cast<double>(1);
-  uvw(t) = Vector3(vis(_U,t), vis(_V,t), vis(_W,t));
+  uvw(t) = Vector3(visF(_U,t), visF(_V,t), visF(_W,t));
   mtx() = selectMtx(uvproj != 0,
                     invMtx * (projMtx * rotMtx),
                     Matrix(d1,d0,d0, d0,d1,d0, d0,d0,d1));
@@ -57,13 +73,18 @@ int main(int argc, char **argv) {
   posChange() = wvec - rotMtx * wvec;
   Expr pathDiff = Vector3(posChange()) * uvw(t);
   Complex visRot = polar(cast<double>(1), 2*pi()*pathDiff);
-  newVis(t) = visRot * Complex(vis(_R,t), vis(_I,t));
+  newVis(t) = visRot * Complex(visF(_R,t), visF(_I,t));
 
   // Generate output
-  rot(uvdim, t) =
+  Expr newField =
     select(uvdim < _R,
            Vector3(newVector(t)).unpack(uvdim),
            Complex(newVis(t)).unpack(uvdim-_R));
+  if (!soa) {
+    rot(uvdim, t) = newField;
+  } else {
+    rot(t, uvdim) = newField;
+  }
 
   // ** Strategy
 
@@ -75,13 +96,86 @@ int main(int argc, char **argv) {
   mtx.compute_at(rot, Var::outermost());
   posChange.compute_at(rot, Var::outermost());
 
-  rot.unroll(uvdim).unroll(t,2).specialize(uvproj != 0);
-  rot.output_buffer()
-     .set_min(0,0).set_stride(0,1).set_extent(0,_VIS_FIELDS)
-     .set_stride(1,_VIS_FIELDS);
+  if (!soa) {
+    rot.unroll(uvdim).unroll(t,2).specialize(uvproj != 0);
+    rot.output_buffer()
+       .set_min(0,0).set_stride(0,1).set_extent(0,_VIS_FIELDS)
+       .set_stride(1,_VIS_FIELDS);
+  } else {
+    // Fields innermost (unrolled), so we calculate the rotation only
+    // once per visibility, but vectorised across visibilities.
+    rot.update().reorder(uvdim, t).unroll(uvdim).vectorize(t,4);
+    rot.output_buffer()
+       .set_stride(0,1)
+       .set_min(1,0).set_extent(1,_VIS_FIELDS).set_stride(1,rot.output_buffer().extent(0));
+  }
+
+  return rot.compile_to_module(args, soa ? "kern_rotate_soa" : "kern_rotate", target);
+}
+
+// Only calculates the rotation parameters for a facet: The UVW
+// reprojection matrix, followed by the position change vector. This
+// allows the gridder and degridder to rotate visibilities on the fly
+// (see "rotParams" in scatter.cpp), so we never need to write out
+// rotated visibilities. Output dimensions after the parameters are
+// the facet coordinates, just like for "kern_rotate".
+Module rotateParamsKernel(Target target) {
+
+  Param<double> in_lon("in_lon"), in_lat("in_lat");
+  Param<double> out_lon0("out_lon0"), out_lat0("out_lat0");
+  Param<double> out_lon_incr("out_lon_incr"), out_lat_incr("out_lat_incr");
+  Param<int> uvproj("uvproj");
+  std::vector<Halide::Argument> args = {
+      in_lon, in_lat,
+      out_lon0, out_lat0,
+      out_lon_incr, out_lat_incr,
+      uvproj
+  };
+
+  Var par("par"), l("l"), m("m");
+  Func rotPar("rotPar");
+  rotPar(par, l, m) = undef<double>();
+  Expr lmin = rotPar.output_buffer().min(1);
+  Expr mmin = rotPar.output_buffer().min(2);
+  Expr out_lon = out_lon0 + lmin * out_lon_incr;
+  Expr out_lat = out_lat0 + mmin * out_lat_incr;
+
+  // Same calculation as in "rotateKernel"
+  Matrix rotMtx = xyz2uvw(out_lon, out_lat) * uvw2xyz(in_lon, in_lat);
+  Matrix projMtx = rotMtx.inverse2x2().transpose();
+  Matrix invMtx = rotMtx.transpose();
+  Expr d0 = cast<double>(0), d1 = cast<double>(1);
+  Matrix mtx = selectMtx(uvproj != 0,
+                         invMtx * (projMtx * rotMtx),
+                         Matrix(d1,d0,d0, d0,d1,d0, d0,d0,d1));
+  Vector3 wvec = { d0, d0, d1 };
+  Vector3 posChange = wvec - rotMtx * wvec;
+
+  // Generate output
+  Expr out = posChange[_A3];
+  for (int i = _VECTOR_FIELDS - 2; i >= 0; i--) {
+    out = select(par == _MATRIX_FIELDS + i, posChange[i], out);
+  }
+  for (int i = _MATRIX_FIELDS - 1; i >= 0; i--) {
+    out = select(par == i, mtx[i], out);
+  }
+  rotPar(par, l, m) = out;
+
+  rotPar.output_buffer()
+     .set_min(0,0).set_stride(0,1).set_extent(0,_ROT_PARAMS);
+  return rotPar.compile_to_module(args, "kern_rotate_params", target);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) return 1;
 
   Target target(get_target_from_environment().os, Target::X86, 64, { Target::SSE41, Target::AVX});
-  Module mod = rot.compile_to_module(args, "kern_rotate", target);
-  compile_module_to_object(mod, argv[1]);
+  std::vector<Module> modules =
+    { rotateKernel(target, false)
+    , rotateKernel(target, true)
+    , rotateParamsKernel(target)
+    };
+  Module linked = link_modules("kern_rotates", modules);
+  compile_module_to_object(linked, argv[1]);
   return 0;
 }
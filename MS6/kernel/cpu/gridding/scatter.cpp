@@ -7,137 +7,489 @@
 #endif
 
 #include "utils.h"
+#include "gcf_halide.h"
 
 using namespace Halide;
 
-std::string mkKernelName(const std::string & prefix, int GCF_SIZE){
-  return prefix + "_" + std::to_string(GCF_SIZE);
+// A GCF_SIZE of zero stands for a kernel that takes the GCF size at
+// runtime. Kernels for an oversampling factor other than 8 (our
+// default) get it added to their name, e.g. "kern_scatter_o16_32".
+std::string mkKernelName(const std::string & prefix, int GCF_SIZE, int OVER = 8){
+  std::string name = prefix;
+  if (OVER != 8) name += "_o" + std::to_string(OVER);
+  if (GCF_SIZE == 0) return name + "_dyn";
+  return name + "_" + std::to_string(GCF_SIZE);
 }
 
-Module scatterKernel(Target target, int GCF_SIZE) {
+// Oversampling factors we generate kernels for
+const std::vector<int> overs = { 4, 8, 16, 32 };
 
-  // Oversampling is a constant for now
-  const int OVER = 8;
+// Options for the kernel variant to generate. They get set by
+// chaining, e.g. "ScatterOpts().withOver(16).withQuadrant()".
+//
+// With "strip" set, the kernel additionally takes a range of grid
+// rows [strip_min, strip_max) and only updates grid cells within it.
+// This is what the parallel driver in scatter_par.cpp uses to hand
+// disjoint parts of the grid to different threads.
+//
+// "storeT" is the type visibilities and GCF are stored as, "gridT"
+// the type of the grid. Products get calculated and accumulated at
+// grid precision, so single-precision inputs with a double grid only
+// reduce the amount of memory we need to move.
+//
+// "over" is the oversampling factor of the GCF. With "quadrant" set,
+// the GCF only has the layers for oversampling offsets up to over/2
+// in either direction (see gcfLookup). With "sep" set, the GCF is
+// separable and we only get its 1D factors (see gcfSepLookup and
+// scatter_sep.cpp).
+//
+// "npol" is the number of polarisations. Visibility records then have
+// one complex value per polarisation after UVW, and every grid cell
+// has all polarisations next to each other.
+//
+// With "soa" set, visibilities come as a structure of arrays: One
+// plane per field, so the buffer is indexed by (t, field). This
+// allows us to vectorise coordinate preprocessing across visibilities.
+//
+// With "half" set, we only grid the v >= 0 half-plane: Visibilities
+// with v < 0 get replaced by their Hermitian counterpart V(-u,-v) =
+// conj(V(u,v)) first. As the GCF for -w is the conjugate of the GCF
+// for w, this simply means conjugating the product. The output
+// buffer is then only expected to cover the upper half of the grid
+// plus a GCF margin below, see "kern_ifft_half" in fft.cpp.
+//
+// With "residual" set, we additionally get a model grid. Every
+// visibility first gets the model degridded from it and subtracted
+// (just like "kern_degrid" does), then the residual gets gridded
+// right away. This saves writing and re-reading the degridded
+// visibilities in the major cycle. Only supported for plain double
+// precision visibilities.
+//
+// With "psf" set, we grid the point spread function: Visibilities are
+// taken to be 1+0j (times the weight of their grid cell, see
+// weight_vis.cpp, if "weighted" is set), so we only read u/v and
+// accumulate the GCF directly. This means we never need to
+// materialise PSF visibilities (see psf_vis.cpp).
+//
+// With "rot" set, visibilities get rotated to the facet on the fly,
+// just as with "kern_degrid_rot" (see degrid.cpp).
+//
+// With "mfs" set, we do multi-frequency synthesis: Visibility records
+// have UVW in metres, followed by one complex value per channel. We
+// additionally get the inverse wavelength of every channel, and grid
+// all channels of a record right after each other, so every record
+// only gets loaded once. The GCF is a stack of w-planes: Plane p has
+// the usual layers for |w| = p * w_step (in wavelengths), and every
+// channel uses the plane closest to its own w, conjugated for
+// negative w. Channels off the grid get skipped here like any other
+// visibility, which is why the driver (scatter_mfs1.cpp) checks the
+// input first. Only for plain double precision visibilities.
+struct ScatterOpts {
+  bool strip = false;
+  Type storeT = Float(64), gridT = Float(64);
+  int over = 8;
+  bool quadrant = false, sep = false;
+  int npol = 1;
+  bool soa = false, half = false, residual = false;
+  bool psf = false, weighted = false, rot = false;
+  bool mfs = false;
+
+  ScatterOpts & withStrip(bool b = true) { strip = b; return *this; }
+  ScatterOpts & withTypes(Type store, Type grid = Float(64)) { storeT = store; gridT = grid; return *this; }
+  ScatterOpts & withOver(int o) { over = o; return *this; }
+  ScatterOpts & withQuadrant(bool b = true) { quadrant = b; return *this; }
+  ScatterOpts & withSep(bool b = true) { sep = b; return *this; }
+  ScatterOpts & withPols(int n) { npol = n; return *this; }
+  ScatterOpts & withSoA(bool b = true) { soa = b; return *this; }
+  ScatterOpts & withHalf(bool b = true) { half = b; return *this; }
+  ScatterOpts & withResidual(bool b = true) { residual = b; return *this; }
+  ScatterOpts & withPSF(bool b = true, bool w = false) { psf = b; weighted = w; return *this; }
+  ScatterOpts & withRot(bool b = true) { rot = b; return *this; }
+  ScatterOpts & withMFS(bool b = true) { mfs = b; return *this; }
+};
+
+Module scatterKernel(Target target, int GCF_SIZE, const ScatterOpts & opts = ScatterOpts()) {
+
+  const bool strip = opts.strip;
+  const Type storeT = opts.storeT, gridT = opts.gridT;
+  const int OVER = opts.over, NPOL = opts.npol;
+  const bool quadrant = opts.quadrant, sep = opts.sep, soa = opts.soa, half = opts.half;
+  const bool residual = opts.residual, psf = opts.psf, weighted = opts.weighted, rot = opts.rot;
+  const bool mfs = opts.mfs;
 
   // ** Input
 
   Param<double> scale("scale");
   Param<int> grid_size("grid_size");
   Param<int> margin_size("margin_size");
+  Param<int> strip_min("strip_min"), strip_max("strip_max");
+  Param<double> w_step("w_step");
+
+  // Inverse wavelength of every channel, for MFS
+  ImageParam inv_lambdas(type_of<double>(), 1, "inv_lambdas");
+  inv_lambdas.set_min(0,0).set_stride(0,1);
+  Expr nchan = mfs ? inv_lambdas.extent(0) : Expr(1);
 
-  // Visibilities: Array of 5-pairs, packed together with UVW
+  // Visibilities: Array of 5-pairs, packed together with UVW. With
+  // multiple polarisations or channels, we have more real/imaginary
+  // pairs.
   enum VisFields { _U=0, _V, _W, _R, _I,  _VIS_FIELDS };
-  ImageParam vis(type_of<double>(), 2, "vis");
-  vis.set_min(0,0).set_stride(0,1).set_extent(0,_VIS_FIELDS)
-     .set_stride(1,_VIS_FIELDS);
+  Expr visFields = _VIS_FIELDS + _CPLX_FIELDS * (NPOL * nchan - 1);
+  ImageParam vis(storeT, 2, "vis");
+  Func visRaw("visRaw"), visF("visF"); Var vf("vf"), vt("vt");
+  if (!soa) {
+    vis.set_min(0,0).set_stride(0,1).set_extent(0,visFields)
+       .set_stride(1,visFields);
+    visRaw(vf, vt) = vis(vf, vt);
+  } else {
+    vis.set_stride(0,1)
+       .set_min(1,0).set_extent(1,visFields).set_stride(1,vis.extent(0));
+    visRaw(vf, vt) = vis(vt, vf);
+  }
+
+  // Facet rotation parameters, see rotate.cpp
+  ImageParam rotp(type_of<double>(), 1, "rot");
+  rotp.set_min(0,0).set_stride(0,1).set_extent(0,_MATRIX_FIELDS+_VECTOR_FIELDS);
+  if (rot) {
+    visF(vf, vt) = rotateVisField(rotp, visRaw, vf, vt);
+  } else {
+    visF(vf, vt) = visRaw(vf, vt);
+  }
+  Expr vis_min = soa ? vis.min(0) : vis.min(1);
+  Expr vis_count = soa ? vis.extent(0) : vis.extent(1);
 
   // GCF: Array of OxOxSxS complex numbers. We "fuse" two dimensions
-  // as Halide only supports up to 4 dimensions.
-  ImageParam gcf_fused(type_of<double>(), 4, "gcf");
-  gcf_fused
-     .set_min(0,0).set_stride(0,1).set_extent(0,_CPLX_FIELDS)
-     .set_min(1,0).set_stride(1,_CPLX_FIELDS).set_extent(1,GCF_SIZE)
-     .set_min(2,0).set_stride(2,_CPLX_FIELDS*GCF_SIZE).set_extent(2,GCF_SIZE)
-     .set_min(3,0).set_stride(3,_CPLX_FIELDS*GCF_SIZE*GCF_SIZE).set_extent(3,OVER*OVER);
+  // as Halide only supports up to 4 dimensions. Without a fixed
+  // GCF_SIZE, S is whatever the buffer says.
+  ImageParam gcf_fused(storeT, 4, "gcf");
+  Expr gcf_size = GCF_SIZE > 0 ? Expr(GCF_SIZE) : gcf_fused.extent(1);
+  if (!sep) {
+    gcf_fused
+       .set_min(0,0).set_stride(0,1).set_extent(0,_CPLX_FIELDS)
+       .set_min(1,0).set_stride(1,_CPLX_FIELDS)
+       .set_min(2,0).set_stride(2,_CPLX_FIELDS*gcf_size).set_extent(2,gcf_size)
+       .set_min(3,0).set_stride(3,_CPLX_FIELDS*gcf_size*gcf_size);
+    // With MFS, we have a stack of w-planes, see above
+    if (!mfs) gcf_fused.set_extent(3,gcfLayers(OVER, quadrant));
+  } else {
+    // Separable GCF: 2xOxS complex numbers
+    gcf_fused
+       .set_min(0,0).set_stride(0,1).set_extent(0,_CPLX_FIELDS)
+       .set_min(1,0).set_stride(1,_CPLX_FIELDS)
+       .set_min(2,0).set_stride(2,_CPLX_FIELDS*gcf_size).set_extent(2,OVER)
+       .set_min(3,0).set_stride(3,_CPLX_FIELDS*gcf_size*OVER).set_extent(3,2);
+  }
+  if (GCF_SIZE > 0) gcf_fused.set_extent(1,GCF_SIZE);
+
+  // Weights per grid cell, for weighted PSF gridding
+  ImageParam weights(type_of<double>(), 2, "weights");
+  weights.set_min(0,0).set_stride(0,1).set_min(1,0);
 
-  std::vector<Halide::Argument> args = { scale, grid_size, margin_size, vis, gcf_fused };
+  // Model grid to degrid from, see degrid.cpp
+  ImageParam model(type_of<double>(), 3, "model");
+  model.set_stride(0,1).set_extent(0,_CPLX_FIELDS)
+       .set_stride(1,_CPLX_FIELDS);
+
+  // Parameters for the residual kernel come in the same order as for
+  // the degridder.
+  std::vector<Halide::Argument> args = { scale, grid_size, margin_size };
+  if (strip) {
+    args.push_back(strip_min);
+    args.push_back(strip_max);
+  }
+  if (mfs) {
+    args.push_back(w_step);
+    args.push_back(inv_lambdas);
+  }
+  if (rot) args.push_back(rotp);
+  if (residual) {
+    args.push_back(gcf_fused);
+    args.push_back(model);
+    args.push_back(vis);
+  } else {
+    if (psf && weighted) args.push_back(weights);
+    args.push_back(vis);
+    args.push_back(gcf_fused);
+  }
 
   // ** Output
 
   // Grid starts out undefined so we can update the output buffer
   Func uvg("uvg");
   Var cmplx("cmplx"), x("x"), y("y");
-  uvg(cmplx, x, y) = undef<double>();
+  uvg(cmplx, x, y) = undef(gridT);
 
   uvg.output_buffer()
-    .set_stride(0,1).set_extent(0,_CPLX_FIELDS)
-    .set_stride(1,_CPLX_FIELDS);
+    .set_stride(0,1).set_extent(0,_CPLX_FIELDS*NPOL)
+    .set_stride(1,_CPLX_FIELDS*NPOL);
 
   // Get grid limits. This limits the uv pixel coordinates we accept
   // for the top-left corner of the GCF.
-  Expr gcf_margin = max(0, (margin_size - GCF_SIZE) / 2);
+  Expr gcf_margin = max(0, (margin_size - gcf_size) / 2);
   Expr min_u = uvg.output_buffer().min(1) + gcf_margin;
-  Expr max_u = uvg.output_buffer().min(1) + uvg.output_buffer().extent(1) - GCF_SIZE - 1 - gcf_margin;
+  Expr max_u = uvg.output_buffer().min(1) + uvg.output_buffer().extent(1) - gcf_size - 1 - gcf_margin;
   Expr min_v = uvg.output_buffer().min(2) + gcf_margin;
-  Expr max_v = uvg.output_buffer().min(2) + uvg.output_buffer().extent(2) - GCF_SIZE - 1 - gcf_margin;
+  Expr max_v = uvg.output_buffer().min(2) + uvg.output_buffer().extent(2) - gcf_size - 1 - gcf_margin;
 
   // ** Helpers
 
-  // Coordinate preprocessing
-  Func uvs("uvs"), uv("uv"), overc("overc");
-  Var uvdim("uvdim"), t("t");
-  uvs(uvdim, t) = vis(uvdim, t) * scale;
-  overc(uvdim, t) = clamp(cast<int>(round(OVER * (uvs(uvdim, t) - floor(uvs(uvdim, t))))), 0, OVER-1);
-  uv(uvdim, t) = cast<int>(round(uvs(uvdim, t)) + grid_size / 2 - GCF_SIZE / 2);
+  // Coordinate preprocessing, per channel "c" of visibility "t".
+  // Without MFS, there is only channel 0.
+  Func uvs("uvs"), uv("uv"), overc("overc"), flip("flip");
+  Var uvdim("uvdim"), c("c"), t("t");
+  Expr chanScale = mfs ? inv_lambdas(c) * scale : Expr(scale);
+  if (!half) {
+    uvs(uvdim, c, t) = cast<double>(visF(uvdim, t)) * chanScale;
+  } else {
+    flip(t) = visF(_V, t) < 0;
+    uvs(uvdim, c, t) = select(flip(t), -1, 1) * cast<double>(visF(uvdim, t)) * chanScale;
+  }
+  overc(uvdim, c, t) = clamp(cast<int>(round(OVER * (uvs(uvdim, c, t) - floor(uvs(uvdim, c, t))))), 0, OVER-1);
+  uv(uvdim, c, t) = cast<int>(round(uvs(uvdim, c, t)) + grid_size / 2 - gcf_size / 2);
 
   // Visibilities to ignore due to being out of bounds
   Func inBound("inBound");
-  inBound(t) = uv(_U, t) >= min_u && uv(_U, t) <= max_u &&
-               uv(_V, t) >= min_v && uv(_V, t) <= max_v;
+  inBound(c, t) = uv(_U, c, t) >= min_u && uv(_U, c, t) <= max_u &&
+                  uv(_V, c, t) >= min_v && uv(_V, c, t) <= max_v;
+
+  // W-plane of the GCF stack to use for a channel (MFS only)
+  Func plane("plane");
+  Expr wc;
+  if (mfs) {
+    wc = cast<double>(visF(_W, t)) * inv_lambdas(c);
+    Expr nplanes = gcf_fused.extent(3) / gcfLayers(OVER, quadrant);
+    plane(c, t) = select(w_step > 0, clamp(cast<int>(round(abs(wc) / w_step)), 0, nplanes - 1), 0);
+  }
 
-  // GCF lookup for a given visibility
+  // GCF lookup for a given visibility. For quadrant GCFs, "mx" says
+  // whether to mirror in u (see gcfLookup), which must match the u
+  // oversampling offset.
   Func gcf("gcf");
-  Var suppx("suppx"), suppy("suppy"), overx("overx"), overy("overy");
-  gcf(suppx, suppy, t)
-      = Complex(gcf_fused(_REAL, suppx, suppy, overc(_U, t) + OVER * overc(_V, t)),
-                gcf_fused(_IMAG, suppx, suppy, overc(_U, t) + OVER * overc(_V, t)));
+  Var suppx("suppx"), suppy("suppy"), mx("mx");
+  if (sep) {
+    gcf(suppx, suppy, mx, c, t)
+        = gcfSepLookup(gcf_fused, gridT, suppx, suppy, overc(_U, c, t), overc(_V, c, t));
+  } else if (mfs) {
+    Complex g = gcfLookup(gcf_fused, gridT, gcf_size, OVER, quadrant,
+                          suppx, suppy, overc(_U, c, t), overc(_V, c, t), plane(c, t), mx != 0);
+    gcf(suppx, suppy, mx, c, t) = Complex(g.real, select(wc < 0, -g.imag, g.imag));
+  } else {
+    gcf(suppx, suppy, mx, c, t)
+        = gcfLookup(gcf_fused, gridT, gcf_size, OVER, quadrant,
+                    suppx, suppy, overc(_U, c, t), overc(_V, c, t), 0, mx != 0);
+  }
+  auto mirrorX = [&](Expr c, Expr t) { return cast<int>(overc(_U, c, t) > OVER/2); };
+
+  // Residual visibilities. Visibilities that the degridder would
+  // skip for being out of the model's bounds stay unchanged.
+  Func pred("pred"), resVis("resVis");
+  if (residual) {
+    Expr min_mu = model.min(1) + gcf_margin;
+    Expr max_mu = model.min(1) + model.extent(1) - gcf_size - 1 - gcf_margin;
+    Expr min_mv = model.min(2) + gcf_margin;
+    Expr max_mv = model.min(2) + model.extent(2) - gcf_size - 1 - gcf_margin;
+    Expr inModel = uv(_U, 0, t) >= min_mu && uv(_U, 0, t) <= max_mu &&
+                   uv(_V, 0, t) >= min_mv && uv(_V, 0, t) <= max_mv;
+
+    RDom rm(0, gcf_size, 0, gcf_size);
+    Expr mu = rm.x + clamp(uv(_U, 0, t), min_mu, max_mu);
+    Expr mv = rm.y + clamp(uv(_V, 0, t), min_mv, max_mv);
+    Expr zero = cast<double>(0);
+    pred(t) = Tuple(zero, zero);
+    Complex p = Complex(pred(t)) +
+                Complex(model(_REAL, mu, mv), model(_IMAG, mu, mv)) * Complex(gcf(rm.x, rm.y, mirrorX(0, t), 0, t));
+    pred(t) = Tuple(p.real, p.imag);
+
+    Expr vr = cast<double>(visF(_R, t)), vi = cast<double>(visF(_I, t));
+    resVis(t) = Tuple(select(inModel, vr - Complex(pred(t)).real, vr),
+                      select(inModel, vi - Complex(pred(t)).imag, vi));
+  }
+
+  // PSF weight per visibility, looked up exactly like "kern_weight_vis" does
+  Func psfWeight("psfWeight");
+  if (psf && weighted) {
+    Expr wx = cast<int>(round(cast<double>(visF(_U, t)) * scale)) + weights.width() / 2;
+    Expr wy = cast<int>(round(cast<double>(visF(_V, t)) * scale)) + weights.height() / 2;
+    Expr inWeights = wx >= 0 && wx < weights.width() && wy >= 0 && wy < weights.height();
+    psfWeight(t) = select(inWeights,
+                          weights(clamp(wx, 0, weights.width()-1), clamp(wy, 0, weights.height()-1)),
+                          cast<double>(0.0f));
+  }
 
   // ** Definition
 
   // Reduction domain. Note that we iterate over time steps before
   // switching the GCF row in order to increase locality (Romein).
-  RDom red(
-      0, _CPLX_FIELDS
-    , 0, GCF_SIZE
-    , vis.top(), vis.height()
-    , 0, GCF_SIZE
-    );
-  RVar
-      rcmplx = red.x
-    , rgcfx = red.y
-    , rvis  = red.z
-    , rgcfy = red.w
-    ;
-
-  // Get visibility as complex number
-  Complex visC(vis(_R, rvis), vis(_I, rvis));
-
-  // Update grid
-  uvg(rcmplx,
-      rgcfx + clamp(uv(_U, rvis), min_u, max_u),
-      rgcfy + clamp(uv(_V, rvis), min_v, max_v))
-    += select(inBound(rvis),
-              (visC * Complex(gcf(rgcfx, rgcfy, rvis))).unpack(rcmplx),
-              undef<double>());
+  // With MFS, channels of a visibility get gridded right after each
+  // other.
+  //
+  // For quadrant GCFs, we have both a plain and a mirrored version of
+  // the row loop (see gcfLookup), and only run the one matching the
+  // visibility. Once unrolled, both only do dense loads.
+  typedef std::pair<Expr, Expr> rType;
+  std::vector<rType> rVec = { rType(0, _CPLX_FIELDS*NPOL), rType(0, gcf_size) };
+  if (quadrant) rVec.push_back(rType(0, 2));
+  if (mfs) rVec.push_back(rType(0, nchan));
+  rVec.push_back(rType(vis_min, vis_count));
+  rVec.push_back(rType(0, gcf_size));
+  RDom red(rVec);
+  int rdim = 0;
+  RVar rcmplx = red[rdim++], rgcfx = red[rdim++];
+  RVar rmirror, rchan;
+  if (quadrant) rmirror = red[rdim++];
+  if (mfs) rchan = red[rdim++];
+  RVar rvis = red[rdim++], rgcfy = red[rdim++];
+  // Mirroring, channel, and the loop we compute coordinates at
+  Expr mirror = quadrant ? Expr(rmirror) : Expr(0);
+  Expr chan = mfs ? Expr(rchan) : Expr(0);
+  RVar rcoord = mfs ? rchan : rvis;
+
+  // Get visibility as complex number. With multiple polarisations,
+  // "rcmplx" also selects the polarisation.
+  Expr visR = _R, visI = _I, part = rcmplx;
+  if (mfs) {
+    visR = _R + _CPLX_FIELDS * chan;
+    visI = _I + _CPLX_FIELDS * chan;
+  }
+  if (NPOL > 1) {
+    visR = _R + rcmplx / _CPLX_FIELDS * _CPLX_FIELDS;
+    visI = _I + rcmplx / _CPLX_FIELDS * _CPLX_FIELDS;
+    part = rcmplx % _CPLX_FIELDS;
+  }
+  Complex visC(cast(gridT, visF(visR, rvis)), cast(gridT, visF(visI, rvis)));
+  if (residual) {
+    visC = Complex(resVis(rvis));
+  }
+
+  // Grid position to update. When working on a strip, we
+  // additionally skip all rows that belong to somebody else. Note
+  // that this does not change the order in which contributions get
+  // summed up for the rows we do own.
+  Expr u = rgcfx + clamp(uv(_U, chan, rvis), min_u, max_u);
+  Expr v = rgcfy + clamp(uv(_V, chan, rvis), min_v, max_v);
+  Expr doUpdate = inBound(chan, rvis);
+  if (quadrant) {
+    doUpdate = doUpdate && mirror == mirrorX(chan, rvis);
+  }
+  if (strip) {
+    doUpdate = doUpdate && v >= strip_min && v < strip_max;
+  }
+
+  // Update grid. Folded visibilities get conjugated (see above). For
+  // the PSF, the visibility is real, so we can skip the multiplication.
+  Complex prod = Complex(gcf(rgcfx, rgcfy, mirror, chan, rvis));
+  if (!psf) {
+    prod = visC * prod;
+  } else if (weighted) {
+    Expr w = cast(gridT, psfWeight(rvis));
+    prod = Complex(w * prod.real, w * prod.imag);
+  }
+  if (half) {
+    prod.imag = select(flip(rvis), -prod.imag, prod.imag);
+  }
+  uvg(rcmplx, u, v)
+    += select(doUpdate, prod.unpack(part), undef(gridT));
 
   // ** Strategy
 
-  // Compute UV & oversampling coordinates per visibility
-  overc.compute_at(uvg, rvis).vectorize(uvdim);
-  uv.compute_at(uvg,rvis).vectorize(uvdim);
-  inBound.compute_at(uvg,rvis);
+  // Compute UV & oversampling coordinates per visibility (and
+  // channel). For SoA we can instead do it for all visibilities
+  // up-front, vectorised across visibilities.
+  if (!soa) {
+    overc.compute_at(uvg, rcoord).vectorize(uvdim);
+    uv.compute_at(uvg, rcoord).vectorize(uvdim);
+    inBound.compute_at(uvg, rcoord);
+    if (mfs) plane.compute_at(uvg, rcoord);
+    if (rot) visF.compute_at(uvg,rvis).bound(vf, 0, _VIS_FIELDS).unroll(vf);
+    if (psf && weighted) psfWeight.compute_at(uvg,rvis);
+  } else {
+    overc.compute_root().bound(uvdim, 0, 2).bound(c, 0, 1).reorder(uvdim, t).unroll(uvdim).vectorize(t, 4);
+    uv.compute_root().bound(uvdim, 0, 2).bound(c, 0, 1).reorder(uvdim, t).unroll(uvdim).vectorize(t, 4);
+    inBound.compute_root().bound(c, 0, 1).vectorize(t, 4);
+  }
 
-  // Fuse and vectorise complex calculations of entire GCF rows
+  // Fuse and vectorise complex calculations of entire GCF rows. We
+  // can only unroll fully if we know the GCF size up-front.
   RVar rgcfxc;
-  uvg.update()
-    .allow_race_conditions()
-    .fuse(rgcfx, rcmplx, rgcfxc)
-    .vectorize(rgcfxc, 8)
-    .unroll(rgcfxc, GCF_SIZE * 2 / 8);
+  Stage upd = uvg.update();
+  upd.allow_race_conditions()
+     .fuse(rgcfx, rcmplx, rgcfxc)
+     .vectorize(rgcfxc, 8);
+  if (GCF_SIZE > 0) upd.unroll(rgcfxc, GCF_SIZE * _CPLX_FIELDS * NPOL / 8);
+  if (quadrant) upd.unroll(rmirror);
+
+  // For residuals, we go through visibilities one by one instead, so
+  // we only need to degrid every visibility once.
+  if (residual) {
+    upd.reorder(rgcfxc, rgcfy, rvis);
+    pred.compute_at(uvg, rvis);
+    resVis.compute_at(uvg, rvis);
+  }
 
-  return uvg.compile_to_module(args, mkKernelName("kern_scatter", GCF_SIZE), target);
+  std::string prefix = "kern_scatter";
+  if (strip) prefix += "_strip";
+  if (storeT.bits() == 32) prefix += gridT.bits() == 32 ? "_f32g" : "_f32";
+  if (quadrant) prefix += "_q";
+  if (sep) prefix += "_sep";
+  if (NPOL > 1) prefix += "_pol" + std::to_string(NPOL);
+  if (soa) prefix += "_soa";
+  if (half) prefix += "_half";
+  if (residual) prefix += "_resid";
+  if (psf) prefix += weighted ? "_psfw" : "_psf";
+  if (rot) prefix += "_rot";
+  if (mfs) prefix += "_mfs";
+  return uvg.compile_to_module(args, mkKernelName(prefix, GCF_SIZE, OVER), target);
 }
 
 int main(int argc, char **argv)
 {
     if (argc < 2) return 1;
     Target target(get_target_from_environment().os, Target::X86, 64, { Target::SSE41, Target::AVX });
-    std::vector<Module> modules =
-      { scatterKernel(target,  8)
-      , scatterKernel(target, 16)
-      , scatterKernel(target, 32)
-      , scatterKernel(target, 64)
-      };
+    std::vector<Module> modules;
+    const std::vector<int> sizes = { 8, 16, 32, 64, 0 };
+    // Plain and quadrant kernels for every oversampling factor
+    for (int over : overs) {
+      for (int size : sizes) {
+        modules.push_back(scatterKernel(target, size, ScatterOpts().withOver(over)));
+        modules.push_back(scatterKernel(target, size, ScatterOpts().withOver(over).withQuadrant()));
+      }
+    }
+    // Everything else only for the default oversampling factor
+    for (int size : sizes) {
+      // Strips for the parallel driver (scatter_par.cpp)
+      modules.push_back(scatterKernel(target, size, ScatterOpts().withStrip()));
+      modules.push_back(scatterKernel(target, size, ScatterOpts().withStrip().withQuadrant()));
+      // Separable GCFs (scatter_sep.cpp)
+      modules.push_back(scatterKernel(target, size, ScatterOpts().withSep()));
+    }
+    // Mixed precision
+    for (int size : { 8, 16, 32, 64 }) {
+      modules.push_back(scatterKernel(target, size, ScatterOpts().withTypes(Float(32))));
+      modules.push_back(scatterKernel(target, size, ScatterOpts().withTypes(Float(32), Float(32))));
+    }
+    for (int size : sizes) {
+      // Full polarisation
+      modules.push_back(scatterKernel(target, size, ScatterOpts().withPols(4)));
+      // Structure-of-arrays visibilities
+      modules.push_back(scatterKernel(target, size, ScatterOpts().withSoA()));
+      // Hermitian half-plane
+      modules.push_back(scatterKernel(target, size, ScatterOpts().withHalf()));
+      // Fused degridding and gridding of residuals. Also with
+      // visibility rotation, see rotate.cpp.
+      for (bool quadrant : { false, true }) {
+        for (bool rot : { false, true }) {
+          modules.push_back(scatterKernel(target, size, ScatterOpts().withResidual().withQuadrant(quadrant).withRot(rot)));
+        }
+      }
+      // Multi-frequency synthesis
+      modules.push_back(scatterKernel(target, size, ScatterOpts().withMFS()));
+      // PSF gridding, with and without weights
+      for (bool quadrant : { false, true }) {
+        for (bool weighted : { false, true }) {
+          modules.push_back(scatterKernel(target, size, ScatterOpts().withPSF(true, weighted).withQuadrant(quadrant)));
+        }
+      }
+    }
     Module linked = link_modules("kern_scatters", modules);
     compile_module_to_c_header(linked, std::string(argv[1]) + ".h");
     compile_module_to_object(linked, argv[1]);
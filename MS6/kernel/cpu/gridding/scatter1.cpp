@@ -1,20 +1,201 @@
 #include "gcf_common.h"
 
 extern "C" {
-int kern_scatter_8(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer);
-int kern_scatter_16(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer);
-int kern_scatter_32(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg__2_buffer);
-int kern_scatter_64(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg__3_buffer);
+#define __DECL(name) int name(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer);
+#define __DECL_SIZES(pre) __DECL(pre ## _8) __DECL(pre ## _16) __DECL(pre ## _32) __DECL(pre ## _64) __DECL(pre ## _dyn)
+__DECL_SIZES(kern_scatter)
+__DECL_SIZES(kern_scatter_o4)
+__DECL_SIZES(kern_scatter_o16)
+__DECL_SIZES(kern_scatter_o32)
+__DECL_SIZES(kern_scatter_q)
+__DECL_SIZES(kern_scatter_q_o4)
+__DECL_SIZES(kern_scatter_q_o16)
+__DECL_SIZES(kern_scatter_q_o32)
+__DECL_SIZES(kern_scatter_pol4)
+__DECL_SIZES(kern_scatter_soa)
+__DECL_SIZES(kern_scatter_half)
+__DECL_SIZES(kern_scatter_psf)
+__DECL_SIZES(kern_scatter_q_psf)
+__DECL(kern_scatter_f32_8)
+__DECL(kern_scatter_f32_16)
+__DECL(kern_scatter_f32_32)
+__DECL(kern_scatter_f32_64)
+__DECL(kern_scatter_f32g_8)
+__DECL(kern_scatter_f32g_16)
+__DECL(kern_scatter_f32g_32)
+__DECL(kern_scatter_f32g_64)
+
+#define __CALL(name) name(_scale, _grid_size, _margin_size, _vis_buffer, _gcf_buffer, _uvg_buffer)
+#define __I_CASE(pre, siz) case siz: return __CALL(pre ## _ ## siz);
+// Other sizes go to the slower generic kernel
+#define __SIZES(pre)   \
+  switch( size ) {     \
+    __I_CASE(pre,  8)  \
+    __I_CASE(pre, 16)  \
+    __I_CASE(pre, 32)  \
+    __I_CASE(pre, 64)  \
+  }                    \
+  if (size > 0) return __CALL(pre ## _dyn);
 
 int kern_scatter(const double _scale, const int32_t _grid_size, const int32_t _margin_size,
                  buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer) {
   int32_t size = checkSize(*_gcf_buffer);
-  #define __I_CASE(siz) case siz: return kern_scatter_ ## siz (_scale, _grid_size, _margin_size, _vis_buffer, _gcf_buffer, _uvg_buffer);
+  switch( checkOver(*_gcf_buffer) ) {
+    case  4: __SIZES(kern_scatter_o4)  break;
+    case  8: __SIZES(kern_scatter)     break;
+    case 16: __SIZES(kern_scatter_o16) break;
+    case 32: __SIZES(kern_scatter_o32) break;
+  }
+  // Otherwise it might be a quadrant GCF (see gcf_halide.h)
+  switch( checkOverQ(*_gcf_buffer) ) {
+    case  4: __SIZES(kern_scatter_q_o4)  break;
+    case  8: __SIZES(kern_scatter_q)     break;
+    case 16: __SIZES(kern_scatter_q_o16) break;
+    case 32: __SIZES(kern_scatter_q_o32) break;
+  }
+  return -444;
+}
+
+// Single-precision visibilities and GCF, double-precision grid.
+// The f32 variants are only used by tools/bench/mixed_precision: the
+// pipeline data representations are double-only and no strategy
+// option selects them.
+int kern_scatter_f32(const double _scale, const int32_t _grid_size, const int32_t _margin_size,
+                     buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer) {
+  int32_t size = checkSize(*_gcf_buffer);
   switch( size ) {
-    __I_CASE( 8)
-    __I_CASE(16)
-    __I_CASE(32)
-    __I_CASE(64)
+    __I_CASE(kern_scatter_f32,  8)
+    __I_CASE(kern_scatter_f32, 16)
+    __I_CASE(kern_scatter_f32, 32)
+    __I_CASE(kern_scatter_f32, 64)
+  }
+  return -444;
+}
+
+// Single-precision visibilities, GCF and grid
+int kern_scatter_f32g(const double _scale, const int32_t _grid_size, const int32_t _margin_size,
+                      buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer) {
+  int32_t size = checkSize(*_gcf_buffer);
+  switch( size ) {
+    __I_CASE(kern_scatter_f32g,  8)
+    __I_CASE(kern_scatter_f32g, 16)
+    __I_CASE(kern_scatter_f32g, 32)
+    __I_CASE(kern_scatter_f32g, 64)
+  }
+  return -444;
+}
+
+// Full polarisation: Visibilities have four complex values (XX, XY,
+// YX, YY), which go to four interleaved grids in one pass.
+int kern_scatter_pol4(const double _scale, const int32_t _grid_size, const int32_t _margin_size,
+                      buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer) {
+  int32_t size = checkSize(*_gcf_buffer);
+  if (checkOver(*_gcf_buffer) == 8) {
+    __SIZES(kern_scatter_pol4)
+  }
+  return -444;
+}
+
+
+// Structure-of-arrays visibilities: One plane each for u, v, w, real
+// and imaginary part (see scatter.cpp).
+int kern_scatter_soa(const double _scale, const int32_t _grid_size, const int32_t _margin_size,
+                     buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer) {
+  int32_t size = checkSize(*_gcf_buffer);
+  if (checkOver(*_gcf_buffer) == 8) {
+    __SIZES(kern_scatter_soa)
+  }
+  return -444;
+}
+
+
+// Hermitian half-plane gridding: The grid buffer only covers v >= 0
+// (plus a GCF margin), see scatter.cpp.
+int kern_scatter_half(const double _scale, const int32_t _grid_size, const int32_t _margin_size,
+                      buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer) {
+  int32_t size = checkSize(*_gcf_buffer);
+  if (checkOver(*_gcf_buffer) == 8) {
+    __SIZES(kern_scatter_half)
+  }
+  return -444;
+}
+
+// PSF gridding: Visibilities are taken to be 1+0j, so only u/v get
+// read (see scatter.cpp).
+int kern_scatter_psf(const double _scale, const int32_t _grid_size, const int32_t _margin_size,
+                     buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer) {
+  int32_t size = checkSize(*_gcf_buffer);
+  if (checkOver(*_gcf_buffer) == 8) {
+    __SIZES(kern_scatter_psf)
+  }
+  if (checkOverQ(*_gcf_buffer) == 8) {
+    __SIZES(kern_scatter_q_psf)
+  }
+  return -444;
+}
+
+// Fused degridding and gridding of residuals (see scatter.cpp). Takes
+// the model grid in addition, and parameters in degridder order.
+#undef __DECL
+#undef __CALL
+#define __DECL(name) int name(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_gcf_buffer, buffer_t *_model_buffer, buffer_t *_vis_buffer, buffer_t *_uvg_buffer);
+#define __CALL(name) name(_scale, _grid_size, _margin_size, _gcf_buffer, _model_buffer, _vis_buffer, _uvg_buffer)
+__DECL_SIZES(kern_scatter_resid)
+__DECL_SIZES(kern_scatter_q_resid)
+
+int kern_scatter_resid(const double _scale, const int32_t _grid_size, const int32_t _margin_size,
+                       buffer_t *_gcf_buffer, buffer_t *_model_buffer, buffer_t *_vis_buffer,
+                       buffer_t *_uvg_buffer) {
+  int32_t size = checkSize(*_gcf_buffer);
+  if (checkOver(*_gcf_buffer) == 8) {
+    __SIZES(kern_scatter_resid)
+  }
+  if (checkOverQ(*_gcf_buffer) == 8) {
+    __SIZES(kern_scatter_q_resid)
+  }
+  return -444;
+}
+
+// Weighted PSF gridding: Same as above, but visibilities get the
+// weight of their grid cell (see weight_vis.cpp).
+#undef __DECL
+#undef __CALL
+#define __DECL(name) int name(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_weights_buffer, buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer);
+#define __CALL(name) name(_scale, _grid_size, _margin_size, _weights_buffer, _vis_buffer, _gcf_buffer, _uvg_buffer)
+__DECL_SIZES(kern_scatter_psfw)
+__DECL_SIZES(kern_scatter_q_psfw)
+
+int kern_scatter_psfw(const double _scale, const int32_t _grid_size, const int32_t _margin_size,
+                      buffer_t *_weights_buffer, buffer_t *_vis_buffer, buffer_t *_gcf_buffer,
+                      buffer_t *_uvg_buffer) {
+  int32_t size = checkSize(*_gcf_buffer);
+  if (checkOver(*_gcf_buffer) == 8) {
+    __SIZES(kern_scatter_psfw)
+  }
+  if (checkOverQ(*_gcf_buffer) == 8) {
+    __SIZES(kern_scatter_q_psfw)
+  }
+  return -444;
+}
+
+// Fused residual gridding, rotating visibilities on the fly (see
+// scatter.cpp). Takes the facet rotation parameters in addition.
+#undef __DECL
+#undef __CALL
+#define __DECL(name) int name(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_rot_buffer, buffer_t *_gcf_buffer, buffer_t *_model_buffer, buffer_t *_vis_buffer, buffer_t *_uvg_buffer);
+#define __CALL(name) name(_scale, _grid_size, _margin_size, _rot_buffer, _gcf_buffer, _model_buffer, _vis_buffer, _uvg_buffer)
+__DECL_SIZES(kern_scatter_resid_rot)
+__DECL_SIZES(kern_scatter_q_resid_rot)
+
+int kern_scatter_resid_rot(const double _scale, const int32_t _grid_size, const int32_t _margin_size,
+                           buffer_t *_rot_buffer, buffer_t *_gcf_buffer, buffer_t *_model_buffer,
+                           buffer_t *_vis_buffer, buffer_t *_uvg_buffer) {
+  int32_t size = checkSize(*_gcf_buffer);
+  if (checkOver(*_gcf_buffer) == 8) {
+    __SIZES(kern_scatter_resid_rot)
+  }
+  if (checkOverQ(*_gcf_buffer) == 8) {
+    __SIZES(kern_scatter_q_resid_rot)
   }
   return -444;
 }
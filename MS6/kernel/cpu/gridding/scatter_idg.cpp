@@ -0,0 +1,358 @@
+// Image-domain gridding (IDG, see van der Tol et al., "Image Domain
+// Gridding", A&A 616, A27). Instead of convolving every visibility
+// with a w-dependent GCF, we group visibilities that lie close
+// together in the uv-plane into small subgrids. Every subgrid gets
+// computed in the image domain, where the w-term is just a phase
+// factor per pixel, then FFT'd and added to the grid. This means we
+// only need the GCF for its size (which tells us how far the w-term
+// spreads a visibility in the uv-plane) and for its image-domain
+// taper, which we apply to every subgrid so the result matches
+// convolutional gridding.
+//
+// Subgrids are the margin size of the grid (the maximum GCF size)
+// plus "SUBGRID_SPREAD" cells, so even visibilities with the largest
+// GCF can share subgrids. Where subgrids reach outside the grid
+// buffer, we only add the part inside, which is all that visibilities
+// we do not drop (see below) contribute to. If a w-bin's visibilities
+// are too far apart to share subgrids, we fall back to convolutional
+// gridding ("kern_scatter"), as IDG would mostly pay for subgrid FFTs.
+//
+// Subgrids are independent, so we compute them in parallel, in
+// batches. Adding them to the grid then happens in parallel over
+// disjoint strips of grid rows, in subgrid order - so the result does
+// not depend on the number of threads.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fftw3.h>
+
+#include "gcf_common.h"
+#include "cpu_threads.h"
+
+typedef std::complex<double> complexd;
+
+// Visibility fields, see scatter.cpp
+enum VisFields { _U=0, _V, _W, _R, _I,  _VIS_FIELDS };
+
+extern "C"
+int kern_scatter(const double _scale, const int32_t _grid_size, const int32_t _margin_size,
+                 buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer);
+
+// Maximum number of visibilities per subgrid. Keeps the work per
+// subgrid bounded, which helps load balancing.
+const int32_t MAX_SUBGRID_VIS = 1024;
+
+// Fewest visibilities per subgrid (on average) for which we use IDG.
+// Every subgrid costs an FFT plus adding it to the grid, which is
+// about as much work as computing a few visibilities.
+const int32_t MIN_SUBGRID_VIS = 4;
+
+// Subgrid size beyond the maximum GCF size, in grid cells
+const int SUBGRID_SPREAD = 16;
+
+// Number of subgrid pixels the phasor recurrence steps at once. The
+// subgrid size is a multiple of this.
+const int LANES = 8;
+
+// Number of subgrids to compute per thread before adding them to the
+// grid.
+const int SUBGRIDS_PER_THREAD = 16;
+
+// Plans get created once per subgrid size and direction and kept
+// around, see "fftwPlannerMutex"
+static std::map<std::pair<int, int>, fftw_plan> plans;
+
+static fftw_plan getPlan(int size, int sign) {
+  std::lock_guard<std::mutex> lock(fftwPlannerMutex());
+  fftw_plan & p = plans[std::make_pair(size, sign)];
+  if (p == NULL) {
+    fftw_complex * a = reinterpret_cast<fftw_complex *>(fftw_malloc(sizeof(fftw_complex) * size * size));
+    p = fftw_plan_dft_2d(size, size, a, a, sign, FFTW_ESTIMATE);
+    fftw_free(a);
+  }
+  return p;
+}
+
+// Both the image-domain pixels and the subgrid cells are centred on
+// N/2. For even N, a centred transform is an uncentred one with both
+// input and output multiplied by (-1)^(p+q).
+static inline double centreSign(int p, int q) {
+  return (p + q) % 2 == 0 ? 1.0 : -1.0;
+}
+
+// Image-domain taper of the GCF: Amplitude of the inverse transform
+// of its layer for oversampling offset zero, sampled at the subgrid
+// pixels. Dropping the phase drops the w-term of the GCF, which we
+// apply per visibility instead. GCF layers are normalised to sum to
+// one, so the taper is one in the centre.
+static bool gcfTaper(int N, const buffer_t & gcfBuf, double * taper) {
+  const int32_t S = gcfBuf.extent[1];
+  complexd * t = reinterpret_cast<complexd *>(fftw_malloc(sizeof(complexd) * N * N));
+  if (t == NULL) return false;
+  std::fill(t, t + N * N, complexd(0, 0));
+  const double * gcf = reinterpret_cast<const double *>(gcfBuf.host);
+  const int32_t a0 = std::max(0, S / 2 - N / 2), a1 = std::min(S, S / 2 + N / 2);
+  for (int32_t b = a0; b < a1; b++)
+    for (int32_t a = a0; a < a1; a++) {
+      const double * g = gcf + int64_t(a) * gcfBuf.stride[1] + int64_t(b) * gcfBuf.stride[2];
+      const int p = a - S / 2 + N / 2, q = b - S / 2 + N / 2;
+      t[q * N + p] = centreSign(p, q) * complexd(g[0], g[gcfBuf.stride[0]]);
+    }
+  fftw_execute_dft(getPlan(N, FFTW_BACKWARD), reinterpret_cast<fftw_complex *>(t),
+                                              reinterpret_cast<fftw_complex *>(t));
+  for (int32_t pq = 0; pq < N * N; pq++) taper[pq] = std::abs(t[pq]);
+  fftw_free(t);
+  return true;
+}
+
+// A subgrid: Top-left grid position, plus the range of visibilities
+// (in "order") that go into it.
+struct Subgrid {
+  int32_t x0, y0;
+  int32_t first, count;
+};
+
+// Compute a subgrid. Visibility coordinates are relative to the
+// subgrid centre, in grid cells. Pixel (p, q) of the image-domain
+// subgrid then is
+//
+//   T(p, q) sum_i V_i exp(2 pi i (du_i (p - N/2) / N + dv_i (q - N/2) / N + w_i n(p, q)))
+//
+// with T the GCF taper, which the FFT turns into the uv-plane
+// contribution, interpolated to integer grid positions.
+//
+// All visibilities of the call come from the same w-bin, so we split
+// w_i into the w-bin's "w0", whose w-term is exact and part of
+// "taper", and the small rest "dw_i". For that we use n(p, q) ~
+// -(l^2 + m^2) / 2, which makes the phase a quadratic function of p
+// and q. So we can step from pixel to pixel by complex
+// multiplication rather than evaluating sine and cosine: Rows by one
+// pixel, and within a row "LANES" independent pixels at a time, which
+// the compiler can vectorise. "taper" also has the centring sign and
+// FFT normalisation folded in.
+static void computeSubgrid(int N, double lscale, const complexd * taper,
+                           const double * du, const double * dv, const double * dw,
+                           const double * re, const double * im, int32_t count,
+                           double * pixRe, double * pixIm, complexd * out,
+                           fftw_plan plan) {
+
+  const int32_t pixels = N * N;
+  const int half = N / 2;
+  std::fill(pixRe, pixRe + pixels, 0.0);
+  std::fill(pixIm, pixIm + pixels, 0.0);
+  for (int32_t i = 0; i < count; i++) {
+
+    // Phase at (p, q), relative to the centre: a p + b q + c (p^2 + q^2)
+    const double a = 2 * M_PI * du[i] / N, b = 2 * M_PI * dv[i] / N,
+                 c = -M_PI * dw[i] * lscale * lscale;
+
+    // Phasors of the first LANES pixels of a row (without the row's
+    // own phase), and the steps to the next LANES pixels. Steps change
+    // by the same factor for all lanes.
+    double baseRe[LANES], baseIm[LANES], step0Re[LANES], step0Im[LANES];
+    for (int j = 0; j < LANES; j++) {
+      const double p = j - half;
+      const complexd bs = std::polar(1.0, a * p + c * p * p);
+      const complexd st = std::polar(1.0, a * LANES + c * LANES * (2 * p + LANES));
+      baseRe[j] = bs.real(); baseIm[j] = bs.imag();
+      step0Re[j] = st.real(); step0Im[j] = st.imag();
+    }
+    const complexd rot = std::polar(1.0, 2 * c * LANES * LANES);
+    const double rotRe = rot.real(), rotIm = rot.imag();
+
+    // Row phase (times the visibility), stepped the same way
+    complexd row = complexd(re[i], im[i]) * std::polar(1.0, -b * half + c * half * half);
+    complexd rowStep = std::polar(1.0, b + c * (1 - 2 * half));
+    const complexd rowRot = std::polar(1.0, 2 * c);
+
+    for (int q = 0; q < N; q++) {
+      double phRe[LANES], phIm[LANES], stRe[LANES], stIm[LANES];
+      for (int j = 0; j < LANES; j++) {
+        phRe[j] = baseRe[j] * row.real() - baseIm[j] * row.imag();
+        phIm[j] = baseRe[j] * row.imag() + baseIm[j] * row.real();
+        stRe[j] = step0Re[j]; stIm[j] = step0Im[j];
+      }
+      double * pr = pixRe + q * N, * pi = pixIm + q * N;
+      for (int k = 0; k < N; k += LANES) {
+        for (int j = 0; j < LANES; j++) {
+          pr[k + j] += phRe[j];
+          pi[k + j] += phIm[j];
+          const double r = phRe[j] * stRe[j] - phIm[j] * stIm[j];
+          phIm[j] = phRe[j] * stIm[j] + phIm[j] * stRe[j];
+          phRe[j] = r;
+          const double sr = stRe[j] * rotRe - stIm[j] * rotIm;
+          stIm[j] = stRe[j] * rotIm + stIm[j] * rotRe;
+          stRe[j] = sr;
+        }
+      }
+      row *= rowStep;
+      rowStep *= rowRot;
+    }
+  }
+
+  // Taper and transform
+  for (int32_t pq = 0; pq < pixels; pq++) out[pq] = taper[pq] * complexd(pixRe[pq], pixIm[pq]);
+  fftw_execute_dft(plan, reinterpret_cast<fftw_complex *>(out),
+                         reinterpret_cast<fftw_complex *>(out));
+  for (int q = 0; q < N; q++)
+    for (int p = 0; p < N; p++)
+      out[q * N + p] *= centreSign(p, q);
+}
+
+extern "C"
+int kern_scatter_idg(const double _scale, const int32_t _grid_size, const int32_t _margin_size,
+                     buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer) {
+
+  const int32_t nvis = _vis_buffer->extent[1];
+  if (nvis == 0) return 0;
+  if (_vis_buffer->stride[0] != 1 || _uvg_buffer->stride[0] != 1 ||
+      _uvg_buffer->extent[0] != 2)
+    return -444;
+
+  // Subgrid size, and how far apart visibilities sharing a subgrid
+  // can be so that all of their GCF support fits. Rounding the
+  // positions of visibilities and the subgrid costs us up to a cell.
+  const int32_t support = checkSize(*_gcf_buffer);
+  if (_margin_size < 1 || support < 0) return -444;
+  const int N = (_margin_size + SUBGRID_SPREAD + LANES - 1) / LANES * LANES;
+  const double maxSpread = N - support - 2;
+
+  const int32_t
+      umin = _uvg_buffer->min[1], uext = _uvg_buffer->extent[1]
+    , vmin = _uvg_buffer->min[2], vext = _uvg_buffer->extent[2]
+    ;
+  const double * vis = reinterpret_cast<const double *>(_vis_buffer->host);
+  double * uvg = reinterpret_cast<double *>(_uvg_buffer->host);
+  auto visRec = [=](int32_t i) { return vis + int64_t(i) * _vis_buffer->stride[1]; };
+
+  // Group visibilities into subgrids, in order. A visibility joins
+  // the current subgrid as long as the subgrid's visibilities stay
+  // within "maxSpread" cells of each other. Just like the Halide
+  // gridder, we drop visibilities that are closer than half the margin
+  // size to the edge of the grid buffer.
+  const int32_t M = _margin_size;
+  std::vector<int32_t> order;
+  std::vector<Subgrid> subgrids;
+  double ulo = 0, uhi = 0, vlo = 0, vhi = 0;
+  auto closeSubgrid = [&]() {
+    Subgrid & sg = subgrids.back();
+    sg.x0 = int32_t(std::floor((ulo + uhi) / 2 + 0.5)) - N / 2;
+    sg.y0 = int32_t(std::floor((vlo + vhi) / 2 + 0.5)) - N / 2;
+  };
+  for (int32_t i = 0; i < nvis; i++) {
+    const double * v = visRec(i);
+    double x = v[_U] * _scale + _grid_size / 2, y = v[_V] * _scale + _grid_size / 2;
+    if (!std::isfinite(x) || !std::isfinite(y)) continue;
+    int32_t cx = int32_t(std::floor(x + 0.5)), cy = int32_t(std::floor(y + 0.5));
+    if (cx - M / 2 < umin || cx + M / 2 > umin + uext ||
+        cy - M / 2 < vmin || cy + M / 2 > vmin + vext)
+      continue;
+
+    if (!subgrids.empty() && subgrids.back().count < MAX_SUBGRID_VIS &&
+        std::max(uhi, x) - std::min(ulo, x) <= maxSpread &&
+        std::max(vhi, y) - std::min(vlo, y) <= maxSpread) {
+      ulo = std::min(ulo, x); uhi = std::max(uhi, x);
+      vlo = std::min(vlo, y); vhi = std::max(vhi, y);
+      subgrids.back().count++;
+    } else {
+      if (!subgrids.empty()) closeSubgrid();
+      subgrids.push_back(Subgrid{0, 0, int32_t(order.size()), 1});
+      ulo = uhi = x; vlo = vhi = y;
+    }
+    order.push_back(i);
+  }
+  if (subgrids.empty()) return 0;
+  closeSubgrid();
+  if (int64_t(order.size()) < int64_t(MIN_SUBGRID_VIS) * int64_t(subgrids.size()))
+    return kern_scatter(_scale, _grid_size, _margin_size, _vis_buffer, _gcf_buffer, _uvg_buffer);
+
+  // Taper, including the w-term for the centre of the w-range (see
+  // computeSubgrid). The subgrid covers the whole field of view at
+  // coarse resolution.
+  double wlo = visRec(order[0])[_W], whi = wlo;
+  for (int32_t i : order) {
+    wlo = std::min(wlo, visRec(i)[_W]);
+    whi = std::max(whi, visRec(i)[_W]);
+  }
+  const double w0 = (wlo + whi) / 2;
+  std::vector<double> amp(N * N);
+  if (!gcfTaper(N, *_gcf_buffer, amp.data())) return -444;
+  std::vector<complexd> taper(N * N);
+  for (int q = 0; q < N; q++)
+    for (int p = 0; p < N; p++) {
+      double l = double(p - N / 2) * _scale / N, m = double(q - N / 2) * _scale / N;
+      double r2 = l * l + m * m;
+      double n = r2 < 1 ? std::sqrt(1 - r2) - 1 : -1;
+      taper[q * N + p] = amp[q * N + p] * centreSign(p, q) / double(N * N)
+                       * std::polar(1.0, 2 * M_PI * w0 * n);
+    }
+
+  // Work through subgrids in batches
+  const fftw_plan plan = getPlan(N, FFTW_FORWARD);
+  const int nthreads = numThreads();
+  const int32_t batch = nthreads * SUBGRIDS_PER_THREAD, nsub = int32_t(subgrids.size());
+  complexd * outs = reinterpret_cast<complexd *>(fftw_malloc(sizeof(complexd) * N * N * batch));
+  if (outs == NULL) return -444;
+  auto runThreads = [&](std::function<void(int)> f) {
+    if (nthreads == 1) { f(0); return; }
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nthreads; t++) threads.push_back(std::thread(f, t));
+    for (std::thread & t : threads) t.join();
+  };
+  for (int32_t b0 = 0; b0 < nsub; b0 += batch) {
+    const int32_t b1 = std::min(nsub, b0 + batch);
+
+    // Compute subgrids
+    std::atomic<int32_t> next(b0);
+    runThreads([&](int) {
+      std::vector<double> du, dv, dw, re, im, pixRe(N * N), pixIm(N * N);
+      int32_t s;
+      while ((s = next++) < b1) {
+        const Subgrid & sg = subgrids[s];
+        du.resize(sg.count); dv.resize(sg.count); dw.resize(sg.count);
+        re.resize(sg.count); im.resize(sg.count);
+        for (int32_t j = 0; j < sg.count; j++) {
+          const double * v = visRec(order[sg.first + j]);
+          du[j] = v[_U] * _scale + _grid_size / 2 - (sg.x0 + N / 2);
+          dv[j] = v[_V] * _scale + _grid_size / 2 - (sg.y0 + N / 2);
+          dw[j] = v[_W] - w0; re[j] = v[_R]; im[j] = v[_I];
+        }
+        computeSubgrid(N, _scale / N, taper.data(), du.data(), dv.data(), dw.data(),
+                       re.data(), im.data(), sg.count,
+                       pixRe.data(), pixIm.data(), outs + int64_t(s - b0) * N * N, plan);
+      }
+    });
+
+    // Add to grid. Every thread owns a strip of rows. Subgrids can
+    // reach outside the grid buffer, we only add what is inside.
+    runThreads([&](int t) {
+      const int32_t r0 = vmin + int32_t(int64_t(vext) * t / nthreads),
+                    r1 = vmin + int32_t(int64_t(vext) * (t + 1) / nthreads);
+      for (int32_t s = b0; s < b1; s++) {
+        const Subgrid & sg = subgrids[s];
+        const complexd * out = outs + int64_t(s - b0) * N * N;
+        const int p0 = std::max(0, umin - sg.x0), p1 = std::min(N, umin + uext - sg.x0);
+        for (int32_t y = std::max(r0, sg.y0); y < std::min(r1, sg.y0 + N); y++) {
+          double * row = uvg + int64_t(y - vmin) * _uvg_buffer->stride[2]
+                             + int64_t(sg.x0 - umin) * _uvg_buffer->stride[1];
+          const complexd * src = out + (y - sg.y0) * N;
+          for (int p = p0; p < p1; p++) {
+            row[p * _uvg_buffer->stride[1] + 0] += src[p].real();
+            row[p * _uvg_buffer->stride[1] + 1] += src[p].imag();
+          }
+        }
+      }
+    });
+  }
+  fftw_free(outs);
+  return 0;
+}
@@ -0,0 +1,94 @@
+// Multi-frequency synthesis gridder driver (see "mfs" in scatter.cpp).
+// Takes the frequency of every channel, so channels do not need to be
+// evenly spaced.
+//
+// The kernel would silently skip channels that fall off the grid, and
+// use the last w-plane of the GCF stack for channels with larger w.
+// Neither is what anybody wants, and binning in wavelengths for a
+// single channel (as our binners do) easily leads to it, so we check
+// all channels up-front and reject the input instead.
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+#include "gcf_common.h"
+
+// Same as in OskarBinReader.h
+#define SPEED_OF_LIGHT 299792458.0
+
+extern "C" {
+#define __DECL(name) int name(const double _scale, const int32_t _grid_size, const int32_t _margin_size, const double _w_step, buffer_t *_inv_lambdas_buffer, buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer);
+__DECL(kern_scatter_mfs_8)
+__DECL(kern_scatter_mfs_16)
+__DECL(kern_scatter_mfs_32)
+__DECL(kern_scatter_mfs_64)
+__DECL(kern_scatter_mfs_dyn)
+
+#define __CALL(name) name(_scale, _grid_size, _margin_size, _w_step, &inv_lambdas_buffer, _vis_buffer, _gcf_buffer, _uvg_buffer)
+#define __I_CASE(pre, siz) case siz: return __CALL(pre ## _ ## siz);
+
+// Visibility records must have UVW in metres, followed by a complex
+// value for every channel. "_freqs_buffer" has the frequency of every
+// channel (in Hz). The GCF is a stack of w-planes for over 8, plane p
+// being for |w| = p * _w_step (in wavelengths).
+int kern_scatter_mfs(const double _scale, const int32_t _grid_size, const int32_t _margin_size,
+                     const double _w_step, buffer_t *_freqs_buffer,
+                     buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer) {
+  const int32_t size = checkSize(*_gcf_buffer);
+  const int32_t nchan = _freqs_buffer->extent[0];
+  const int32_t layers = 8 * 8;
+  const int32_t nplanes = _gcf_buffer->extent[3] / layers;
+  if ( size <= 0 || nchan <= 0 || _vis_buffer->extent[0] != 3 + 2 * nchan
+    || _vis_buffer->stride[0] != 1
+    || nplanes <= 0 || _gcf_buffer->extent[3] != nplanes * layers
+    || (_w_step <= 0 && nplanes > 1)
+     )
+    return -444;
+
+  std::vector<double> inv_lambdas(nchan);
+  const double *freqs = reinterpret_cast<const double *>(_freqs_buffer->host);
+  for (int32_t c = 0; c < nchan; c++)
+    inv_lambdas[c] = freqs[c * _freqs_buffer->stride[0]] / SPEED_OF_LIGHT;
+
+  // Check channels against grid limits and w-planes, calculating
+  // positions exactly like the kernel does.
+  const int32_t gcf_margin = std::max(0, (_margin_size - size) / 2);
+  const int32_t
+      min_u = _uvg_buffer->min[1] + gcf_margin
+    , max_u = _uvg_buffer->min[1] + _uvg_buffer->extent[1] - size - 1 - gcf_margin
+    , min_v = _uvg_buffer->min[2] + gcf_margin
+    , max_v = _uvg_buffer->min[2] + _uvg_buffer->extent[2] - size - 1 - gcf_margin
+    ;
+  const double *vis = reinterpret_cast<const double *>(_vis_buffer->host);
+  for (int32_t t = 0; t < _vis_buffer->extent[1]; t++) {
+    const double *rec = vis + size_t(t) * _vis_buffer->stride[1];
+    for (int32_t c = 0; c < nchan; c++) {
+      int32_t u = int32_t(nearbyint(rec[0] * inv_lambdas[c] * _scale)) + _grid_size / 2 - size / 2;
+      int32_t v = int32_t(nearbyint(rec[1] * inv_lambdas[c] * _scale)) + _grid_size / 2 - size / 2;
+      if (u < min_u || u > max_u || v < min_v || v > max_v)
+        return -444;
+      if (nplanes > 1 && nearbyint(fabs(rec[2] * inv_lambdas[c]) / _w_step) >= nplanes)
+        return -444;
+    }
+  }
+
+  buffer_t inv_lambdas_buffer;
+  memset(&inv_lambdas_buffer, 0, sizeof(inv_lambdas_buffer));
+  inv_lambdas_buffer.host = reinterpret_cast<uint8_t *>(inv_lambdas.data());
+  inv_lambdas_buffer.extent[0] = nchan;
+  inv_lambdas_buffer.stride[0] = 1;
+  inv_lambdas_buffer.elem_size = sizeof(double);
+
+  switch( size ) {
+    __I_CASE(kern_scatter_mfs,  8)
+    __I_CASE(kern_scatter_mfs, 16)
+    __I_CASE(kern_scatter_mfs, 32)
+    __I_CASE(kern_scatter_mfs, 64)
+  }
+  // Other sizes go to the slower generic kernel
+  return __CALL(kern_scatter_mfs_dyn);
+}
+
+}
@@ -0,0 +1,192 @@
+// Parallel driver for the CPU scatter gridder.
+//
+// The Halide gridder (see scatter.cpp) updates the grid in an order
+// that cannot be parallelised without introducing races. What we do
+// here instead is to split the rows of the output grid into strips
+// and give every thread exclusive ownership of the strips it works
+// on. Each visibility gets routed to all strips its GCF overlaps,
+// then the "kern_scatter_strip_<N>" kernel grids it, skipping all
+// rows outside of the strip.
+//
+// As every grid cell still receives its contributions in exactly the
+// same order as with "kern_scatter_<N>", the result is bit-for-bit
+// identical to the sequential kernel.
+//
+// Strip kernels only exist for an oversampling factor of 8.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "gcf_common.h"
+#include "cpu_threads.h"
+
+extern "C" {
+#define __DECL(name) int name(const double _scale, const int32_t _grid_size, const int32_t _margin_size, const int32_t _strip_min, const int32_t _strip_max, buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer);
+#define __DECL_SIZES(pre) __DECL(pre ## _8) __DECL(pre ## _16) __DECL(pre ## _32) __DECL(pre ## _64) __DECL(pre ## _dyn)
+__DECL_SIZES(kern_scatter_strip)
+__DECL_SIZES(kern_scatter_strip_q)
+}
+
+typedef int (*stripKernel)(const double, const int32_t, const int32_t, const int32_t, const int32_t, buffer_t *, buffer_t *, buffer_t *);
+
+// Visibility fields, see scatter.cpp
+const int _VIS_FIELDS = 5;
+const int _V = 1;
+
+// Number of strips per thread. Having more than one gives us some
+// room for load balancing when the work estimate is off.
+const int STRIPS_PER_THREAD = 4;
+
+static buffer_t mkVisBuffer(double * data, int32_t count) {
+  buffer_t buf;
+  memset(&buf, 0, sizeof(buf));
+  buf.host = reinterpret_cast<uint8_t *>(data);
+  buf.extent[0] = _VIS_FIELDS; buf.stride[0] = 1;
+  buf.extent[1] = count;       buf.stride[1] = _VIS_FIELDS;
+  buf.elem_size = sizeof(double);
+  return buf;
+}
+
+static int scatterPar(
+    stripKernel kern
+  , int gcf_size
+  , double scale
+  , int32_t grid_size
+  , int32_t margin_size
+  , buffer_t *vis
+  , buffer_t *gcf
+  , buffer_t *uvg
+  ) {
+
+  const int32_t
+      vmin = uvg->min[2]
+    , vext = uvg->extent[2]
+    , nvis = vis->extent[1]
+    ;
+  const double * visp = reinterpret_cast<const double *>(vis->host);
+  auto visRec = [=](int32_t i) { return visp + int64_t(i) * vis->stride[1]; };
+
+  // Determine the range of grid rows every visibility might touch,
+  // relative to the start of the grid buffer. This only needs to be
+  // conservative: the strip kernel makes the final decision about
+  // which rows get updated, so we add a row of slack on both ends.
+  std::vector<int32_t> rowLo(nvis), rowHi(nvis);
+  for (int32_t i = 0; i < nvis; i++) {
+    double vs = visRec(i)[_V] * scale;
+    if (!std::isfinite(vs)) { rowLo[i] = rowHi[i] = 0; continue; }
+    double row = std::nearbyint(vs) + (grid_size / 2 - gcf_size / 2) - vmin;
+    row = std::max(double(-gcf_size - 1), std::min(double(vext), row));
+    rowLo[i] = std::max(0, int32_t(row) - 1);
+    rowHi[i] = std::min(vext, int32_t(row) + gcf_size + 1);
+  }
+
+  // Estimate work per row, then cut the grid into strips of roughly
+  // equal work.
+  const int nthreads = numThreads();
+  const int nstrips = std::max(1, std::min(vext, nthreads * STRIPS_PER_THREAD));
+  std::vector<int64_t> load(vext + 1, 0);
+  for (int32_t i = 0; i < nvis; i++) {
+    if (rowLo[i] >= rowHi[i]) continue;
+    load[rowLo[i]]++;
+    load[rowHi[i]]--;
+  }
+  int64_t total = 0, running = 0;
+  for (int32_t r = 0; r < vext; r++) {
+    running += load[r];
+    load[r] = running;
+    total += running;
+  }
+  std::vector<int32_t> stripStart(nstrips + 1, vext), stripOf(vext);
+  stripStart[0] = 0;
+  int64_t acc = 0;
+  for (int32_t r = 0, s = 1; r < vext; r++) {
+    stripOf[r] = s - 1;
+    acc += load[r];
+    while (s < nstrips && acc * nstrips >= total * s) {
+      stripStart[s++] = r + 1;
+    }
+  }
+
+  // Route visibilities to strips. We keep visibilities in their
+  // original order, which is what makes the result deterministic.
+  std::vector<int32_t> bucketOff(nstrips + 1, 0);
+  for (int32_t i = 0; i < nvis; i++) {
+    if (rowLo[i] >= rowHi[i]) continue;
+    for (int s = stripOf[rowLo[i]]; s < nstrips && stripStart[s] < rowHi[i]; s++)
+      bucketOff[s + 1]++;
+  }
+  for (int s = 0; s < nstrips; s++) bucketOff[s + 1] += bucketOff[s];
+  std::vector<int32_t> bucket(bucketOff[nstrips]), fill(bucketOff.begin(), bucketOff.end() - 1);
+  for (int32_t i = 0; i < nvis; i++) {
+    if (rowLo[i] >= rowHi[i]) continue;
+    for (int s = stripOf[rowLo[i]]; s < nstrips && stripStart[s] < rowHi[i]; s++)
+      bucket[fill[s]++] = i;
+  }
+
+  // Grid strips. Every thread gets its own copy of the buffer
+  // descriptors, as Halide might update them.
+  std::atomic<int> nextStrip(0);
+  std::vector<int> results(nthreads, 0);
+  auto worker = [&](int tno) {
+    buffer_t gcfT = *gcf, uvgT = *uvg;
+    std::vector<double> gathered;
+    int s;
+    while ((s = nextStrip++) < nstrips) {
+      int32_t b0 = bucketOff[s], b1 = bucketOff[s + 1];
+      if (b0 == b1) continue;
+      gathered.resize(size_t(b1 - b0) * _VIS_FIELDS);
+      double * dst = gathered.data();
+      for (int32_t b = b0; b < b1; b++, dst += _VIS_FIELDS)
+        std::copy(visRec(bucket[b]), visRec(bucket[b]) + _VIS_FIELDS, dst);
+      buffer_t stripVis = mkVisBuffer(gathered.data(), b1 - b0);
+      int res = kern(scale, grid_size, margin_size,
+                     vmin + stripStart[s], vmin + stripStart[s + 1],
+                     &stripVis, &gcfT, &uvgT);
+      if (res != 0) { results[tno] = res; return; }
+    }
+  };
+  if (nthreads == 1) {
+    worker(0);
+  } else {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nthreads; t++) threads.push_back(std::thread(worker, t));
+    for (std::thread & t : threads) t.join();
+  }
+
+  for (int res : results) if (res != 0) return res;
+  return 0;
+}
+
+extern "C" {
+
+#define __CALL(name, siz) scatterPar(name, siz, _scale, _grid_size, _margin_size, _vis_buffer, _gcf_buffer, _uvg_buffer)
+#define __I_CASE(pre, siz) case siz: return __CALL(pre ## _ ## siz, siz);
+// Other sizes go to the slower generic kernel
+#define __SIZES(pre)   \
+  switch( size ) {     \
+    __I_CASE(pre,  8)  \
+    __I_CASE(pre, 16)  \
+    __I_CASE(pre, 32)  \
+    __I_CASE(pre, 64)  \
+  }                    \
+  if (size > 0) return __CALL(pre ## _dyn, size);
+
+int kern_scatter_par(const double _scale, const int32_t _grid_size, const int32_t _margin_size,
+                     buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer) {
+  int32_t size = checkSize(*_gcf_buffer);
+  if (checkOver(*_gcf_buffer) == 8) {
+    __SIZES(kern_scatter_strip)
+  }
+  // Otherwise it might be a quadrant GCF (see gcf_halide.h)
+  if (checkOverQ(*_gcf_buffer) == 8) {
+    __SIZES(kern_scatter_strip_q)
+  }
+  return -444;
+}
+
+}
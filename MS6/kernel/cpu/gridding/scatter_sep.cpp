@@ -0,0 +1,110 @@
+// Separable gridder. For small w the GCF is (close to) just the
+// anti-aliasing function, which is separable: every GCF value is the
+// product of a factor depending on u and one depending on v. In that
+// case there is no need to load the full OxOxSxS table: we extract
+// the two 1D factors and have "kern_scatter_sep_<N>" take their
+// products on the fly.
+//
+// Whether a GCF is separable gets decided for every w-bin anew.
+// Otherwise we fall back to the standard gridder. We also do that for
+// oversampling factors other than 8, as we only generate separable
+// kernels for that one.
+
+#include <algorithm>
+#include <complex>
+#include <cstring>
+#include <vector>
+
+#include "gcf_common.h"
+
+extern "C" {
+#define __DECL(name) int name(const double _scale, const int32_t _grid_size, const int32_t _margin_size, buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer);
+#define __DECL_SIZES(pre) __DECL(pre ## _8) __DECL(pre ## _16) __DECL(pre ## _32) __DECL(pre ## _64) __DECL(pre ## _dyn)
+__DECL_SIZES(kern_scatter_sep)
+__DECL(kern_scatter)
+}
+
+typedef std::complex<double> complexd;
+
+// Maximum deviation from the original GCF we accept, relative to its
+// largest value.
+const double SEP_TOLERANCE = 1e-6;
+
+// Attempts to factor the GCF. The centre of the GCF is at tap S/2
+// with oversampling offset 0, so we can use the GCF's centre column
+// and row as factors, after dividing one of them by the centre value.
+// Returns whether the factors reproduce the whole GCF.
+static bool separate(const buffer_t & gcf, int32_t size, int32_t over,
+                     complexd * fu,   // [over][size]
+                     complexd * fv) { // [over][size]
+
+  const double * p = reinterpret_cast<const double *>(gcf.host);
+  auto at = [&](int32_t su, int32_t sv, int32_t ou, int32_t ov) {
+    const double * e = p + su * gcf.stride[1] + sv * gcf.stride[2] + (ou + over * ov) * gcf.stride[3];
+    return complexd(e[0], e[gcf.stride[0]]);
+  };
+
+  const int32_t c = size / 2;
+  const complexd centre = at(c, c, 0, 0);
+  if (centre == 0.0) return false;
+  for (int32_t o = 0; o < over; o++) {
+    for (int32_t s = 0; s < size; s++) {
+      fu[o * size + s] = at(s, c, o, 0) / centre;
+      fv[o * size + s] = at(c, s, 0, o);
+    }
+  }
+
+  double maxAbs = 0;
+  for (int32_t ov = 0; ov < over; ov++)
+    for (int32_t ou = 0; ou < over; ou++)
+      for (int32_t sv = 0; sv < size; sv++)
+        for (int32_t su = 0; su < size; su++)
+          maxAbs = std::max(maxAbs, std::abs(at(su, sv, ou, ov)));
+  for (int32_t ov = 0; ov < over; ov++)
+    for (int32_t ou = 0; ou < over; ou++)
+      for (int32_t sv = 0; sv < size; sv++)
+        for (int32_t su = 0; su < size; su++)
+          if (std::abs(fu[ou * size + su] * fv[ov * size + sv] - at(su, sv, ou, ov))
+              > SEP_TOLERANCE * maxAbs)
+            return false;
+  return true;
+}
+
+extern "C" {
+
+#define __CALL(name) name(_scale, _grid_size, _margin_size, _vis_buffer, &sep_buffer, _uvg_buffer)
+#define __I_CASE(pre, siz) case siz: return __CALL(pre ## _ ## siz);
+// Other sizes go to the slower generic kernel
+#define __SIZES(pre)   \
+  switch( size ) {     \
+    __I_CASE(pre,  8)  \
+    __I_CASE(pre, 16)  \
+    __I_CASE(pre, 32)  \
+    __I_CASE(pre, 64)  \
+  }                    \
+  if (size > 0) return __CALL(pre ## _dyn);
+
+int kern_scatter_sep(const double _scale, const int32_t _grid_size, const int32_t _margin_size,
+                     buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer) {
+  int32_t size = checkSize(*_gcf_buffer);
+  int32_t over = checkOver(*_gcf_buffer);
+  std::vector<complexd> factors(2 * std::max(0, over * size));
+  if (size <= 0 || over != 8 ||
+      !separate(*_gcf_buffer, size, over, factors.data(), factors.data() + over * size)) {
+    return kern_scatter(_scale, _grid_size, _margin_size, _vis_buffer, _gcf_buffer, _uvg_buffer);
+  }
+
+  buffer_t sep_buffer;
+  memset(&sep_buffer, 0, sizeof(sep_buffer));
+  sep_buffer.host = reinterpret_cast<uint8_t *>(factors.data());
+  sep_buffer.extent[0] = 2;    sep_buffer.stride[0] = 1;
+  sep_buffer.extent[1] = size; sep_buffer.stride[1] = 2;
+  sep_buffer.extent[2] = over; sep_buffer.stride[2] = 2 * size;
+  sep_buffer.extent[3] = 2;    sep_buffer.stride[3] = 2 * size * over;
+  sep_buffer.elem_size = sizeof(double);
+
+  __SIZES(kern_scatter_sep)
+  return kern_scatter(_scale, _grid_size, _margin_size, _vis_buffer, _gcf_buffer, _uvg_buffer);
+}
+
+}
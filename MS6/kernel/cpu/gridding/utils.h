@@ -157,4 +157,24 @@ inline Matrix uvw2xyz(Expr lon, Expr lat) {
   return rotateZ((pi()/2)+lon)*rotateX(cast<double>(pi()/2)-lat);
 }
 
+// Rotate visibility "t" on the fly. "rotp" holds the parameters as
+// calculated by "kern_rotate_params" (see rotate.cpp): the UVW
+// reprojection matrix, followed by the position change vector. Field
+// "f" is as for the visibility layout used by our kernels (u, v, w,
+// real, imaginary), and the result is the same as what "kern_rotate"
+// would have written for it.
+inline Expr rotateVisField(ImageParam rotp, Func vis, Expr f, Expr t) {
+  Matrix mtx(rotp(_A11), rotp(_A12), rotp(_A13),
+             rotp(_A21), rotp(_A22), rotp(_A23),
+             rotp(_A31), rotp(_A32), rotp(_A33));
+  Vector3 posChange(rotp(_MATRIX_FIELDS + _A1),
+                    rotp(_MATRIX_FIELDS + _A2),
+                    rotp(_MATRIX_FIELDS + _A3));
+  Vector3 uvw(cast<double>(vis(0, t)), cast<double>(vis(1, t)), cast<double>(vis(2, t)));
+  Vector3 newUvw = mtx * uvw;
+  Complex newVis = polar(cast<double>(1), 2*pi()*(posChange * uvw)) *
+                   Complex(cast<double>(vis(3, t)), cast<double>(vis(4, t)));
+  return select(f < 3, newUvw.unpack(f), newVis.unpack(f - 3));
+}
+
 #endif // HALIDE_UTILS_H
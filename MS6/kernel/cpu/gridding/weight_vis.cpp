@@ -0,0 +1,58 @@
+#include "Halide.h"
+#include "utils.h"
+using namespace Halide;
+
+// Applies a weight grid (see weights.cpp) to visibilities: Every
+// visibility gets multiplied by the weight of the grid cell it falls
+// into. The grid cell is calculated the same way as in scatter.cpp.
+// Visibilities outside of the grid get weight zero.
+int main(int argc, char **argv) {
+  if (argc < 2) return 1;
+
+  // ** Input
+
+  Param<double> scale("scale");
+
+  ImageParam weights(type_of<double>(), 2, "weights");
+  weights.set_min(0,0).set_stride(0,1).set_min(1,0);
+
+  // Visibilities: Array of 5-pairs, packed together with UVW
+  enum VisFields { _U=0, _V, _W, _R, _I,  _VIS_FIELDS };
+  ImageParam vis(type_of<double>(), 2, "vis");
+  vis.set_min(0,0).set_stride(0,1).set_extent(0,_VIS_FIELDS)
+     .set_stride(1,_VIS_FIELDS);
+
+  std::vector<Halide::Argument> args = { scale, weights, vis };
+
+  // ** Definition
+
+  // Weight per visibility
+  Func weight("weight"); Var t("t");
+  Expr x = cast<int>(round(vis(_U, t) * scale)) + weights.width() / 2;
+  Expr y = cast<int>(round(vis(_V, t) * scale)) + weights.height() / 2;
+  Expr inBound = x >= 0 && x < weights.width() && y >= 0 && y < weights.height();
+  weight(t) = select(inBound,
+                     weights(clamp(x, 0, weights.width()-1), clamp(y, 0, weights.height()-1)),
+                     cast<double>(0.0f));
+
+  Func weightVis("weightVis"); Var uvdim("uvdim");
+  weightVis(uvdim, t) = select(uvdim == _R || uvdim == _I, weight(t) * vis(uvdim, t),
+                               vis(uvdim, t));
+
+  // ** Strategy
+
+  weightVis.output_buffer()
+     .set_min(0,0).set_stride(0,1).set_extent(0,_VIS_FIELDS)
+     .set_stride(1,_VIS_FIELDS);
+  weightVis.bound(uvdim, 0, _VIS_FIELDS).unroll(uvdim);
+
+  // Look up weights in vectors, in parallel for blocks of visibilities
+  Var to("to"), ti("ti");
+  weightVis.split(t, to, ti, 1024).parallel(to);
+  weight.compute_at(weightVis, to).vectorize(t, 4);
+
+  Target target(get_target_from_environment().os, Target::X86, 64, { Target::SSE41, Target::AVX});
+  Module mod = weightVis.compile_to_module(args, "kern_weight_vis", target);
+  compile_module_to_object(mod, argv[1]);
+  return 0;
+}
@@ -0,0 +1,114 @@
+// Visibility weighting. Calculates a weight for every cell of the uv
+// grid, which "kern_weight_vis" (see weight_vis.cpp) then applies to
+// the visibilities falling into the cell before gridding:
+//
+//  * Natural: every visibility has weight 1 (nothing to do)
+//  * Uniform: 1 / D, where D is the number of visibilities in the cell
+//  * Briggs:  1 / (1 + D * f^2), with f^2 = (5 * 10^-R)^2 / (sum D^2 / sum D)
+//
+// We first count visibilities per cell into a density grid, using
+// the same coordinate calculation as the gridder (see scatter.cpp).
+// Threads own disjoint strips of grid rows, so no thread needs a
+// grid of its own.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "halide_buf.h"
+#include "cpu_threads.h"
+
+// Visibility fields, see scatter.cpp
+const int _U = 0;
+const int _V = 1;
+
+// Weighting schemes. Must match "Weighting" in Kernel/Config.hs.
+enum Weighting { WEIGHT_NATURAL = 0, WEIGHT_UNIFORM = 1, WEIGHT_BRIGGS = 2 };
+
+// Run "f(t, lo, hi)" for disjoint ranges covering [0, n) in
+// parallel, with "t" being the thread number
+template <typename F>
+static void parallelRanges(int nthreads, int32_t n, F f) {
+  if (nthreads == 1) { f(0, 0, n); return; }
+  std::vector<std::thread> threads;
+  for (int t = 0; t < nthreads; t++)
+    threads.push_back(std::thread(f, t, int32_t(int64_t(n) * t / nthreads),
+                                  int32_t(int64_t(n) * (t + 1) / nthreads)));
+  for (std::thread & t : threads) t.join();
+}
+
+extern "C"
+int kern_weights(const double _scale, const int32_t _mode, const double _robust,
+                 buffer_t *_vis_buffer, buffer_t *_weights_buffer) {
+
+  const int32_t
+      width = _weights_buffer->extent[0]
+    , height = _weights_buffer->extent[1]
+    , nvis = _vis_buffer->extent[1]
+    ;
+  const int64_t pitch = _weights_buffer->stride[1];
+  double * weights = reinterpret_cast<double *>(_weights_buffer->host);
+  const double * vis = reinterpret_cast<const double *>(_vis_buffer->host);
+  if (_weights_buffer->stride[0] != 1 || _vis_buffer->stride[0] != 1) return -888;
+  const int nthreads = numThreads();
+
+  if (_mode == WEIGHT_NATURAL) {
+    parallelRanges(nthreads, height, [&](int, int32_t y0, int32_t y1) {
+      for (int32_t y = y0; y < y1; y++)
+        std::fill(weights + y * pitch, weights + y * pitch + width, 1.0);
+    });
+    return 0;
+  }
+  if (_mode != WEIGHT_UNIFORM && _mode != WEIGHT_BRIGGS) return -888;
+
+  // Find grid cell of every visibility, -1 if outside of the grid
+  std::vector<int64_t> cell(nvis);
+  parallelRanges(nthreads, nvis, [&](int, int32_t i0, int32_t i1) {
+    for (int32_t i = i0; i < i1; i++) {
+      const double * v = vis + int64_t(i) * _vis_buffer->stride[1];
+      double x = std::nearbyint(v[_U] * _scale) + width / 2;
+      double y = std::nearbyint(v[_V] * _scale) + height / 2;
+      cell[i] = (x >= 0 && x < width && y >= 0 && y < height)
+              ? int64_t(y) * pitch + int64_t(x) : -1;
+    }
+  });
+
+  // Count visibilities per cell. Every thread owns a strip of rows,
+  // and only counts the visibilities that fall into it.
+  std::vector<double> sumD2(nthreads, 0.0), sumD(nthreads, 0.0);
+  parallelRanges(nthreads, height, [&](int t, int32_t y0, int32_t y1) {
+    const int64_t c0 = y0 * pitch, c1 = y1 * pitch;
+    for (int32_t y = y0; y < y1; y++)
+      std::fill(weights + y * pitch, weights + y * pitch + width, 0.0);
+    for (int32_t i = 0; i < nvis; i++)
+      if (cell[i] >= c0 && cell[i] < c1) weights[cell[i]] += 1;
+    double d2 = 0, d = 0;
+    for (int32_t y = y0; y < y1; y++)
+      for (int32_t x = 0; x < width; x++) {
+        double dens = weights[y * pitch + x];
+        d2 += dens * dens; d += dens;
+      }
+    sumD2[t] = d2; sumD[t] = d;
+  });
+
+  // Convert densities into weights
+  double f2 = 0;
+  if (_mode == WEIGHT_BRIGGS) {
+    double d2 = 0, d = 0;
+    for (int t = 0; t < nthreads; t++) { d2 += sumD2[t]; d += sumD[t]; }
+    if (d2 > 0) f2 = std::pow(5 * std::pow(10, -_robust), 2) / (d2 / d);
+  }
+  parallelRanges(nthreads, height, [&](int, int32_t y0, int32_t y1) {
+    for (int32_t y = y0; y < y1; y++)
+      for (int32_t x = 0; x < width; x++) {
+        double & w = weights[y * pitch + x];
+        if (_mode == WEIGHT_UNIFORM)
+          w = w > 0 ? 1 / w : 0;
+        else
+          w = 1 / (1 + w * f2);
+      }
+  });
+  return 0;
+}
@@ -0,0 +1,56 @@
+
+#include "Halide.h"
+#include "utils.h"
+using namespace Halide;
+
+// W-stacking phase screen. Takes the (complex) inverse FFT of a grid
+// that only has visibilities with w close to the given w and
+// accumulates it into the image after correcting for the w-term:
+//
+//   img(l,m) += Re( plane(l,m) * exp(2 pi i w (sqrt(1-l^2-m^2) - 1)) )
+//
+int main(int argc, char **argv) {
+  if (argc < 2) return 1;
+
+  // ** Input
+
+  Param<double> w("w"), theta("theta");
+
+  ImageParam plane(type_of<double>(), 3, "plane");
+  plane.set_min(0,0).set_stride(0,1).set_extent(0,_CPLX_FIELDS)
+       .set_stride(1,_CPLX_FIELDS);
+
+  std::vector<Halide::Argument> args = { w, theta, plane };
+
+  // ** Output
+
+  // Image starts out undefined so we can update the output buffer
+  Func img("img"); Var x("x"), y("y");
+  img(x, y) = undef<double>();
+  Expr width = img.output_buffer().extent(0);
+  Expr height = img.output_buffer().extent(1);
+
+  // ** Definition
+
+  // Direction cosines of the pixel, relative to the image centre
+  Func n("n");
+  Expr l = theta * cast<double>(x - width / 2) / cast<double>(width);
+  Expr m = theta * cast<double>(y - height / 2) / cast<double>(height);
+  n(x, y) = sqrt(1 - l*l - m*m) - 1;
+
+  // Apply phase screen, accumulate real part
+  Complex screen = polar(cast<double>(1), 2 * pi() * w * n(x, y));
+  img(x, y) += (Complex(plane(_REAL, x, y), plane(_IMAG, x, y)) * screen).real;
+
+  // ** Strategy
+
+  img.output_buffer()
+     .set_min(0,0).set_stride(0,1)
+     .set_min(1,0);
+  img.update().vectorize(x, 4).parallel(y);
+
+  Target target(get_target_from_environment().os, Target::X86, 64, { Target::SSE41, Target::AVX});
+  Module mod = img.compile_to_module(args, "kern_wstack", target);
+  compile_module_to_object(mod, argv[1]);
+  return 0;
+}
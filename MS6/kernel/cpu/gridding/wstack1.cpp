@@ -0,0 +1,69 @@
+// W-stacking imaging. Instead of choosing a larger GCF for larger w
+// (w-projection), we grid every w-bin with the same small GCF into a
+// plane of its own, inverse FFT it, and correct for w in the image
+// domain using a phase screen (see wstack.cpp).
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "gcf_common.h"
+
+extern "C" {
+int kern_scatter(const double _scale, const int32_t _grid_size, const int32_t _margin_size,
+                 buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_uvg_buffer);
+int kern_ifft_c2c(buffer_t *_uvg_buffer, buffer_t *_img_cshifted_buffer);
+int kern_wstack(const double _w, const double _theta, buffer_t *_plane_buffer, buffer_t *_img_buffer);
+}
+
+// Visibility fields, see scatter.cpp
+const int _W = 2;
+
+static buffer_t mkPlaneBuffer(double * data, int32_t width, int32_t height) {
+  buffer_t buf;
+  memset(&buf, 0, sizeof(buf));
+  buf.host = reinterpret_cast<uint8_t *>(data);
+  buf.extent[0] = 2;      buf.stride[0] = 1;
+  buf.extent[1] = width;  buf.stride[1] = 2;
+  buf.extent[2] = height; buf.stride[2] = 2 * width;
+  buf.elem_size = sizeof(double);
+  return buf;
+}
+
+// "_theta" is the field of view of the image in radians. For facets
+// that is the facet's own field of view, which must match "_scale".
+extern "C"
+int kern_wstack_grid(const double _scale, const int32_t _grid_size, const int32_t _margin_size,
+                     const double _theta,
+                     buffer_t *_vis_buffer, buffer_t *_gcf_buffer, buffer_t *_img_buffer) {
+
+  // Nothing to do for empty w-bins - which saves us two FFTs.
+  const int32_t nvis = _vis_buffer->extent[1];
+  if (nvis == 0) return 0;
+
+  // Determine w of the plane. The binner makes sure all visibilities
+  // we get are within a narrow w-range, so we take its centre.
+  const double * vis = reinterpret_cast<const double *>(_vis_buffer->host);
+  double wmin = std::numeric_limits<double>::infinity(), wmax = -wmin;
+  for (int32_t i = 0; i < nvis; i++) {
+    double w = vis[int64_t(i) * _vis_buffer->stride[1] + _W];
+    wmin = std::min(wmin, w);
+    wmax = std::max(wmax, w);
+  }
+  const double w = (wmin + wmax) / 2;
+
+  // Grid into a (zeroed) plane covering the whole image, then
+  // transform
+  const int32_t width = _img_buffer->extent[0], height = _img_buffer->extent[1];
+  std::vector<double> uvg(size_t(2) * width * height), plane(uvg.size());
+  buffer_t uvg_buffer = mkPlaneBuffer(uvg.data(), width, height)
+         , plane_buffer = mkPlaneBuffer(plane.data(), width, height);
+  int res;
+  if ((res = kern_scatter(_scale, _grid_size, _margin_size, _vis_buffer, _gcf_buffer, &uvg_buffer)) != 0) return res;
+  if ((res = kern_ifft_c2c(&uvg_buffer, &plane_buffer)) != 0) return res;
+
+  // Correct for w, accumulate
+  return kern_wstack(w, _theta, &plane_buffer, _img_buffer);
+}
@@ -0,0 +1,48 @@
+{-# LANGUAGE DataKinds #-}
+
+module Kernel.Averaging
+  ( bdaKernel, bdaPsfVisKernel
+  ) where
+
+import Data.Int
+
+import Flow.Builder
+import Flow.Halide
+
+import Kernel.Data
+
+-- For FFI
+import Data.Vector.HFixed.Class ()
+import Flow.Halide.Types ()
+
+-- | Baseline-dependent averaging: Averages consecutive raw
+-- visibilities until they would smear over more than the configured
+-- fraction of a grid cell (see kernel/cpu/gridding/bda.cpp). Runs
+-- never cross baselines, which are "gridBDATimes" visibilities each
+-- in the order the reader produces them. The
+-- output keeps the size of the input, with unused visibilities
+-- marked such that binning drops them. Averaged visibilities are
+-- summed, so natural weighting is preserved. If @isPsf@ is set, we
+-- sum unit visibilities instead, which "bdaPsfVisKernel" then turns
+-- into PSF visibilities.
+bdaKernel :: GridPar -> Bool -> TDom -> Flow Vis -> Kernel Vis
+bdaKernel gp isPsf tdom =
+  halideKernel1 "bda" (rawVisRepr tdom) (rawVisRepr tdom) $
+  kern_bda `halideBind` gridScale gp
+           `halideBind` gridBDASmear gp
+           `halideBind` fromIntegral (gridBDAMaxRun gp)
+           `halideBind` fromIntegral (gridBDATimes gp)
+           `halideBind` (if isPsf then 1 else 0)
+foreign import ccall unsafe kern_bda
+  :: HalideBind Double (HalideBind Double (HalideBind Int32 (HalideBind Int32 (HalideBind Int32 (
+     HalideFun '[RawVisRepr] RawVisRepr)))))
+
+-- | PSF visibility kernel for averaged visibilities. Replaces
+-- "psfVisKernel", keeping the run length "bdaKernel" put into the
+-- amplitude.
+bdaPsfVisKernel :: UVDom -> WDom -> Flow Vis -> Kernel Vis
+bdaPsfVisKernel uvdom wdom =
+  halideKernel1 "bdaPsfVis" (visRepr uvdom wdom) (visRepr uvdom wdom)
+  kern_bda_psf_vis
+foreign import ccall unsafe kern_bda_psf_vis
+  :: HalideFun '[VisRepr] VisRepr
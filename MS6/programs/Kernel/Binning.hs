@@ -1,12 +1,10 @@
 {-# LANGUAGE BangPatterns #-}
 
-module Kernel.Binning ( binSizer, binner ) where
+module Kernel.Binning ( binSizer, binSizerSoA, binner, binnerPols, binnerSoA ) where
 
 import Control.Arrow ( second )
 import Control.Monad
-import Foreign.Marshal.Array
 import Foreign.Storable
-import Foreign.Ptr
 import Data.Int ( Int64 )
 import Data.IORef
 import qualified Data.Map as Map
@@ -28,16 +26,40 @@ binSizeRepr (udom, vdom) = RegionRepr udom $ RegionRepr vdom $ VectorRepr WriteA
 ufield, vfield, wfield :: Int
 [ufield, vfield, wfield] = [0..2]
 
+-- | Layout of raw visibility data: Given the region box, returns the
+-- number of visibilities and the offset of a field of a visibility.
+type VisLayout = RegionBox -> (Int, Int -> Int -> Int)
+
+-- | Array of structures, see "rawVisPolRepr"
+aosLayout :: Int -> TDom -> VisLayout
+aosLayout npol tdom inds = (fromIntegral inVis, \i f -> i * fromIntegral inWdt + f)
+  where (_, inVis) :. (_, inWdt) :. Z = halrDim (rawVisPolRepr npol tdom) inds
+
+-- | Structure of arrays, see "rawVisSoARepr"
+soaLayout :: TDom -> VisLayout
+soaLayout tdom inds = (fromIntegral inVis, \i f -> f * fromIntegral inVis + i)
+  where _ :. (_, inVis) :. Z = halrDim (rawVisSoARepr tdom) inds
+
 -- | Kernel determining bin sizes. This is used to construct the bin
 -- domain with enough data to allow us to calculate Halide buffer
 -- sizes.
 binSizer :: GridPar -> TDom -> UVDom -> Flow Vis -> Kernel ()
 binSizer gpar tdom uvdom =
- kernel "binSizer" (rawVisRepr tdom :. Z) (binSizeRepr uvdom) $ \[visPar] rboxes -> do
+ kernel "binSizer" (rawVisRepr tdom :. Z) (binSizeRepr uvdom) $
+   binSizerCode gpar (aosLayout 1 tdom)
+
+-- | Bin sizer for visibilities in structure-of-arrays layout
+binSizerSoA :: GridPar -> TDom -> UVDom -> Flow Vis -> Kernel ()
+binSizerSoA gpar tdom uvdom =
+ kernel "binSizerSoA" (rawVisSoARepr tdom :. Z) (binSizeRepr uvdom) $
+   binSizerCode gpar (soaLayout tdom)
+
+binSizerCode :: GridPar -> VisLayout -> KernelCode
+binSizerCode gpar layout [visPar] rboxes = do
 
   -- Input size (range domain)
   let [(inds,inVec)] = Map.toList visPar
-      (_, inVis) :. (_, inWdt) :. Z  = halrDim (rawVisRepr tdom) inds
+      (inVis, field) = layout inds
       inVec' = castVector inVec :: Vector Double
 
   -- Find range of coordinates
@@ -48,10 +70,10 @@ binSizer gpar tdom uvdom =
       vmin = minimum $ map (xy2uv . regLow . regionRange . (!! 1)) rboxes
       umax = maximum $ map (xy2uv . regHigh . regionRange . (!! 0)) rboxes
       vmax = maximum $ map (xy2uv . regHigh . regionRange . (!! 1)) rboxes
-  (low, high0) <- (\f -> foldM f (0,0) [0..fromIntegral inVis-1]) $ \(low, high) i -> do
-    u <- peekVector inVec' (i * fromIntegral inWdt + ufield)
-    v <- peekVector inVec' (i * fromIntegral inWdt + vfield)
-    w <- peekVector inVec' (i * fromIntegral inWdt + wfield)
+  (low, high0) <- (\f -> foldM f (0,0) [0..inVis-1]) $ \(low, high) i -> do
+    u <- peekVector inVec' (field i ufield)
+    v <- peekVector inVec' (field i vfield)
+    w <- peekVector inVec' (field i wfield)
     if u >= umin && u < umax && v >= vmin && v < vmax then do
       let !low' = min w low
           !high' = max w high
@@ -78,10 +100,10 @@ binSizer gpar tdom uvdom =
                   binVecs
 
   -- Make vector for bin sizes
-  forM_ [0..fromIntegral inVis-1] $ \i -> do
-    u <- peekVector inVec' (i * fromIntegral inWdt + ufield)
-    v <- peekVector inVec' (i * fromIntegral inWdt + vfield)
-    w <- peekVector inVec' (i * fromIntegral inWdt + wfield)
+  forM_ [0..inVis-1] $ \i -> do
+    u <- peekVector inVec' (field i ufield)
+    v <- peekVector inVec' (field i vfield)
+    w <- peekVector inVec' (field i wfield)
     when (u >= umin && u < umax && v >= vmin && v < vmax && w >= low && w <= high) $ do
       case Map.lookupLE u binVecMap >>= Map.lookupLE v . snd of
         Just (_, binVec) -> do
@@ -97,25 +119,52 @@ binSizer gpar tdom uvdom =
   -}
 
   return $ map (castVector . snd . snd) binVecs
+binSizerCode _ _ _ _ = fail "binSizer: Expected exactly one parameter!"
 
 -- | Kernel that splits up visibilities per u/v/w bins.
 binner :: GridPar -> TDom -> UVDom -> WDom -> Flow Vis -> Kernel Vis
-binner gpar tdom uvdom wdom =
- kernel "binner" (rawVisRepr tdom :. Z) (visRepr uvdom wdom) $ \[visPar] rboxes -> do
+binner = binnerPols 1
+
+-- | Binner for visibilities with the given number of polarisations
+-- (see "visPolRepr").
+binnerPols :: Int -> GridPar -> TDom -> UVDom -> WDom -> Flow Vis -> Kernel Vis
+binnerPols npol gpar tdom uvdom wdom =
+ kernel "binner" (rawVisPolRepr npol tdom :. Z) (visPolRepr npol uvdom wdom) $ \[visPar] rboxes -> do
+  let [(inds,_)] = Map.toList visPar
+      _ :. (_, inWdt) :. Z = halrDim (rawVisPolRepr npol tdom) inds
+  when (fromIntegral inWdt /= 3 + 2 * npol) $ fail "wBinner: Unexpected data width!"
+  outVecs <- allocReturns allocCVector (visPolRepr npol uvdom wdom) rboxes
+  binnerCode gpar (3 + 2 * npol) (aosLayout npol tdom) (\_ i f -> i * (3 + 2 * npol) + f)
+             visPar outVecs
+
+-- | Binner for visibilities in structure-of-arrays layout (see
+-- "rawVisSoARepr" and "visSoARepr"). Fields stay in planes of their
+-- own, so every output region has one plane per field.
+binnerSoA :: GridPar -> TDom -> UVDom -> WDom -> Flow Vis -> Kernel Vis
+binnerSoA gpar tdom uvdom wdom =
+ kernel "binnerSoA" (rawVisSoARepr tdom :. Z) (visSoARepr uvdom wdom) $ \[visPar] rboxes -> do
+  outVecs <- allocReturns allocCVector (visSoARepr uvdom wdom) rboxes
+  binnerCode gpar 5 (soaLayout tdom) (\n i f -> f * n + i) visPar outVecs
+
+-- | Actual binning. Output field offsets are given by "outField",
+-- which gets the number of visibilities in the output region, the
+-- visibility and the field number.
+binnerCode :: GridPar -> Int -> VisLayout -> (Int -> Int -> Int -> Int)
+           -> RegionData -> [(RegionBox, Vector Double)] -> IO [Vector ()]
+binnerCode gpar width layout outField visPar outVecs = do
 
   -- Input size (range domain, assumed single region)
   let [(inds,inVec)] = Map.toList visPar
-      (_, inVis) :. (_, inWdt) :. Z  = halrDim (rawVisRepr tdom) inds
+      (inVis, field) = layout inds
       inVec' = castVector inVec :: Vector Double
-  when (inWdt /= 5) $ fail "wBinner: Unexpected data width!"
-
-  -- Create return vectors
-  outVecs <- allocReturns allocCVector (visRepr uvdom wdom) rboxes
 
-  -- Make pointer map
+  -- Make pointer map. We track the number of visibilities written
+  -- so far for every output region.
   let xy2uv (x,y) = (gridXY2UV gpar x, gridXY2UV gpar y)
+      regionVis wreg = sum $ map regionBinSize $ regionBins wreg
   outPtrs <- forM outVecs $ \([ureg,vreg,wreg], CVector _ p) -> do
-    pRef <- newIORef p
+    iRef <- newIORef 0
+    let pRef = (p, regionVis wreg, iRef)
     return [ Map.singleton wl $ Map.singleton vl $ Map.singleton ul $
              ((ul,uh),(vl,vh),(wl,wh),pRef)
            | let (ul,uh) = xy2uv $ regionRange ureg
@@ -125,30 +174,26 @@ binner gpar tdom uvdom wdom =
   let outPtrMap = Map.unionsWith (Map.unionWith Map.union) $ concat outPtrs
 
   -- Bin visibilities
-  forM_ [0..fromIntegral inVis-1] $ \i -> do
+  forM_ [0..inVis-1] $ \i -> do
 
     -- Get coordinates
-    u <- peekVector inVec' (i * fromIntegral inWdt + ufield)
-    v <- peekVector inVec' (i * fromIntegral inWdt + vfield)
-    w <- peekVector inVec' (i * fromIntegral inWdt + wfield)
+    u <- peekVector inVec' (field i ufield)
+    v <- peekVector inVec' (field i vfield)
+    w <- peekVector inVec' (field i wfield)
 
     -- Lookup and double-check range
     let lookupP x = fmap snd . Map.lookupLE x
     case lookupP u =<< lookupP v =<< lookupP w outPtrMap of
-      Just ((ul,uh), (vl,vh), (wl,wh), pRef)
+      Just ((ul,uh), (vl,vh), (wl,wh), (p, n, iRef))
         | ul <= u && u < uh && vl <= v && v < vh && wl <= w && w < wh -> do
 
-          -- Increase pointer
-          p <- readIORef pRef
-          writeIORef pRef (p `advancePtr` fromIntegral inWdt)
+          -- Increase index
+          o <- readIORef iRef
+          writeIORef iRef (o + 1)
 
           -- Copy visibility
-          let transfer f = poke (p `advancePtr` f) =<< peekVector inVec' (i * fromIntegral inWdt + f)
-          transfer 0
-          transfer 1
-          transfer 2
-          transfer 3
-          transfer 4
+          let transfer f = pokeElemOff p (outField n o f) =<< peekVector inVec' (field i f)
+          mapM_ transfer [0..width-1]
       _otherwise -> return ()
 
   -- Check bin sizes and pad with zeroes if we did not fill the bin
@@ -165,17 +210,12 @@ binner gpar tdom uvdom wdom =
 
     let lookupP x = fmap snd . Map.lookupLE x
     case lookupP u =<< lookupP v =<< lookupP w outPtrMap of
-      Just ((_ul,_uh), (_vl,_vh), (_wl,_wh), pRef) -> do
-          -- Check pointer
-          p' <- readIORef pRef
-          let size = (p' `minusPtr` p) `div` (5*8)
+      Just ((_ul,_uh), (_vl,_vh), (_wl,_wh), (_, n, iRef)) -> do
+          -- Check index
+          size <- readIORef iRef
           -- putStrLn $ show ((_ul,_uh), (_vl,_vh), (_wl,_wh)) ++ " -> " ++ show size ++ " vs " ++ show s
-          forM_ [size..regionBinSize bin-1] $ \i -> do
-            poke (p `advancePtr` (5*i+0)) 0
-            poke (p `advancePtr` (5*i+1)) 0
-            poke (p `advancePtr` (5*i+2)) 0
-            poke (p `advancePtr` (5*i+3)) 0
-            poke (p `advancePtr` (5*i+4)) 0
+          forM_ [size..regionBinSize bin-1] $ \i ->
+            forM_ [0..width-1] $ \f -> pokeElemOff p (outField n i f) 0
       _otherwise -> putStrLn "???"
 
   return $ map (castVector . snd) outVecs
@@ -18,6 +18,14 @@ psfVisKernel uvdom wdom = halideKernel1 "psfvis" (visRepr uvdom wdom) (visRepr u
 foreign import ccall unsafe kern_psf_vis
   :: HalideFun '[VisRepr] VisRepr
 
+-- | PSF visibility update kernel for structure-of-arrays layout (see
+-- "visSoARepr")
+psfVisKernelSoA :: UVDom -> WDom -> Flow Vis -> Kernel Vis
+psfVisKernelSoA uvdom wdom = halideKernel1 "psfvisSoA" (visSoARepr uvdom wdom) (visSoARepr uvdom wdom) $
+  kern_psf_vis_soa
+foreign import ccall unsafe kern_psf_vis_soa
+  :: HalideFun '[VisSoARepr] VisSoARepr
+
 -- | Cleaning kernel binding, returning the model
 cleanModel :: GridPar -> CleanPar -- ^ Configuration
            -> Flow Image          -- ^ PSF
@@ -51,6 +51,9 @@ instance FromJSON OskarInput where
 
 data GridKernelType
   = GridKernelCPU
+  | GridKernelCPUPar
+  | GridKernelCPUSep
+  | GridKernelCPUIDG
 #ifdef USE_CUDA
   | GridKernelGPU
   | GridKernelNV
@@ -59,14 +62,24 @@ data GridKernelType
 
 data DegridKernelType
   = DegridKernelCPU
+  | DegridKernelCPUPar
 #ifdef USE_CUDA
   | DegridKernelGPU
 #endif
   deriving (Eq, Ord, Enum, Show)
 
+data FFTKernelType
+  = FFTKernelCPU
+  | FFTKernelCPUPar
+  | FFTKernelFFTW
+  deriving (Eq, Ord, Enum, Show)
+
 instance Read GridKernelType where
   readsPrec _ str = case lex str of
     ("cpu", rest):_ -> [(GridKernelCPU, rest)]
+    ("cpu_par", rest):_ -> [(GridKernelCPUPar, rest)]
+    ("cpu_sep", rest):_ -> [(GridKernelCPUSep, rest)]
+    ("cpu_idg", rest):_ -> [(GridKernelCPUIDG, rest)]
 #ifdef USE_CUDA
     ("gpu", rest):_ -> [(GridKernelGPU, rest)]
     ("nv",  rest):_ -> [(GridKernelNV,  rest)]
@@ -75,12 +88,20 @@ instance Read GridKernelType where
 
 instance Read DegridKernelType where
   readsPrec _ str
+    | Just rest <- stripPrefix "cpu_par" str = [(DegridKernelCPUPar, rest)]
     | Just rest <- stripPrefix "cpu" str  = [(DegridKernelCPU, rest)]
 #ifdef USE_CUDA
     | Just rest <- stripPrefix "gpu" str  = [(DegridKernelGPU, rest)]
 #endif
     | otherwise = []
 
+instance Read FFTKernelType where
+  readsPrec _ str
+    | Just rest <- stripPrefix "cpu_par" str = [(FFTKernelCPUPar, rest)]
+    | Just rest <- stripPrefix "cpu" str  = [(FFTKernelCPU, rest)]
+    | Just rest <- stripPrefix "fftw" str = [(FFTKernelFFTW, rest)]
+    | otherwise = []
+
 data GridPar = GridPar
   { gridWidth :: !Int  -- ^ Width of the uv-grid/image in pixels
   , gridHeight :: !Int -- ^ Neight of the uv-grid/image in pixels
@@ -92,6 +113,12 @@ data GridPar = GridPar
   , gridTiles  :: !Int -- ^ Number of tiles in U and V domains
   , gridFacets :: !Int -- ^ Number of facets in L and M domains
   , gridBins   :: !Int -- ^ Number of bins in W domain
+  , gridWeighting :: !Weighting -- ^ Visibility weighting scheme
+  , gridBDASmear :: !Double -- ^ Maximum uv smearing from baseline-dependent
+                            -- averaging, in grid cells. 0 disables averaging.
+  , gridBDAMaxRun :: !Int   -- ^ Maximum number of visibilities to average
+  , gridBDATimes :: !Int    -- ^ Time steps per baseline in the input, so
+                            -- averaging can tell baselines apart
   }
 instance FromJSON GridPar where
   parseJSON (Object v)
@@ -101,8 +128,37 @@ instance FromJSON GridPar where
               <*> (v .: "uv-tiles" <|> return 1)
               <*> (v .: "lm-facets" <|> return 1)
               <*> (v .: "w-bins" <|> return 1)
+              <*> (weighting =<< (,) <$> v .:? "weighting" .!= "natural"
+                                     <*> v .:? "robust" .!= 0)
+              <*> v .:? "bda-smear" .!= 0
+              <*> v .:? "bda-max-run" .!= 16
+              <*> v .:? "bda-times" .!= 0
+    where weighting :: (String, Double) -> Parser Weighting
+          weighting ("natural", _) = return WeightNatural
+          weighting ("uniform", _) = return WeightUniform
+          weighting ("briggs", r)  = return (WeightBriggs r)
+          weighting (other, _)     = fail $ "Unknown weighting: " ++ other
   parseJSON _ = mempty
 
+-- | Visibility weighting schemes
+data Weighting
+  = WeightNatural        -- ^ All visibilities have the same weight
+  | WeightUniform        -- ^ Weight inversely to visibility density
+  | WeightBriggs !Double -- ^ Briggs weighting with the given robustness
+  deriving (Eq, Show)
+
+-- | Weighting mode identifier as expected by the weighting kernel
+-- (see weights.cpp)
+weightingMode :: Weighting -> Int
+weightingMode WeightNatural    = 0
+weightingMode WeightUniform    = 1
+weightingMode (WeightBriggs _) = 2
+
+-- | Robustness parameter for Briggs weighting
+weightingRobust :: Weighting -> Double
+weightingRobust (WeightBriggs r) = r
+weightingRobust _                = 0
+
 data GCFFile = GCFFile
   { gcfFile :: FilePath
   , gcfSize :: Int
@@ -112,21 +168,63 @@ instance FromJSON GCFFile where
   parseJSON (Object v)
     = GCFFile <$> v .: "file" <*> v .: "size" <*> v .: "w"
   parseJSON _ = mempty
+-- | Parameters for generating GCFs on the fly (see
+-- kernel/cpu/gcf/gcf_cache.cpp). Sizes still get chosen from the GCF
+-- list, but the kernel gets generated for the actual w of the bin.
+data GCFGen = GCFGen
+  { gcfGenT2 :: Double     -- ^ Half field of view (should be theta / 2)
+  , gcfGenCache :: FilePath -- ^ Directory for on-disk cache, empty to disable
+  , gcfGenLRU :: Int        -- ^ Number of GCFs to keep in memory
+  }
+instance FromJSON GCFGen where
+  parseJSON (Object v)
+    = GCFGen <$> v .: "t2"
+             <*> v .:? "cache" .!= ""
+             <*> v .:? "lru" .!= 16
+  parseJSON _ = mempty
 data GCFPar = GCFPar
   { gcfFiles :: [GCFFile]
   , gcfOver :: Int
+  , gcfGenerate :: Maybe GCFGen
+  , gcfQuadrant :: Bool -- ^ Only store unique quadrant of (symmetric) GCFs
   }
 instance FromJSON GCFPar where
   parseJSON (Object v)
     = GCFPar <$> v .: "list" <*> v .: "over"
+             <*> v .:? "generate"
+             <*> v .:? "quadrant" .!= False
   parseJSON _ = mempty
 
 gcfMaxSize :: GCFPar -> Int
-gcfMaxSize = maximum . map gcfSize . gcfFiles
+gcfMaxSize gcfp = maximum $ map (gcfSize . gcfUsed gcfp) $ gcfFiles gcfp
+
+-- | GCF list entry as we use it. We only generate GCFs of even size
+-- (see "gcfSizer" in Kernel/IO.hs), so with generate odd sizes get
+-- rounded up.
+gcfUsed :: GCFPar -> GCFFile -> GCFFile
+gcfUsed gcfp gcf = case gcfGenerate gcfp of
+  Just _ | odd (gcfSize gcf) -> gcf { gcfSize = gcfSize gcf + 1 }
+  _                          -> gcf
+
+-- | Number of GCF layers we store per w-bin. For quadrant GCFs we
+-- only keep oversampling offsets up to half the oversampling factor
+-- in either direction (see kernel/cpu/gridding/gcf_halide.h)
+gcfLayers :: GCFPar -> Int
+gcfLayers gcfp
+  | gcfQuadrant gcfp = (gcfOver gcfp `div` 2 + 1) ^ (2 :: Int)
+  | otherwise        = gcfOver gcfp * gcfOver gcfp
+
+-- | GCF parameters for w-stacking: Here we correct for w in the
+-- image domain, so we use the GCF with the lowest w for everything.
+-- We also never generate GCFs, as that would introduce a w-term.
+gcfNoW :: GCFPar -> GCFPar
+gcfNoW gcfp = gcfp { gcfFiles = [ gcf0 { gcfW = 0 } ], gcfGenerate = Nothing }
+  where gcf0 = minimumBy (comparing gcfW) (gcfFiles gcfp)
 
 -- | Returns the GCF to use for the given w-range.
 gcfGet :: GCFPar -> Double -> Double -> GCFFile
-gcfGet gcfp w0 w1 = maximumBy (comparing gcfW) $
+gcfGet gcfp w0 w1 = gcfUsed gcfp $
+                    maximumBy (comparing gcfW) $
                     filter ((<= w) . gcfW) $
                     gcfFiles gcfp
   where w = max (abs w0) (abs w1)
@@ -145,27 +243,45 @@ instance FromJSON CleanPar where
 data StrategyPar = StrategyPar
   { stratGridder   :: GridKernelType -- ^ Type of gridder: 0-CPU Halide, 1-GPU Halide, 2-GPU NVidia
   , stratDegridder :: DegridKernelType -- ^ Type of degridder: 0-CPU Halide, otherwise-GPU Halide
+  , stratFFT :: FFTKernelType -- ^ Type of FFT: single- or multi-threaded CPU Halide, or FFTW
   , stratTileSched :: (Schedule, Schedule) -- ^ Strategy to use for U and V distribution
   , stratFacetSched :: (Schedule, Schedule) -- ^ Strategy to use for L and M distribution
   , stratUseFiles :: Bool
+  , stratWStacking :: Bool -- ^ Use w-stacking instead of w-projection for gridding
+  , stratVisSoA :: Bool -- ^ Keep visibilities as structure of arrays (one plane per field)
+  , stratHalfPlane :: Bool -- ^ Only grid the Hermitian v >= 0 half-plane
+  , stratFusedResidual :: Bool -- ^ Degrid, subtract and re-grid in one kernel
+  , stratFusedRotation :: Bool -- ^ Rotate visibilities to facets within the degridder
   }
 instance FromJSON StrategyPar where
   parseJSON (Object v)
     = StrategyPar
         <$> (fmap (readMaybe =<<) $ v .:? "gridder_type")   .!= stratGridder defaultStrategyPar
         <*> (fmap (readMaybe =<<) $ v .:? "degridder_type") .!= stratDegridder defaultStrategyPar
+        <*> (fmap (readMaybe =<<) $ v .:? "fft_type")       .!= stratFFT defaultStrategyPar
         <*> (fmap (readMaybe =<<) $ v .:? "uv-tiles-sched") .!= stratTileSched defaultStrategyPar
         <*> (fmap (readMaybe =<<) $ v .:? "lm-facets-sched") .!= stratFacetSched defaultStrategyPar
         <*> v .:? "use_files" .!= stratUseFiles defaultStrategyPar
+        <*> v .:? "w_stacking" .!= stratWStacking defaultStrategyPar
+        <*> v .:? "vis_soa" .!= stratVisSoA defaultStrategyPar
+        <*> v .:? "half_plane" .!= stratHalfPlane defaultStrategyPar
+        <*> v .:? "fused_residual" .!= stratFusedResidual defaultStrategyPar
+        <*> v .:? "fused_rotation" .!= stratFusedRotation defaultStrategyPar
   parseJSON _ = mempty
 
 defaultStrategyPar :: StrategyPar
 defaultStrategyPar = StrategyPar
   { stratGridder    = GridKernelCPU
   , stratDegridder  = DegridKernelCPU
+  , stratFFT        = FFTKernelCPU
   , stratTileSched  = (SeqSchedule, SeqSchedule)
   , stratFacetSched = (SeqSchedule, SeqSchedule)
   , stratUseFiles   = False
+  , stratWStacking  = False
+  , stratVisSoA     = False
+  , stratHalfPlane  = False
+  , stratFusedResidual = False
+  , stratFusedRotation = False
   }
 
 -- | Default configuration. Gets overridden by the actual
@@ -179,8 +295,8 @@ defaultConfig = Config
   , cfgLong     = 72.1 / 180 * pi -- mostly arbitrary, and probably wrong in some way
   , cfgLat      = 42.6 / 180 * pi -- ditto
   , cfgOutput   = ""
-  , cfgGrid     = GridPar 0 0 0 0 1 1 1
-  , cfgGCF      = GCFPar [] 8
+  , cfgGrid     = GridPar 0 0 0 0 1 1 1 WeightNatural 0 16 0
+  , cfgGCF      = GCFPar [] 8 Nothing False
   , cfgClean    = CleanPar 0 0 0
   , cfgStrategy = defaultStrategyPar
   }
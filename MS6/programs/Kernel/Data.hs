@@ -3,19 +3,29 @@
 -- | Data representation definitions
 module Kernel.Data
   ( -- * Configuration
-    Config(..), OskarInput(..), GridKernelType(..), DegridKernelType(..)
-  , GridPar(..), GCFPar(..), GCFFile(..), CleanPar(..), StrategyPar(..)
+    Config(..), OskarInput(..), GridKernelType(..), DegridKernelType(..), FFTKernelType(..)
+  , GridPar(..), GCFPar(..), GCFFile(..), GCFGen(..), CleanPar(..), StrategyPar(..)
+  , Weighting(..), weightingMode, weightingRobust
   , defaultConfig, cfgParallelism
-  , gridImageWidth, gridImageHeight, gridScale, gridXY2UV, gcfMaxSize, gcfGet
+  , gridImageWidth, gridImageHeight, gridScale, gridXY2UV, gcfMaxSize, gcfGet, gcfNoW
   -- * Data tags
-  , Index, Tag, Vis, UVGrid, FullUVGrid, Image, Cleaned, GCFs
+  , Index, Tag, Vis, UVGrid, FullUVGrid, Image, Cleaned, GCFs, Weights, Rotation, Channels
   -- * Data representations
   , DDom, TDom, UDom, VDom, WDom, UVDom, LDom, MDom, LMDom, GUDom, GVDom, GUVDom
   , IndexRepr, UVGRepr, UVGMarginRepr, FacetRepr, ImageRepr, FullUVGRepr, PlanRepr, GCFsRepr
   , indexRepr, uvgRepr, uvgMarginRepr, facetRepr, imageRepr, fullUVGRepr, planRepr, gcfsRepr
+  , uvgMarginPolRepr, fullUVGPolRepr
+  , UVGHalfRepr, uvgHalfRepr
+  , WeightsRepr, weightsRepr
+  , RotationRepr, FacetRotationRepr, rotationRepr, facetRotationRepr
+  , GCFStackRepr, gcfStackRepr
+  , ChannelsRepr, channelsRepr
   -- * Visibility data representations
   , RawVisRepr, RotatedVisRepr, VisRepr
   , rawVisRepr, rotatedVisRepr, visRepr
+  , rawVisPolRepr, visPolRepr
+  , RawVisSoARepr, RotatedVisSoARepr, VisSoARepr
+  , rawVisSoARepr, rotatedVisSoARepr, visSoARepr
   ) where
 
 import Data.Typeable
@@ -36,6 +46,9 @@ data FullUVGrid -- ^ Full UV grid
 data Image -- ^ Image
 data Cleaned -- ^ Result from cleaning
 data GCFs -- ^ A set of GCFs
+data Weights -- ^ Visibility weights per grid cell
+data Rotation -- ^ Visibility rotation parameters for a facet
+data Channels -- ^ Frequencies of visibility channels
 
 deriving instance Typeable Tag
 deriving instance Typeable Vis
@@ -43,6 +56,9 @@ deriving instance Typeable UVGrid
 deriving instance Typeable FullUVGrid
 deriving instance Typeable Image
 deriving instance Typeable GCFs
+deriving instance Typeable Weights
+deriving instance Typeable Rotation
+deriving instance Typeable Channels
 
 type DDom = Domain Bins -- ^ Domain used for indexing data sets
 type TDom = Domain Range -- ^ Domain used for indexing visibilities
@@ -70,13 +86,33 @@ uvgRepr (udom, vdom) =
 
 type UVGMarginRepr = MarginRepr (MarginRepr (HalideRepr Dim1 Double UVGrid))
 uvgMarginRepr :: GCFPar -> UVDom -> UVGMarginRepr
-uvgMarginRepr gcfp (udom, vdom) =
+uvgMarginRepr gcfp = uvgMarginPolRepr gcfp 1
+
+-- | Grid for multiple polarisations. All polarisations of a grid
+-- point are stored next to each other.
+uvgMarginPolRepr :: GCFPar -> Int -> UVDom -> UVGMarginRepr
+uvgMarginPolRepr gcfp npol (udom, vdom) =
   marginRepr vdom (gcfMaxSize gcfp `div` 2) $
   marginRepr udom (gcfMaxSize gcfp `div` 2) $
-  halideRepr (dim1 dimCpx)
+  halideRepr (dim1 $ dimCpxPol npol)
+
+-- | Hermitian half-plane grid: Only rows with v >= 0 (so starting
+-- from the grid centre), plus a margin of half the maximum GCF size
+-- below for contributions spilling over the centre line.
+type UVGHalfRepr = HalideRepr Dim3 Double UVGrid
+uvgHalfRepr :: GridPar -> GCFPar -> UVGHalfRepr
+uvgHalfRepr gp gcfp = halideRepr $ dimV :. dimU :. dimCpx :. Z
+  where dimU = (0, fromIntegral $ gridWidth gp)
+        dimV = (fromIntegral $ gridHeight gp `div` 2 - margin,
+                fromIntegral $ gridHeight gp `div` 2 + margin)
+        margin = gcfMaxSize gcfp `div` 2
 
 dimCpx :: Dim
-dimCpx = (0, 2)
+dimCpx = dimCpxPol 1
+
+-- | Complex values for the given number of polarisations
+dimCpxPol :: Int -> Dim
+dimCpxPol npol = (0, 2 * fromIntegral npol)
 
 type FacetRepr = HalideRepr Dim2 Double Image
 facetRepr :: GridPar -> ImageRepr
@@ -92,10 +128,42 @@ imageRepr gp = halideRepr $ dimY :. dimX :. Z
 
 type FullUVGRepr = HalideRepr Dim3 Double FullUVGrid
 fullUVGRepr :: GridPar -> FullUVGRepr
-fullUVGRepr gp = halideRepr $ dimY :. dimX :. dimCpx :. Z
+fullUVGRepr gp = fullUVGPolRepr gp 1
+
+fullUVGPolRepr :: GridPar -> Int -> FullUVGRepr
+fullUVGPolRepr gp npol = halideRepr $ dimY :. dimX :. dimCpxPol npol :. Z
   where dimX = (0, fromIntegral $ gridImageWidth gp)
         dimY = (0, fromIntegral $ gridImageHeight gp)
 
+-- | Visibility weights, one per cell of the uv grid
+type WeightsRepr = HalideRepr Dim2 Double Weights
+weightsRepr :: GridPar -> WeightsRepr
+weightsRepr gp = halideRepr $ dimV :. dimU :. Z
+  where dimU = (0, fromIntegral $ gridWidth gp)
+        dimV = (0, fromIntegral $ gridHeight gp)
+
+-- | Facet rotation parameters: UVW reprojection matrix followed by
+-- the position change vector (see kernel/cpu/gridding/rotate.cpp).
+-- This is what kernels see when running within a facet, the
+-- producing kernel additionally gets the facet region passed.
+type RotationRepr = HalideRepr Dim1 Double Rotation
+rotationRepr :: RotationRepr
+rotationRepr = halideRepr (dim1 dimRotParams)
+
+type FacetRotationRepr = RegionRepr Range (RegionRepr Range (HalideRepr Dim1 Double Rotation))
+facetRotationRepr :: LMDom -> FacetRotationRepr
+facetRotationRepr (ldom, mdom) =
+  RegionRepr ldom $ RegionRepr mdom $
+  halideRepr (dim1 dimRotParams)
+
+dimRotParams :: Dim
+dimRotParams = (0, 9 + 3)
+
+-- | Frequency of every channel, in Hz
+type ChannelsRepr = HalideRepr Dim1 Double Channels
+channelsRepr :: Int -> ChannelsRepr
+channelsRepr nchan = halideRepr (dim1 (0, fromIntegral nchan))
+
 type PlanRepr = NoRepr Tag -- HalideRepr Dim0 Int32 Tag
 planRepr :: PlanRepr
 planRepr = NoRepr -- halideRepr dim0
@@ -104,7 +172,10 @@ planRepr = NoRepr -- halideRepr dim0
 -- (see "dimVisFields").
 type RawVisRepr = RangeRepr (HalideRepr Dim1 Double Vis)
 rawVisRepr :: Domain Range -> RawVisRepr
-rawVisRepr dom = RangeRepr dom $ halideRepr (dim1 dimVisFields)
+rawVisRepr = rawVisPolRepr 1
+
+rawVisPolRepr :: Int -> Domain Range -> RawVisRepr
+rawVisPolRepr npol dom = RangeRepr dom $ halideRepr (dim1 $ dimVisFieldsPol npol)
 
 type RotatedVisRepr = RegionRepr Range (RegionRepr Range (RangeRepr (HalideRepr Dim1 Double Vis)))
 rotatedVisRepr :: LMDom -> TDom -> RotatedVisRepr
@@ -114,13 +185,41 @@ rotatedVisRepr (ldom, mdom) tdom =
 
 type VisRepr = RegionRepr Range (RegionRepr Range (BinRepr (HalideRepr Dim1 Double Vis)))
 visRepr :: UVDom -> WDom -> VisRepr
-visRepr (udom, vdom) wdom =
+visRepr = visPolRepr 1
+
+visPolRepr :: Int -> UVDom -> WDom -> VisRepr
+visPolRepr npol (udom, vdom) wdom =
   RegionRepr udom $ RegionRepr vdom $ BinRepr wdom $
-  halideRepr (dim1 dimVisFields)
+  halideRepr (dim1 $ dimVisFieldsPol npol)
 
 -- | We have 5 visibility fields: u, v and w, Real, imag
 dimVisFields :: Dim
-dimVisFields = (0, 5)
+dimVisFields = dimVisFieldsPol 1
+
+-- | With multiple polarisations, we have a real and imaginary field
+-- for every polarisation after u, v and w.
+dimVisFieldsPol :: Int -> Dim
+dimVisFieldsPol npol = (0, 3 + 2 * fromIntegral npol)
+
+-- | Raw visibilities as a structure of arrays: One plane per field
+-- (see "dimVisFields"), holding the field for all visibilities.
+type RawVisSoARepr = ArrayRepr (RangeRepr (HalideRepr Dim0 Double Vis))
+rawVisSoARepr :: Domain Range -> RawVisSoARepr
+rawVisSoARepr dom = ArrayRepr visFieldsSoA $ RangeRepr dom $ halideRepr dim0
+
+type RotatedVisSoARepr = RegionRepr Range (RegionRepr Range RawVisSoARepr)
+rotatedVisSoARepr :: LMDom -> TDom -> RotatedVisSoARepr
+rotatedVisSoARepr (ldom, mdom) tdom =
+  RegionRepr ldom $ RegionRepr mdom $ rawVisSoARepr tdom
+
+type VisSoARepr = RegionRepr Range (RegionRepr Range (ArrayRepr (BinRepr (HalideRepr Dim0 Double Vis))))
+visSoARepr :: UVDom -> WDom -> VisSoARepr
+visSoARepr (udom, vdom) wdom =
+  RegionRepr udom $ RegionRepr vdom $ ArrayRepr visFieldsSoA $ BinRepr wdom $
+  halideRepr dim0
+
+visFieldsSoA :: (Int, Int)
+visFieldsSoA = (0, 5)
 
 type GCFsRepr = RegionRepr Bins (ArrayRepr (BinRepr (BinRepr (HalideRepr Dim1 Double GCFs))))
 gcfsRepr :: GCFPar -> WDom -> GUVDom -> GCFsRepr
@@ -130,4 +229,12 @@ gcfsRepr gcfp wdom (gudom, gvdom) =
     BinRepr gvdom $
     BinRepr gudom $
     halideRepr (dim1 dimCpx)
-  where dimOver = (0, fromIntegral $ gcfOver gcfp * gcfOver gcfp)
+  where dimOver = (0, fromIntegral $ gcfLayers gcfp)
+
+-- | A stack of GCFs for the given number of w-planes, all of the
+-- largest GCF size. The layers of all planes follow each other.
+type GCFStackRepr = HalideRepr Dim4 Double GCFs
+gcfStackRepr :: GCFPar -> Int -> GCFStackRepr
+gcfStackRepr gcfp nplanes = halideRepr $ dimLayers :. dimSize :. dimSize :. dimCpx :. Z
+  where dimLayers = (0, fromIntegral $ nplanes * gcfLayers gcfp)
+        dimSize = (0, fromIntegral $ gcfMaxSize gcfp)
@@ -1,7 +1,8 @@
 {-# LANGUAGE DataKinds, CPP #-}
 
 module Kernel.Degrid
-  ( distributeGrid, degridKernel
+  ( distributeGrid, degridKernel, degridKernelPol4, degridKernelSoA
+  , degridKernelRot
   )
   where
 
@@ -46,26 +47,93 @@ degridKernel ktype gp gcfp uvdom wdom guvdom =
                          `halideBind` fromIntegral (gridHeight gp)
                          `halideBind` fromIntegral (gcfMaxSize gcfp)
 
+-- | Full polarisation degridder, the counterpart to "gridKernelPol4".
+-- Degrids all four polarisations of every visibility in one pass.
+degridKernelPol4 :: GridPar -> GCFPar -- ^ Configuration
+                 -> UVDom -> WDom     -- ^ u/v/w visibility domains
+                 -> GUVDom            -- ^ GCF u/v domains
+                 -> Flow GCFs -> Flow FullUVGrid -> Flow Vis
+                 -> Kernel Vis
+degridKernelPol4 gp gcfp uvdom wdom guvdom =
+  hintsByPars (\pars -> [floatHint { hintDoubleOps = 4 * degridOps gcfp pars }, memHint]) $
+  halideKernel3 "degridKernelPol4" (gcfsRepr gcfp wdom guvdom)
+                                   (fullUVGPolRepr gp 4)
+                                   (visPolRepr 4 uvdom wdom)
+                                   (visPolRepr 4 uvdom wdom) $
+  kern_degrid_pol4 `halideBind` gridScale gp
+                   `halideBind` fromIntegral (gridHeight gp)
+                   `halideBind` fromIntegral (gcfMaxSize gcfp)
+
+-- | Degridder for visibilities in structure-of-arrays layout (see
+-- "visSoARepr"), the counterpart to "gridKernelSoA".
+degridKernelSoA :: GridPar -> GCFPar -- ^ Configuration
+                -> UVDom -> WDom     -- ^ u/v/w visibility domains
+                -> GUVDom            -- ^ GCF u/v domains
+                -> Flow GCFs -> Flow FullUVGrid -> Flow Vis
+                -> Kernel Vis
+degridKernelSoA gp gcfp uvdom wdom guvdom =
+  hintsByPars (\pars -> [floatHint { hintDoubleOps = degridOps gcfp pars }, memHint]) $
+  halideKernel3 "degridKernelSoA" (gcfsRepr gcfp wdom guvdom)
+                                  (fullUVGRepr gp)
+                                  (visSoARepr uvdom wdom)
+                                  (visSoARepr uvdom wdom) $
+  kern_degrid_soa `halideBind` gridScale gp
+                  `halideBind` fromIntegral (gridHeight gp)
+                  `halideBind` fromIntegral (gcfMaxSize gcfp)
+
+-- | Degridder rotating visibilities to the facet on the fly (see
+-- "rotateParamsKernel"). Gets unrotated visibilities, but produces
+-- rotated ones, so it replaces "rotateKernel" for the major loop.
+degridKernelRot :: GridPar -> GCFPar -- ^ Configuration
+                -> UVDom -> WDom     -- ^ u/v/w visibility domains
+                -> GUVDom            -- ^ GCF u/v domains
+                -> Flow Rotation -> Flow GCFs -> Flow FullUVGrid -> Flow Vis
+                -> Kernel Vis
+degridKernelRot gp gcfp uvdom wdom guvdom =
+  hintsByPars (\pars -> [floatHint { hintDoubleOps = degridOps gcfp (drop 1 pars) }, memHint]) $
+  halideKernel4 "degridKernelRot" rotationRepr
+                                  (gcfsRepr gcfp wdom guvdom)
+                                  (fullUVGRepr gp)
+                                  (visRepr uvdom wdom)
+                                  (visRepr uvdom wdom) $
+  kern_degrid_rot `halideBind` gridScale gp
+                  `halideBind` fromIntegral (gridHeight gp)
+                  `halideBind` fromIntegral (gcfMaxSize gcfp)
+
 degridHint :: GCFPar -> DegridKernelType -> [[RegionBox]] -> [ProfileHint]
-degridHint gcfp ktype (_:_:visRegs:_) = case ktype of
+degridHint gcfp ktype pars = case ktype of
   DegridKernelCPU -> [floatHint { hintDoubleOps = ops }, memHint]
+  DegridKernelCPUPar -> [floatHint { hintDoubleOps = ops }, memHint]
 #ifdef USE_CUDA
   DegridKernelGPU -> [cudaHint  { hintCudaDoubleOps = ops }]
 #endif
+ where ops = degridOps gcfp pars
+
+-- | Floating point operations for degridding one polarisation
+degridOps :: GCFPar -> [[RegionBox]] -> Int
+degridOps gcfp (_:_:visRegs:_) = sum $ map binOps $ concatMap (regionBins . wBinReg) visRegs
  where wBinReg = (!!2) -- u, v, w - we want region three (see visRepr definition)
-       ops = sum $ map binOps $ concatMap (regionBins . wBinReg) visRegs
        binOps bin = 8 * gcfSize gcf * gcfSize gcf * regionBinSize bin
          where gcf = gcfGet gcfp (regionBinLow bin) (regionBinHigh bin)
-degridHint _ _ _ = error "degridHint: Not enough parameters!"
+degridOps _ _ = error "degridHint: Not enough parameters!"
 
 type ForeignDegridder = HalideBind Double (HalideBind Int32 (HalideBind Int32 (
                                               HalideFun '[GCFsRepr, FullUVGRepr, VisRepr] VisRepr)))
 foreignDegridder :: DegridKernelType -> ForeignDegridder
 foreignDegridder DegridKernelCPU = kern_degrid
+foreignDegridder DegridKernelCPUPar = kern_degrid_par
 #ifdef USE_CUDA
 foreignDegridder DegridKernelGPU = kern_degrid_gpu1
 #endif
 foreign import ccall unsafe kern_degrid      :: ForeignDegridder
+foreign import ccall unsafe kern_degrid_par  :: ForeignDegridder
+foreign import ccall unsafe kern_degrid_pol4 :: ForeignDegridder
+foreign import ccall unsafe kern_degrid_soa
+  :: HalideBind Double (HalideBind Int32 (HalideBind Int32 (
+     HalideFun '[GCFsRepr, FullUVGRepr, VisSoARepr] VisSoARepr)))
+foreign import ccall unsafe kern_degrid_rot
+  :: HalideBind Double (HalideBind Int32 (HalideBind Int32 (
+     HalideFun '[RotationRepr, GCFsRepr, FullUVGRepr, VisRepr] VisRepr)))
 #ifdef USE_CUDA
 foreign import ccall unsafe kern_degrid_gpu1 :: ForeignDegridder
 #endif
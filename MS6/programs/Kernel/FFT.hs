@@ -11,10 +11,33 @@ import Kernel.Data
 import Data.Vector.HFixed.Class ()
 import Flow.Halide.Types ()
 
-fftKern :: GridPar -> Flow Image -> Kernel FullUVGrid
-fftKern gp = halideKernel1 "fftKern" (imageRepr gp) (fullUVGRepr gp) kern_fft
-foreign import ccall unsafe kern_fft :: HalideFun '[ImageRepr] FullUVGRepr
+fftKern :: FFTKernelType -> GridPar -> Flow Image -> Kernel FullUVGrid
+fftKern ktype gp = halideKernel1 "fftKern" (imageRepr gp) (fullUVGRepr gp) $
+  case ktype of
+    FFTKernelCPU    -> kern_fft
+    FFTKernelCPUPar -> kern_fft_par
+    FFTKernelFFTW   -> kern_fft_fftw
+foreign import ccall unsafe kern_fft      :: HalideFun '[ImageRepr] FullUVGRepr
+foreign import ccall unsafe kern_fft_par  :: HalideFun '[ImageRepr] FullUVGRepr
+foreign import ccall unsafe kern_fft_fftw :: HalideFun '[ImageRepr] FullUVGRepr
 
-ifftKern :: GridPar -> UVDom -> Flow UVGrid -> Kernel Image
-ifftKern gp uvdom = halideKernel1 "ifftKern" (uvgRepr uvdom) (facetRepr gp) kern_ifft
-foreign import ccall unsafe kern_ifft :: HalideFun '[UVGRepr] ImageRepr
+ifftKern :: FFTKernelType -> GridPar -> UVDom -> Flow UVGrid -> Kernel Image
+ifftKern ktype gp uvdom = halideKernel1 "ifftKern" (uvgRepr uvdom) (facetRepr gp) $
+  case ktype of
+    FFTKernelCPU    -> kern_ifft
+    FFTKernelCPUPar -> kern_ifft_par
+    FFTKernelFFTW   -> kern_ifft_fftw
+foreign import ccall unsafe kern_ifft      :: HalideFun '[UVGRepr] ImageRepr
+foreign import ccall unsafe kern_ifft_par  :: HalideFun '[UVGRepr] ImageRepr
+foreign import ccall unsafe kern_ifft_fftw :: HalideFun '[UVGRepr] ImageRepr
+
+-- | Inverse FFT for a half-plane grid (see "gridKernelHalf")
+ifftKernHalf :: FFTKernelType -> GridPar -> GCFPar -> Flow UVGrid -> Kernel Image
+ifftKernHalf ktype gp gcfp = halideKernel1 "ifftKernHalf" (uvgHalfRepr gp gcfp) (facetRepr gp) $
+  case ktype of
+    FFTKernelCPU    -> kern_ifft_half
+    FFTKernelCPUPar -> kern_ifft_half_par
+    FFTKernelFFTW   -> kern_ifft_half_fftw
+foreign import ccall unsafe kern_ifft_half      :: HalideFun '[UVGHalfRepr] ImageRepr
+foreign import ccall unsafe kern_ifft_half_par  :: HalideFun '[UVGHalfRepr] ImageRepr
+foreign import ccall unsafe kern_ifft_half_fftw :: HalideFun '[UVGHalfRepr] ImageRepr
@@ -23,6 +23,51 @@ rotateKernel
   -> Flow Vis
   -> Kernel Vis
 rotateKernel cfg lmdom tdom =
+  let (inLon, inLat, lon0, lat0, lonIncr, latIncr, doRep) = rotateParams cfg
+  in halideKernel1 "rotateKernel" (rawVisRepr tdom)
+                                  (rotatedVisRepr lmdom tdom) $
+     kern_rotate `halideBind` inLon `halideBind` inLat
+                 `halideBind` lon0 `halideBind` lat0
+                 `halideBind` lonIncr `halideBind` latIncr
+                 `halideBind` doRep
+
+-- | Visibility rotation for visibilities in structure-of-arrays
+-- layout (see "rawVisSoARepr")
+rotateKernelSoA
+  :: Config -- ^ Configuration
+  -> LMDom  -- ^ Image coordinate domains
+  -> TDom   -- ^ Visibility indexdomain
+  -> Flow Vis
+  -> Kernel Vis
+rotateKernelSoA cfg lmdom tdom =
+  let (inLon, inLat, lon0, lat0, lonIncr, latIncr, doRep) = rotateParams cfg
+  in halideKernel1 "rotateKernelSoA" (rawVisSoARepr tdom)
+                                     (rotatedVisSoARepr lmdom tdom) $
+     kern_rotate_soa `halideBind` inLon `halideBind` inLat
+                     `halideBind` lon0 `halideBind` lat0
+                     `halideBind` lonIncr `halideBind` latIncr
+                     `halideBind` doRep
+
+-- | Visibility rotation parameters for the facet. Kernels can use
+-- these to rotate visibilities on the fly (see "degridKernelRot"),
+-- instead of running "rotateKernel" up-front.
+rotateParamsKernel
+  :: Config -- ^ Configuration
+  -> LMDom  -- ^ Image coordinate domains
+  -> Kernel Rotation
+rotateParamsKernel cfg lmdom =
+  let (inLon, inLat, lon0, lat0, lonIncr, latIncr, doRep) = rotateParams cfg
+  in halideKernel0 "rotateParamsKernel" (facetRotationRepr lmdom) $
+     kern_rotate_params `halideBind` inLon `halideBind` inLat
+                        `halideBind` lon0 `halideBind` lat0
+                        `halideBind` lonIncr `halideBind` latIncr
+                        `halideBind` doRep
+
+-- | Parameters for the rotation kernels: Input longitude/latitude,
+-- output longitude/latitude for the top-left facet and increments
+-- per facet, and whether to reproject.
+rotateParams :: Config -> (Double, Double, Double, Double, Double, Double, Int32)
+rotateParams cfg =
   let gp = cfgGrid cfg
       wdt = fromIntegral $ gridWidth gp
       hgt = fromIntegral $ gridHeight gp
@@ -40,24 +85,33 @@ rotateKernel cfg lmdom tdom =
       latIncr = gridTheta gp / hgt / facets -- radians per pixel
       lon0 = outLon - lonIncr * (fromIntegral $ (gridImageWidth gp `div` 2) - (gridWidth gp `div` 2))
       lat0 = outLat - latIncr * (fromIntegral $ (gridImageHeight gp `div` 2) - (gridHeight gp `div` 2))
-  in halideKernel1 "rotateKernel" (rawVisRepr tdom)
-                                  (rotatedVisRepr lmdom tdom) $
-     kern_rotate `halideBind` inLon `halideBind` inLat
-                 `halideBind` lon0 `halideBind` lat0
-                 `halideBind` lonIncr `halideBind` latIncr
-                 `halideBind` (if doRep then 1 else 0)
-foreign import ccall unsafe kern_rotate
-  :: (HalideBind Double (HalideBind Double
+  in (inLon, inLat, lon0, lat0, lonIncr, latIncr, if doRep then 1 else 0)
+
+type ForeignRotate vis rvis
+  = HalideBind Double (HalideBind Double
+    (HalideBind Double (HalideBind Double
+    (HalideBind Double (HalideBind Double
+    (HalideBind Int32
+    (HalideFun '[vis] rvis)))))))
+foreign import ccall unsafe kern_rotate     :: ForeignRotate RawVisRepr RotatedVisRepr
+foreign import ccall unsafe kern_rotate_soa :: ForeignRotate RawVisSoARepr RotatedVisSoARepr
+foreign import ccall unsafe kern_rotate_params
+  :: HalideBind Double (HalideBind Double
      (HalideBind Double (HalideBind Double
      (HalideBind Double (HalideBind Double
      (HalideBind Int32
-     (HalideFun '[RawVisRepr] RotatedVisRepr))))))))
+     (HalideFun '[] FacetRotationRepr)))))))
 
 -- | Defacetting image initialisation
 imageInit :: GridPar -> Kernel Image
 imageInit gp = halideKernel0 "imageInit" (imageRepr gp) kern_image_init
 foreign import ccall unsafe kern_image_init :: HalideFun '[] ImageRepr
 
+-- | Facet image initialisation. Only needed where we do not get the
+-- facet from an FFT, as with w-stacking.
+facetInit :: GridPar -> Kernel Image
+facetInit gp = halideKernel0 "facetInit" (facetRepr gp) kern_image_init
+
 -- | Grid de-tiling kernel. This simply copies  tiles into a common UV-grid.
 imageDefacet :: GridPar -> LMDom -> Flow Image -> Flow Image -> Kernel Image
 imageDefacet gp (ldom, mdom) =
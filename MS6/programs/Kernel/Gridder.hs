@@ -3,7 +3,14 @@
 module Kernel.Gridder
   ( GridKernelType
   , gridInit, gridKernel
+  , gridInitPol, gridKernelPol4
+  , gridKernelMFS
+  , gridKernelSoA
+  , gridInitHalf, gridKernelHalf
+  , degridGridKernel, degridGridKernelRot
+  , psfGridKernel, psfGridKernelWeighted
   , gridInitDetile, gridDetiling
+  , wstackKernel
   )
   where
 
@@ -43,20 +50,41 @@ gridKernel ktype gp gcfp uvdom wdom guvdom uvdom' =
                     `halideBind` fromIntegral (gcfMaxSize gcfp)
 
 gridHint :: GCFPar -> GridKernelType -> [[RegionBox]] -> [ProfileHint]
-gridHint gcfp ktype (visRegs:_) = case ktype of
+gridHint gcfp ktype pars = case ktype of
   GridKernelCPU -> [floatHint { hintDoubleOps = ops }, memHint]
+  GridKernelCPUPar -> [floatHint { hintDoubleOps = ops }, memHint]
+  GridKernelCPUSep -> [floatHint { hintDoubleOps = ops }, memHint]
+  GridKernelCPUIDG -> [floatHint { hintDoubleOps = idgOps gcfp pars }, memHint]
 #ifdef USE_CUDA
   GridKernelGPU -> [cudaHint { hintCudaDoubleOps = ops } ]
   GridKernelNV  -> [cudaHint { hintCudaDoubleOps = ops } ]
 #endif
+ where ops = gridOps gcfp pars
+
+-- | Floating point operations for gridding one polarisation
+gridOps :: GCFPar -> [[RegionBox]] -> Int
+gridOps gcfp (visRegs:_) = sum $ map binOps $ concatMap (regionBins . wBinReg) visRegs
  where wBinReg = (!!2) -- u, v, w - we want region three (see visRepr definition)
-       ops = sum $ map binOps $ concatMap (regionBins . wBinReg) visRegs
        binOps bin = 8 * gcfSize gcf * gcfSize gcf * regionBinSize bin
          where gcf = gcfGet gcfp (regionBinLow bin) (regionBinHigh bin)
-gridHint _ _ _ = error "gridHint: Not enough parameters!"
+gridOps _ _ = error "gridHint: Not enough parameters!"
+
+-- | Floating point operations for image-domain gridding: Every
+-- visibility contributes to all pixels of a subgrid, which is the
+-- maximum GCF size plus 16, rounded up to a multiple of 8 (see
+-- kernel/cpu/gridding/scatter_idg.cpp). We do not count the subgrid
+-- FFTs.
+idgOps :: GCFPar -> [[RegionBox]] -> Int
+idgOps gcfp (visRegs:_) = sum $ map binOps $ concatMap (regionBins . (!!2)) visRegs
+ where binOps bin = 22 * subgrid * subgrid * regionBinSize bin
+       subgrid = (gcfMaxSize gcfp + 16 + 7) `div` 8 * 8
+idgOps _ _ = error "gridHint: Not enough parameters!"
 
 gridCKernel :: GridKernelType -> ForeignGridder
 gridCKernel GridKernelCPU = kern_scatter
+gridCKernel GridKernelCPUPar = kern_scatter_par
+gridCKernel GridKernelCPUSep = kern_scatter_sep
+gridCKernel GridKernelCPUIDG = kern_scatter_idg
 #ifdef USE_CUDA
 gridCKernel GridKernelGPU = kern_scatter_gpu1
 gridCKernel GridKernelNV  = nvGridder
@@ -65,11 +93,200 @@ gridCKernel GridKernelNV  = nvGridder
 type ForeignGridder = HalideBind Double (HalideBind Int32 (HalideBind Int32 (
                       HalideFun '[VisRepr, GCFsRepr] UVGMarginRepr)))
 foreign import ccall unsafe kern_scatter      :: ForeignGridder
+foreign import ccall unsafe kern_scatter_par  :: ForeignGridder
+foreign import ccall unsafe kern_scatter_sep  :: ForeignGridder
+foreign import ccall unsafe kern_scatter_idg  :: ForeignGridder
 #ifdef USE_CUDA
 foreign import ccall unsafe kern_scatter_gpu1 :: ForeignGridder
 foreign import ccall unsafe nvGridder         :: ForeignGridder
 #endif
 
+-- | Grid initialisation for gridding multiple polarisations
+gridInitPol :: GCFPar -> Int -> UVDom -> Kernel UVGrid
+gridInitPol gcfp npol uvdom = halideKernel0 "gridInitPol" (uvgMarginPolRepr gcfp npol uvdom) kern_init
+
+-- | Full polarisation gridder. Grids all four polarisations of every
+-- visibility in one pass, sharing the GCF lookup and grid address
+-- calculation. Uses the grid layout from "uvgMarginPolRepr".
+gridKernelPol4 :: GridPar -> GCFPar -- ^ Configuration
+               -> UVDom -> WDom     -- ^ u/v/w visibility domains
+               -> GUVDom            -- ^ GCF u/v domains
+               -> UVDom             -- ^ u/v grid domains
+               -> Flow Vis -> Flow GCFs -> Flow UVGrid
+               -> Kernel UVGrid
+gridKernelPol4 gp gcfp uvdom wdom guvdom uvdom' =
+  hintsByPars (\pars -> [floatHint { hintDoubleOps = 4 * gridOps gcfp pars }, memHint]) $
+  halideKernel2Write "gridKernelPol4" (visPolRepr 4 uvdom wdom)
+                                      (gcfsRepr gcfp wdom guvdom)
+                                      (uvgMarginPolRepr gcfp 4 uvdom') $
+  kern_scatter_pol4 `halideBind` gridScale gp
+                    `halideBind` fromIntegral (gridHeight gp)
+                    `halideBind` fromIntegral (gcfMaxSize gcfp)
+foreign import ccall unsafe kern_scatter_pol4 :: ForeignGridder
+
+-- | Multi-frequency synthesis gridder. Visibilities have UVW in
+-- metres, followed by a complex value for each of the given number
+-- of channels, which is the same layout as "visPolRepr" has for
+-- polarisations. All channels get gridded into the same grid in one
+-- pass. We get the frequency of every channel (see "channelsKernel")
+-- and a stack of GCFs for w-planes w-step apart (see
+-- "gcfStackKernel"), so every channel uses the GCF for its own w.
+--
+-- Our binners bin by UVW as given, so they can not know where the
+-- channels of a visibility end up. The kernel fails for channels off
+-- the grid (or beyond the last w-plane) instead of dropping them, so
+-- this needs a grid without uv-tiling that has room for all channels.
+gridKernelMFS :: GridPar -> GCFPar  -- ^ Configuration
+              -> Int                -- ^ Number of channels
+              -> Int -> Double      -- ^ Number of w-planes, w-step (in wavelengths)
+              -> UVDom -> WDom      -- ^ u/v/w visibility domains
+              -> UVDom              -- ^ u/v grid domains
+              -> Flow Channels -> Flow Vis -> Flow GCFs -> Flow UVGrid
+              -> Kernel UVGrid
+gridKernelMFS gp gcfp nchan nplanes wstep uvdom wdom uvdom' =
+  hintsByPars (\pars -> [floatHint { hintDoubleOps = nchan * gridOps gcfp pars }, memHint]) $
+  halideKernel3Write "gridKernelMFS" (channelsRepr nchan)
+                                     (visPolRepr nchan uvdom wdom)
+                                     (gcfStackRepr gcfp nplanes)
+                                     (uvgMarginRepr gcfp uvdom') $
+  kern_scatter_mfs `halideBind` gridScale gp
+                   `halideBind` fromIntegral (gridHeight gp)
+                   `halideBind` fromIntegral (gcfMaxSize gcfp)
+                   `halideBind` wstep
+foreign import ccall unsafe kern_scatter_mfs
+  :: HalideBind Double (HalideBind Int32 (HalideBind Int32 (HalideBind Double (
+     HalideFun '[ChannelsRepr, VisRepr, GCFStackRepr] UVGMarginRepr))))
+
+-- | Gridder for visibilities in structure-of-arrays layout (see
+-- "visSoARepr"). Otherwise the same as the "GridKernelCPU" gridder.
+gridKernelSoA :: GridPar -> GCFPar  -- ^ Configuration
+              -> UVDom -> WDom      -- ^ u/v/w visibility domains
+              -> GUVDom             -- ^ GCF u/v domains
+              -> UVDom              -- ^ u/v grid domains
+              -> Flow Vis -> Flow GCFs -> Flow UVGrid
+              -> Kernel UVGrid
+gridKernelSoA gp gcfp uvdom wdom guvdom uvdom' =
+  hintsByPars (\pars -> [floatHint { hintDoubleOps = gridOps gcfp pars }, memHint]) $
+  halideKernel2Write "gridKernelSoA" (visSoARepr uvdom wdom)
+                                     (gcfsRepr gcfp wdom guvdom)
+                                     (uvgMarginRepr gcfp uvdom') $
+  kern_scatter_soa `halideBind` gridScale gp
+                   `halideBind` fromIntegral (gridHeight gp)
+                   `halideBind` fromIntegral (gcfMaxSize gcfp)
+foreign import ccall unsafe kern_scatter_soa
+  :: HalideBind Double (HalideBind Int32 (HalideBind Int32 (
+     HalideFun '[VisSoARepr, GCFsRepr] UVGMarginRepr)))
+
+-- | Grid initialisation for the half-plane gridder
+gridInitHalf :: GridPar -> GCFPar -> Kernel UVGrid
+gridInitHalf gp gcfp = halideKernel0 "gridInitHalf" (uvgHalfRepr gp gcfp) kern_init_half
+foreign import ccall unsafe "kern_init" kern_init_half :: HalideFun '[] UVGHalfRepr
+
+-- | Hermitian half-plane gridder. Visibilities with v < 0 get
+-- conjugated and mirrored, so we only need to keep the upper half of
+-- the grid (see "uvgHalfRepr"). This only works without tiling, and
+-- the result goes straight to "ifftKernHalf".
+gridKernelHalf :: GridPar -> GCFPar -- ^ Configuration
+               -> UVDom -> WDom     -- ^ u/v/w visibility domains
+               -> GUVDom            -- ^ GCF u/v domains
+               -> Flow Vis -> Flow GCFs -> Flow UVGrid
+               -> Kernel UVGrid
+gridKernelHalf gp gcfp uvdom wdom guvdom =
+  hintsByPars (\pars -> [floatHint { hintDoubleOps = gridOps gcfp pars }, memHint]) $
+  halideKernel2Write "gridKernelHalf" (visRepr uvdom wdom)
+                                      (gcfsRepr gcfp wdom guvdom)
+                                      (uvgHalfRepr gp gcfp) $
+  kern_scatter_half `halideBind` gridScale gp
+                    `halideBind` fromIntegral (gridHeight gp)
+                    `halideBind` fromIntegral (gcfMaxSize gcfp)
+foreign import ccall unsafe kern_scatter_half
+  :: HalideBind Double (HalideBind Int32 (HalideBind Int32 (
+     HalideFun '[VisRepr, GCFsRepr] UVGHalfRepr)))
+
+-- | Fused residual gridder: Degrids every visibility from the model
+-- grid, subtracts the prediction and grids the residual right away.
+-- Equivalent to running "degridKernel" followed by "gridKernel", but
+-- without the intermediate visibility buffer.
+degridGridKernel :: GridPar -> GCFPar -- ^ Configuration
+                 -> UVDom -> WDom     -- ^ u/v/w visibility domains
+                 -> GUVDom            -- ^ GCF u/v domains
+                 -> Flow GCFs -> Flow FullUVGrid -> Flow Vis -> Flow UVGrid
+                 -> Kernel UVGrid
+degridGridKernel gp gcfp uvdom wdom guvdom =
+  hintsByPars (\pars -> [floatHint { hintDoubleOps = 2 * gridOps gcfp (drop 2 pars) }, memHint]) $
+  halideKernel3Write "degridGridKernel" (gcfsRepr gcfp wdom guvdom)
+                                        (fullUVGRepr gp)
+                                        (visRepr uvdom wdom)
+                                        (uvgMarginRepr gcfp uvdom) $
+  kern_scatter_resid `halideBind` gridScale gp
+                     `halideBind` fromIntegral (gridHeight gp)
+                     `halideBind` fromIntegral (gcfMaxSize gcfp)
+foreign import ccall unsafe kern_scatter_resid
+  :: HalideBind Double (HalideBind Int32 (HalideBind Int32 (
+     HalideFun '[GCFsRepr, FullUVGRepr, VisRepr] UVGMarginRepr)))
+
+-- | Fused residual gridder rotating visibilities to the facet on the
+-- fly, like "degridKernelRot" does.
+degridGridKernelRot :: GridPar -> GCFPar -- ^ Configuration
+                    -> UVDom -> WDom     -- ^ u/v/w visibility domains
+                    -> GUVDom            -- ^ GCF u/v domains
+                    -> Flow Rotation -> Flow GCFs -> Flow FullUVGrid -> Flow Vis -> Flow UVGrid
+                    -> Kernel UVGrid
+degridGridKernelRot gp gcfp uvdom wdom guvdom =
+  hintsByPars (\pars -> [floatHint { hintDoubleOps = 2 * gridOps gcfp (drop 3 pars) }, memHint]) $
+  halideKernel4Write "degridGridKernelRot" rotationRepr
+                                           (gcfsRepr gcfp wdom guvdom)
+                                           (fullUVGRepr gp)
+                                           (visRepr uvdom wdom)
+                                           (uvgMarginRepr gcfp uvdom) $
+  kern_scatter_resid_rot `halideBind` gridScale gp
+                         `halideBind` fromIntegral (gridHeight gp)
+                         `halideBind` fromIntegral (gcfMaxSize gcfp)
+foreign import ccall unsafe kern_scatter_resid_rot
+  :: HalideBind Double (HalideBind Int32 (HalideBind Int32 (
+     HalideFun '[RotationRepr, GCFsRepr, FullUVGRepr, VisRepr] UVGMarginRepr)))
+
+-- | PSF gridder. Grids visibilities as if they were 1+0j, so it only
+-- needs their coordinates, and does not need "psfVisKernel" to run
+-- first. Only needs to add up GCF values, which is a quarter of the
+-- floating point work of "gridKernel".
+psfGridKernel :: GridPar -> GCFPar -- ^ Configuration
+              -> UVDom -> WDom     -- ^ u/v/w visibility domains
+              -> GUVDom            -- ^ GCF u/v domains
+              -> UVDom             -- ^ u/v grid domains
+              -> Flow Vis -> Flow GCFs -> Flow UVGrid
+              -> Kernel UVGrid
+psfGridKernel gp gcfp uvdom wdom guvdom uvdom' =
+  hintsByPars (\pars -> [floatHint { hintDoubleOps = gridOps gcfp pars `div` 4 }, memHint]) $
+  halideKernel2Write "psfGridKernel" (visRepr uvdom wdom)
+                                     (gcfsRepr gcfp wdom guvdom)
+                                     (uvgMarginRepr gcfp uvdom') $
+  kern_scatter_psf `halideBind` gridScale gp
+                   `halideBind` fromIntegral (gridHeight gp)
+                   `halideBind` fromIntegral (gcfMaxSize gcfp)
+foreign import ccall unsafe kern_scatter_psf :: ForeignGridder
+
+-- | Weighted PSF gridder. Like "psfGridKernel", but every visibility
+-- gets the weight of its grid cell, as "weightVisKernel" would do.
+psfGridKernelWeighted :: GridPar -> GCFPar -- ^ Configuration
+                      -> UVDom -> WDom     -- ^ u/v/w visibility domains
+                      -> GUVDom            -- ^ GCF u/v domains
+                      -> UVDom             -- ^ u/v grid domains
+                      -> Flow Weights -> Flow Vis -> Flow GCFs -> Flow UVGrid
+                      -> Kernel UVGrid
+psfGridKernelWeighted gp gcfp uvdom wdom guvdom uvdom' =
+  hintsByPars (\pars -> [floatHint { hintDoubleOps = gridOps gcfp (drop 1 pars) `div` 2 }, memHint]) $
+  halideKernel3Write "psfGridKernelWeighted" (weightsRepr gp)
+                                             (visRepr uvdom wdom)
+                                             (gcfsRepr gcfp wdom guvdom)
+                                             (uvgMarginRepr gcfp uvdom') $
+  kern_scatter_psfw `halideBind` gridScale gp
+                    `halideBind` fromIntegral (gridHeight gp)
+                    `halideBind` fromIntegral (gcfMaxSize gcfp)
+foreign import ccall unsafe kern_scatter_psfw
+  :: HalideBind Double (HalideBind Int32 (HalideBind Int32 (
+     HalideFun '[WeightsRepr, VisRepr, GCFsRepr] UVGMarginRepr)))
+
 -- | Gridder grid initialisation, for detiling. Only differs from
 -- "gridInit" in the produced data representation, we can even re-use
 -- the underlying Halide kernel.
@@ -83,3 +300,25 @@ gridDetiling :: GCFPar -> UVDom -> UVDom
 gridDetiling gcfp uvdom0 uvdom1 =
   halideKernel1Write "gridDetiling" (uvgMarginRepr gcfp uvdom0) (uvgRepr uvdom1) kern_detile
 foreign import ccall unsafe kern_detile :: HalideFun '[UVGMarginRepr] UVGRepr
+
+-- | W-stacking gridder. Grids every w-bin into a plane of its own
+-- (using a w-independent GCF, see "gcfNoW"), then inverse FFTs it
+-- and accumulates it into the facet image after correcting for w.
+-- The w-correction has to cover the facet's field of view, which is
+-- the same "gridScale" the gridder uses.
+wstackKernel :: GridPar -> GCFPar -- ^ Configuration
+             -> UVDom -> WDom     -- ^ u/v/w visibility domains
+             -> GUVDom            -- ^ GCF u/v domains
+             -> Flow Vis -> Flow GCFs -> Flow Image
+             -> Kernel Image
+wstackKernel gp gcfp uvdom wdom guvdom =
+  halideKernel2Write "wstackKernel" (visRepr uvdom wdom)
+                                    (gcfsRepr gcfp wdom guvdom)
+                                    (facetRepr gp) $
+  kern_wstack_grid `halideBind` gridScale gp
+                   `halideBind` fromIntegral (gridHeight gp)
+                   `halideBind` fromIntegral (gcfMaxSize gcfp)
+                   `halideBind` gridScale gp
+foreign import ccall unsafe kern_wstack_grid
+  :: HalideBind Double (HalideBind Int32 (HalideBind Int32 (HalideBind Double (
+     HalideFun '[VisRepr, GCFsRepr] FacetRepr))))
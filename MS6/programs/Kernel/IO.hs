@@ -3,7 +3,10 @@
 module Kernel.IO where
 
 import Control.Monad
-import Foreign.C.Types ( CDouble(..) )
+import Foreign.C.Types ( CDouble(..), CInt(..) )
+import Foreign.C.String ( CString, withCString )
+import Foreign.Ptr      ( Ptr )
+import Foreign.Marshal.Array ( advancePtr )
 import Foreign.Storable
 import qualified Data.Map as Map
 import Data.Complex
@@ -21,9 +24,33 @@ import Kernel.Data
 
 oskarReader :: Domain Bins -> Domain Range -> [OskarInput] -> Int -> Int
             -> Flow Index -> Kernel Vis
-oskarReader ddom tdom files freq pol
+oskarReader ddom tdom files freq pol = oskarReaderPols ddom tdom files freq [pol]
+
+-- | Reads visibilities for a number of polarisations at once. Every
+-- visibility record has u, v and w followed by the real and imaginary
+-- parts for every polarisation (see "rawVisPolRepr").
+oskarReaderPols :: Domain Bins -> Domain Range -> [OskarInput] -> Int -> [Int]
+                -> Flow Index -> Kernel Vis
+oskarReaderPols ddom tdom files freq pols
   = mappingKernel "oskar reader" (indexRepr ddom :. Z)
-                                 (RegionRepr ddom $ rawVisRepr tdom) $ \[ixs] [dreg,treg] -> do
+                                 (RegionRepr ddom $ rawVisPolRepr (length pols) tdom) $
+    oskarReadCode files freq pols (\_ i f -> i * (3 + 2 * length pols) + f)
+
+-- | Reads visibilities into structure-of-arrays layout (see
+-- "rawVisSoARepr"). We write every field straight into its plane, so
+-- this needs no further conversion.
+oskarReaderSoA :: Domain Bins -> Domain Range -> [OskarInput] -> Int -> Int
+               -> Flow Index -> Kernel Vis
+oskarReaderSoA ddom tdom files freq pol
+  = mappingKernel "oskar reader SoA" (indexRepr ddom :. Z)
+                                     (RegionRepr ddom $ rawVisSoARepr tdom) $
+    oskarReadCode files freq [pol] (\n i f -> f * n + i)
+
+-- | Reads visibilities from OSKAR. "field" gives the offset of a
+-- field of a visibility, given the number of visibilities.
+oskarReadCode :: [OskarInput] -> Int -> [Int] -> (Int -> Int -> Int -> Int)
+              -> MappingKernelCode
+oskarReadCode files freq pols field [ixs] [dreg,treg] = do
 
   -- Get data set number. We only support reading one data set at a
   -- time currently - no pressing reason, but it makes the code
@@ -39,6 +66,8 @@ oskarReader ddom tdom files freq pol
   taskData <- readOskarData $ oskarFile file
   when (freq > tdChannels taskData) $
     fail "Attempted to read non-existent frequency channel from Oskar data!"
+  when (any (\p -> p < 0 || p >= 4) pols) $
+    fail "Attempted to read non-existent polarisation from Oskar data!"
 
   -- Get data
   let baselinePoints = tdTimes taskData
@@ -53,27 +82,37 @@ oskarReader ddom tdom files freq pol
     fail $ "oskarReader: region not baseline-aligned: " ++ show domLow ++ "-" ++ show domHigh
 
   -- Go through baselines and collect our data into on big array
-  let dblsPerPoint = 5
-  visVector <- allocCVector $ dblsPerPoint * (domHigh - domLow)
+  let dblsPerPoint = 3 + 2 * length pols
+      points = domHigh - domLow
+  visVector <- allocCVector $ dblsPerPoint * points
   let bl0 = domLow `div` baselinePoints
       bl1 = (domHigh - 1) `div` baselinePoints
       CVector _ visp = visVector
   forM_ [bl0..bl1] $ \bl -> do
      forM_ [0..baselinePoints-1] $ \p -> do
-       let off = (bl - bl0) * baselinePoints * dblsPerPoint + p * dblsPerPoint
+       let off = field points ((bl - bl0) * baselinePoints + p)
            getUVW uvw = do CDouble d <- peek (tdUVWPtr taskData bl p uvw); return d
-       pokeElemOff visp (off + 0) =<< getUVW 0
-       pokeElemOff visp (off + 1) =<< getUVW 1
-       pokeElemOff visp (off + 2) =<< getUVW 2
-       v <- peek (tdVisibilityPtr taskData bl p freq pol)
-       pokeElemOff visp (off + 3) (realPart v)
-       pokeElemOff visp (off + 4) (imagPart v)
+       pokeElemOff visp (off 0) =<< getUVW 0
+       pokeElemOff visp (off 1) =<< getUVW 1
+       pokeElemOff visp (off 2) =<< getUVW 2
+       forM_ (zip [0..] pols) $ \(i, pol) -> do
+         v <- peek (tdVisibilityPtr taskData bl p freq pol)
+         pokeElemOff visp (off (3 + 2*i)) (realPart v)
+         pokeElemOff visp (off (4 + 2*i)) (imagPart v)
 
   -- Free all data, done
   finalizeTaskData taskData
   return $ castVector visVector
+oskarReadCode _ _ _ _ _ _ = fail "oskarReader: Unexpected parameters / regions!"
 
 -- | Make GCF coordinate domain. Size depends on w.
+--
+-- Generated GCFs always have an even size: Odd sizes from the GCF
+-- list get rounded up (see "gcfUsed"). The kernels expect the GCF
+-- centre at tap size/2, which the generator's even FFT shift only
+-- gets right for even sizes, and the mirroring of quadrant GCFs only
+-- holds for them (see kernel/cpu/gridding/gcf_halide.h). GCF files
+-- are used at the size given.
 gcfSizer
   :: GCFPar
   -> WDom             -- ^ w domain
@@ -94,18 +133,52 @@ gcfSizer gcfp wdom =
     pokeVector binVec    2 (fromIntegral $ gcfSize gcf)
     return (castVector binVec)
 
+foreign import ccall safe gcf_get
+  :: CDouble -> CInt -> CInt -> CDouble -> CString -> CInt -> Ptr Double -> IO CInt
+
 gcfKernel :: GCFPar -> WDom -> GUVDom -> Kernel GCFs
 gcfKernel gcfp wdom guvdom =
  mappingKernel "gcfs" Z (gcfsRepr gcfp wdom guvdom) $ \_ doms -> do
 
-  -- Simply read it from the file
-  let size = nOfElements (halrDim (gcfsRepr gcfp wdom guvdom) doms)
-      bins = regionBins $ head doms
+  -- Read it from the file, or generate it. Either way we get all
+  -- layers at first.
+  let bins = regionBins $ head doms
       low = minimum $ map regionBinLow bins
       high = maximum $ map regionBinHigh bins
       gcf = gcfGet gcfp low high
-  putStrLn $ "Choosing " ++ gcfFile gcf ++ " for w range " ++ show low ++ "-" ++ show high
-  v <- readCVector (gcfFile gcf) size :: IO (Vector Double)
+      over = gcfOver gcfp
+      layerSize = 2 * gcfSize gcf * gcfSize gcf
+      size = over * over * layerSize
+  v0 <- case gcfGenerate gcfp of
+    Nothing -> do
+      -- Quadrant trimming assumes symmetry, which we only know for
+      -- GCFs we generate ourselves.
+      when (gcfQuadrant gcfp) $
+        fail "gcfKernel: quadrant GCFs require generate, GCF files might not be symmetric!"
+      putStrLn $ "Choosing " ++ gcfFile gcf ++ " for w range " ++ show low ++ "-" ++ show high
+      readCVector (gcfFile gcf) size :: IO (Vector Double)
+
+    -- Generate GCF for the centre of the w range instead. We generate
+    -- for positive w, see below.
+    Just gen -> do
+      let w = abs (low + high) / 2
+      putStrLn $ "Generating GCF of size " ++ show (gcfSize gcf) ++ " for w=" ++ show w
+      v@(CVector _ p) <- allocCVector size :: IO (Vector Double)
+      res <- withCString (gcfGenCache gen) $ \cache ->
+        gcf_get (realToFrac w) (fromIntegral $ gcfSize gcf) (fromIntegral over)
+                (realToFrac $ gcfGenT2 gen) cache (fromIntegral $ gcfGenLRU gen) p
+      when (res /= 0) $ fail $ "Failed to generate GCF: " ++ show res
+      return v
+
+  -- Drop layers we don't need for a quadrant GCF. The ones we keep
+  -- stay in the same order.
+  v <- if not (gcfQuadrant gcfp) then return v0 else do
+    let qover = over `div` 2 + 1
+    q <- allocCVector (qover * qover * layerSize)
+    forM_ [0..qover-1] $ \ov -> forM_ [0..qover-1] $ \ou ->
+      copyVector q ((ou + qover * ov) * layerSize) v0 ((ou + over * ov) * layerSize) layerSize
+    freeVector v0
+    return q
 
   -- Conjugate for negative w (= negate imaginary parts)
   when (low < -high) $ do
@@ -114,6 +187,39 @@ gcfKernel gcfp wdom guvdom =
 
   return (castVector v)
 
+-- | Makes a stack of GCFs for the multi-frequency synthesis gridder
+-- (see "gridKernelMFS"): Plane p is for |w| = p * wstep, all of them
+-- with the largest GCF size. We need GCFs for exactly these w, so we
+-- always generate them.
+gcfStackKernel :: GCFPar -> Int -> Double -> Kernel GCFs
+gcfStackKernel gcfp nplanes wstep =
+ mappingKernel "gcf stack" Z (gcfStackRepr gcfp nplanes) $ \_ _ -> do
+  gen <- case gcfGenerate gcfp of
+    Just gen | not (gcfQuadrant gcfp) && gcfOver gcfp == 8 -> return gen
+    _ -> fail "gcfStackKernel: GCF stacks require generate and oversampling 8, without quadrant!"
+  let size = gcfMaxSize gcfp
+      over = gcfOver gcfp
+      planeSize = 2 * over * over * size * size
+  v@(CVector _ p) <- allocCVector (nplanes * planeSize) :: IO (Vector Double)
+  forM_ [0..nplanes-1] $ \pl -> do
+    let w = fromIntegral pl * wstep
+    putStrLn $ "Generating GCF of size " ++ show size ++ " for w=" ++ show w
+    res <- withCString (gcfGenCache gen) $ \cache ->
+      gcf_get (realToFrac w) (fromIntegral size) (fromIntegral over)
+              (realToFrac $ gcfGenT2 gen) cache (fromIntegral $ gcfGenLRU gen)
+              (p `advancePtr` (pl * planeSize))
+    when (res /= 0) $ fail $ "Failed to generate GCF: " ++ show res
+  return (castVector v)
+
+-- | Frequencies of visibility channels, for the multi-frequency
+-- synthesis gridder. They do not need to be evenly spaced.
+channelsKernel :: [Double] -> Kernel Channels
+channelsKernel freqs =
+ mappingKernel "channels" Z (channelsRepr (length freqs)) $ \_ _ -> do
+  v <- allocCVector (length freqs) :: IO (Vector Double)
+  forM_ (zip [0..] freqs) $ uncurry (pokeVector v)
+  return (castVector v)
+
 imageWriter :: GridPar -> FilePath -> Flow Image -> Kernel ()
 imageWriter gp = halideDump (imageRepr gp)
 
@@ -0,0 +1,39 @@
+{-# LANGUAGE DataKinds #-}
+
+module Kernel.Weighting
+  ( weightsKernel, weightVisKernel
+  ) where
+
+import Data.Int
+
+import Flow.Builder
+import Flow.Halide
+
+import Kernel.Data
+
+-- For FFI
+import Data.Vector.HFixed.Class ()
+import Flow.Halide.Types ()
+
+-- | Calculate visibility weights per grid cell, according to the
+-- configured weighting scheme (see "Weighting"). This needs to see
+-- all visibilities of the data set, so it should run before binning.
+weightsKernel :: GridPar -> TDom -> Flow Vis -> Kernel Weights
+weightsKernel gp tdom =
+  halideKernel1 "weights" (rawVisRepr tdom) (weightsRepr gp) $
+  kern_weights `halideBind` gridScale gp
+               `halideBind` fromIntegral (weightingMode $ gridWeighting gp)
+               `halideBind` weightingRobust (gridWeighting gp)
+foreign import ccall unsafe kern_weights
+  :: HalideBind Double (HalideBind Int32 (HalideBind Double (
+     HalideFun '[RawVisRepr] WeightsRepr)))
+
+-- | Apply weights to visibilities. PSF visibilities get weighted
+-- just the same, so the PSF matches the weighted image.
+weightVisKernel :: GridPar -> UVDom -> WDom -> Flow Weights -> Flow Vis -> Kernel Vis
+weightVisKernel gp uvdom wdom =
+  halideKernel2 "weightVis" (weightsRepr gp) (visRepr uvdom wdom) (visRepr uvdom wdom) $
+  kern_weight_vis `halideBind` gridScale gp
+
+foreign import ccall unsafe kern_weight_vis
+  :: HalideBind Double (HalideFun '[WeightsRepr, VisRepr] VisRepr)
@@ -6,12 +6,14 @@ module Main where
 import Control.Monad
 
 import Data.List
+import Data.Maybe ( isNothing )
 import Data.Yaml
 
 import Flow
 import Flow.Builder ( rule )
 import Flow.Kernel
 
+import Kernel.Averaging
 import Kernel.Binning
 import Kernel.Cleaning
 import Kernel.Data
@@ -21,6 +23,7 @@ import Kernel.FFT
 import Kernel.Gridder
 import Kernel.IO
 import Kernel.Scheduling
+import Kernel.Weighting
 
 import System.Environment
 import System.Directory
@@ -39,6 +42,8 @@ degrid :: Flow GCFs -> Flow FullUVGrid -> Flow Vis -> Flow Vis
 degrid = flow "degrid"
 gcf :: Flow Vis -> Flow GCFs
 gcf = flow "gcf"
+rotation :: Flow Rotation
+rotation = flow "rotation"
 
 -- FFT
 dft :: Flow Image -> Flow FullUVGrid
@@ -64,6 +69,10 @@ splitModel = flow "model from cleaning"
 splitResidual :: Flow Cleaned -> Flow Image
 splitResidual = flow "residual from cleaning"
 
+-- Weighting
+weights :: Flow Vis -> Flow Weights
+weights = flow "weights"
+
 -- Compound actors
 gridder :: Flow Vis -> Flow Vis -> Flow Image
 gridder vis0 vis = idft (grid vis (gcf vis0) createGrid)
@@ -110,20 +119,93 @@ allCpuHints = ioHint:cpuHints
 -- | Implement one major iteration of continuum gridding (@loopIter@) for
 -- the given input 'Flow's over a number of datasets given by the data
 -- set domains @ddoms@. Internally, we will distribute twice over
--- @DDom@ and once over @UVDom@.
+-- @DDom@ and once over @UVDom@. If @isPsf@ is set, @vis@ must be the
+-- PSF visibilities for @vis0@, which allows us to grid them without
+-- materialising them first.
 continuumGridStrat :: Config -> [DDom] -> TDom -> [UVDom] -> [LMDom]
-                   -> Flow Index -> Flow Vis -> Flow Vis
+                   -> Flow Index -> Flow Vis -> Flow Vis -> Bool
                    -> Strategy (Flow Image)
 continuumGridStrat cfg [ddomss,ddoms,ddom] tdom [uvdoms,uvdom] [_lmdoms,lmdom]
-                   ixs vis0 vis
+                   ixs vis0 vis isPsf
  = implementing (summed vis0 vis) $ do
 
   -- Helpers
   let dkern :: IsKernelDef kf => kf -> kf
       dkern = regionKernel ddom
       gpar = cfgGrid cfg
-      gcfpar = cfgGCF cfg
       strat = cfgStrategy cfg
+      wstack = stratWStacking strat
+      weighted = gridWeighting gpar /= WeightNatural
+      soa = stratVisSoA strat
+      half = stratHalfPlane strat
+      bda = gridBDASmear gpar > 0
+      fused = stratFusedResidual strat
+      fusedRot = stratFusedRotation strat
+      (_, _, _, _, _, _, doRep) = rotateParams cfg
+      -- Dedicated PSF gridder. Only replaces the plain CPU gridder,
+      -- which uses the same GCFs, so the PSF still matches the image.
+      -- Like the gridder, it only exists for an oversampling of 8.
+      psfDirect = isPsf && not (wstack || half || soa || bda) &&
+                  stratGridder strat == GridKernelCPU && gcfOver gcfpar == 8
+      gcfpar | wstack    = gcfNoW (cfgGCF cfg)
+             | otherwise = cfgGCF cfg
+
+  -- With w-stacking the gridder produces the facet image directly,
+  -- so there is no grid to detile.
+  when (wstack && gridTiles gpar /= 1) $
+    fail "continuumGridStrat: w-stacking requires uv-tiles: 1!"
+  -- The degridder would get the w=0 GCFs as well, so the model would
+  -- be predicted without w-term. Only the PSF is safe for now.
+  when (wstack && cfgLoops cfg > 0) $
+    fail "continuumGridStrat: w-stacking does not support major loops yet (use loops: 0)!"
+  -- Structure-of-arrays visibilities only have kernels for
+  -- w-projection and natural weighting so far.
+  when (soa && (wstack || weighted)) $
+    fail "continuumGridStrat: vis_soa does not support w-stacking or weighting!"
+  -- The half-plane grid is a single grid going straight to the
+  -- inverse FFT, so it can not be tiled.
+  when (half && (gridTiles gpar /= 1 || wstack || soa)) $
+    fail "continuumGridStrat: half_plane requires uv-tiles: 1 and no w-stacking or vis_soa!"
+  when (bda && soa) $
+    fail "continuumGridStrat: bda-smear does not support vis_soa!"
+  -- Averaging must not cross baselines, so it needs to know where
+  -- they start.
+  when (bda && (gridBDATimes gpar <= 0 || cfgPoints cfg `mod` gridBDATimes gpar /= 0)) $
+    fail "continuumGridStrat: bda-smear requires bda-times to be the number of time steps per baseline!"
+  -- Averaged visibilities carry their run length in their amplitude
+  -- (see "bdaKernel"). Weights would get counted per averaged
+  -- visibility, and the degridder would subtract the model only once
+  -- per run.
+  when (bda && (weighted || cfgLoops cfg > 0)) $
+    fail "continuumGridStrat: bda-smear requires natural weighting and loops: 0!"
+  -- The fused residual kernel grids degridded visibilities
+  -- directly, so there is no chance to weight them in-between. It
+  -- replaces both the plain CPU gridder and degridder, and only
+  -- exists for an oversampling of 8 (see scatter.cpp).
+  when (fused && (weighted || wstack || half || soa || gcfOver gcfpar /= 8 ||
+                  stratGridder strat /= GridKernelCPU || stratDegridder strat /= DegridKernelCPU)) $
+    fail "continuumGridStrat: fused_residual requires natural weighting, gcf over: 8, gridder_type: cpu, degridder_type: cpu and no w-stacking, half_plane or vis_soa!"
+  -- Rotating in the degridder means that everything else sees
+  -- unrotated visibilities. That is only okay as long as we do not
+  -- reproject, as otherwise binning would need the rotated UVWs. The
+  -- rotating kernels only exist for an oversampling of 8.
+  when (fusedRot && (soa || doRep /= 0 || gcfOver gcfpar /= 8 || stratDegridder strat /= DegridKernelCPU)) $
+    fail "continuumGridStrat: fused_rotation requires degridder_type: cpu, gcf over: 8, no vis_soa and no reprojection!"
+  -- The GCF files we ship (gcf*.dat) are oversampled by 8, so other
+  -- factors need generated GCFs. Of the gridders, only the plain and
+  -- quadrant kernels exist for other factors (see scatter.cpp), and
+  -- the parallel gridder needs strip kernels.
+  when (gcfOver gcfpar /= 8 && isNothing (gcfGenerate gcfpar)) $
+    fail "continuumGridStrat: gcf over other than 8 requires generate, GCF files are for over 8!"
+  when (gcfOver gcfpar /= 8 && stratGridder strat == GridKernelCPUPar) $
+    fail "continuumGridStrat: gridder_type: cpu_par requires gcf over: 8!"
+  -- The parallel degridder only handles double-precision,
+  -- single-polarisation visibilities as records, and only exists for
+  -- an oversampling of 8 (see degrid.cpp). Neither full polarisation
+  -- nor single precision can be selected here, but vis_soa would
+  -- silently replace it with the sequential SoA degridder.
+  when (stratDegridder strat == DegridKernelCPUPar && (soa || gcfOver gcfpar /= 8)) $
+    fail "continuumGridStrat: degridder_type: cpu_par requires gcf over: 8 and no vis_soa!"
 
   -- Intermediate Flow nodes
   let gridded = grid vis (gcf vis0) createGrid -- grid from vis
@@ -147,11 +229,20 @@ continuumGridStrat cfg [ddomss,ddoms,ddom] tdom [uvdoms,uvdom] [_lmdoms,lmdom]
 
         -- Read in visibilities
         rebind ixs $ scheduleSplit ddomss ddom
+        let reader | soa       = oskarReaderSoA
+                   | otherwise = oskarReader
         bind vis0 $ hints [ioHint{hintReadBytes = cfgPoints cfg * 5 * 8 {-sizeof double-}}] $
-          oskarReader ddom tdom (cfgInput cfg) 0 0 ixs
+          reader ddom tdom (cfgInput cfg) 0 0 ixs
+
+        -- Average visibilities. Needs to happen before we size bins,
+        -- as it reduces the number of visibilities we will bin.
+        when bda $
+          rebind vis0 $ dkern $ hints cpuHints $ bdaKernel gpar isPsf tdom
 
         -- Create w-binned domain, split
-        wdoms <- makeBinDomain $ dkern $ binSizer gpar tdom uvdom vis0
+        let sizer | soa       = binSizerSoA
+                  | otherwise = binSizer
+        wdoms <- makeBinDomain $ dkern $ sizer gpar tdom uvdom vis0
         wdom <- split wdoms (gridBins gpar)
 
         -- Create GCF u/v domains
@@ -167,30 +258,83 @@ continuumGridStrat cfg [ddomss,ddoms,ddom] tdom [uvdoms,uvdom] [_lmdoms,lmdom]
           bindRule gcf $ rkern $ const $ hints allCpuHints $ gcfKernel gcfpar wdom guvdom
           distribute wdom SeqSchedule $ calculate $ gcf vis0
 
-          -- Rotate visibilities
-          rebind vis0 $ dkern $ hints cpuHints $ rotateKernel cfg lmdom tdom
+          -- Rotate visibilities. Alternatively we just calculate
+          -- rotation parameters, and leave it to the degridder.
+          let rotate | soa       = rotateKernelSoA
+                     | otherwise = rotateKernel
+          if fusedRot then bind rotation $ dkern $ rotateParamsKernel cfg lmdom
+          else rebind vis0 $ dkern $ hints cpuHints $ rotate cfg lmdom tdom
+
+          -- Calculate weights. Needs all visibilities, so do it before binning.
+          when weighted $
+            bind (weights vis0) $ rkern $ hints cpuHints $ weightsKernel gpar tdom vis0
 
           -- Bin visibilities (could distribute, but there's no benefit)
-          rebind vis0 $ rkern $ hints allCpuHints $ binner gpar tdom uvdom wdom
+          let binner' | soa       = binnerSoA
+                      | otherwise = binner
+          rebind vis0 $ rkern $ hints allCpuHints $ binner' gpar tdom uvdom wdom
 
           -- Degrid / generate PSF (depending on vis)
           rule degrid $ \(gcfs :. uvgrid :. vis' :. Z) -> do
             rebind uvgrid $ distributeGrid ddomss ddom lmdom gpar
             bind (degrid gcfs uvgrid vis') $ rkern $
-              degridKernel (stratDegridder strat) gpar gcfpar uvdom wdom guvdom gcfs uvgrid vis'
-          bindRule psfVis $ rkern $ psfVisKernel uvdom wdom
-          calculate vis
+              if soa then degridKernelSoA gpar gcfpar uvdom wdom guvdom gcfs uvgrid vis'
+              else if fusedRot then degridKernelRot gpar gcfpar uvdom wdom guvdom rotation gcfs uvgrid vis'
+              else degridKernel (stratDegridder strat) gpar gcfpar uvdom wdom guvdom gcfs uvgrid vis'
+          bindRule psfVis $ rkern $
+            if soa then psfVisKernelSoA uvdom wdom
+            else if bda then bdaPsfVisKernel uvdom wdom
+            else psfVisKernel uvdom wdom
+          unless (fused || psfDirect) $ calculate vis
+
+          -- Weight visibilities (including PSF visibilities, unless
+          -- the PSF gridder does it for us)
+          when (weighted && not psfDirect) $
+            rebind vis $ rkern $ weightVisKernel gpar uvdom wdom (weights vis0)
 
           -- Gridding
-          bind createGrid $ rkern $ gridInit gcfpar uvdom
-          bindRule grid $ rkern $ gridKernel (stratGridder strat) gpar gcfpar uvdoms wdom guvdom uvdom
-          calculate gridded
+          if wstack then do
+            bind createImage $ rkern $ facetInit gpar
+            bind (idft gridded) $ rkern $ hints cpuHints $
+              wstackKernel gpar gcfpar uvdom wdom guvdom vis (gcf vis0) createImage
+            calculate $ idft gridded
+          else if psfDirect then do
+            bind createGrid $ rkern $ gridInit gcfpar uvdom
+            bind gridded $ rkern $
+              if weighted
+              then psfGridKernelWeighted gpar gcfpar uvdoms wdom guvdom uvdom (weights vis0) vis0 (gcf vis0) createGrid
+              else psfGridKernel gpar gcfpar uvdoms wdom guvdom uvdom vis0 (gcf vis0) createGrid
+            calculate gridded
+          else if half then do
+            bind createGrid $ rkern $ gridInitHalf gpar gcfpar
+            bindRule grid $ rkern $ gridKernelHalf gpar gcfpar uvdoms wdom guvdom
+            calculate gridded
+          else do
+            bind createGrid $ rkern $ gridInit gcfpar uvdom
+            bindRule grid $ rkern $
+              if soa then gridKernelSoA gpar gcfpar uvdoms wdom guvdom uvdom
+              else gridKernel (stratGridder strat) gpar gcfpar uvdoms wdom guvdom uvdom
+            -- Grid residuals straight from the model grid. Takes
+            -- precedence over the rules above, but only matches when
+            -- we are gridding degridded visibilities (not the PSF).
+            when fused $
+              rule (\gcfs uvgrid vis' gcfs' g -> grid (degrid gcfs uvgrid vis') gcfs' g) $
+                \(gcfs :. uvgrid :. vis' :. gcfs' :. g :. Z) -> do
+                  rebind uvgrid $ distributeGrid ddomss ddom lmdom gpar
+                  bind (grid (degrid gcfs uvgrid vis') gcfs' g) $ rkern $
+                    if fusedRot then degridGridKernelRot gpar gcfpar uvdom wdom guvdom rotation gcfs uvgrid vis' g
+                    else degridGridKernel gpar gcfpar uvdom wdom guvdom gcfs uvgrid vis' g
+            calculate gridded
 
         -- Compute the result by detiling & iFFT on tiles
-        bind createGrid $ rkern $ gridInitDetile uvdoms
-        bind gridded $ rkern $ gridDetiling gcfpar uvdom uvdoms gridded createGrid
-        bindRule idft $ rkern $ hints cpuHints $ ifftKern gpar uvdoms
-        calculate $ idft gridded
+        when half $ do
+          bindRule idft $ rkern $ hints cpuHints $ ifftKernHalf (stratFFT strat) gpar gcfpar
+          calculate $ idft gridded
+        unless (wstack || half) $ do
+          bind createGrid $ rkern $ gridInitDetile uvdoms
+          bind gridded $ rkern $ gridDetiling gcfpar uvdom uvdoms gridded createGrid
+          bindRule idft $ rkern $ hints cpuHints $ ifftKern (stratFFT strat) gpar uvdoms
+          calculate $ idft gridded
 
       -- Sum up facets
       bind createImage $ dkern $ imageInit gpar
@@ -208,7 +352,7 @@ continuumGridStrat cfg [ddomss,ddoms,ddom] tdom [uvdoms,uvdom] [_lmdoms,lmdom]
   bind createImage $ regionKernel ddomss $ imageInit gpar
   bind summed' $ imageSum gpar ddoms ddomss summed' createImage
 
-continuumGridStrat _ _ _ _ _ _ _ _ = fail "continuumGridStrat: Not enough domain splits provided!"
+continuumGridStrat _ _ _ _ _ _ _ _ _ = fail "continuumGridStrat: Not enough domain splits provided!"
 
 majorIterationStrat :: Config -> [DDom] -> TDom -> [UVDom] -> [LMDom]
                    -> Flow Index -> Flow Vis -> Flow Image
@@ -217,13 +361,13 @@ majorIterationStrat cfg ddom_s tdom uvdom_s lmdom_s ixs vis mdl = do
 
   -- Calculate model grid using FFT (once)
   let gpar = cfgGrid cfg
-  bindRule dft $ regionKernel (head ddom_s) $ hints allCpuHints $ fftKern gpar
+  bindRule dft $ regionKernel (head ddom_s) $ hints allCpuHints $ fftKern (stratFFT $ cfgStrategy cfg) gpar
   calculate (dft mdl)
 
   -- Do continuum gridding for degridded visibilities. The actual
   -- degridding will be done in the inner loop, see continuumGridStrat.
   let vis' = degridModel vis mdl
-  void $ continuumGridStrat cfg ddom_s tdom uvdom_s lmdom_s ixs vis vis'
+  void $ continuumGridStrat cfg ddom_s tdom uvdom_s lmdom_s ixs vis vis' False
 
   -- Clean
   let cpar = cfgClean cfg
@@ -274,7 +418,7 @@ continuumStrat cfg = do
   let uvdom_s = [(udoms, vdoms), (udom, vdom)]
 
   -- Compute PSF
-  psfFlow <- continuumGridStrat cfg ddom_s tdom uvdom_s lmdom_s ixs vis (psfVis vis)
+  psfFlow <- continuumGridStrat cfg ddom_s tdom uvdom_s lmdom_s ixs vis (psfVis vis) True
   void $ bindNew $ regionKernel ddomss $ imageWriter gpar "psf.img" psfFlow
 
   -- Major loops
@@ -117,7 +117,7 @@ gridderStrat cfg = do
     -- Compute the result by detiling & iFFT on result tiles
     bind createGrid (rkern $ gridInitDetile uvdoms)
     bind gridded (rkern $ gridDetiling gcfpar uvdom uvdoms gridded createGrid)
-    bindRule idft (rkern $ hints [floatHint] $ ifftKern gpar uvdoms)
+    bindRule idft (rkern $ hints [floatHint] $ ifftKern FFTKernelCPU gpar uvdoms)
     calculate facets
 
   -- Write out
@@ -135,9 +135,15 @@ main = do
                      , gridFacets = 3
                      , gridTiles  = 1
                      , gridBins   = 10
+                     , gridWeighting = WeightNatural
+                     , gridBDASmear = 0
+                     , gridBDAMaxRun = 16
+                     , gridBDATimes = 0
                      }
       gcfpar = GCFPar { gcfFiles = [GCFFile "gcf0.dat" 16 0]
                       , gcfOver = 8
+                      , gcfGenerate = Nothing
+                      , gcfQuadrant = False
                       }
       config = defaultConfig
         { cfgInput  = [OskarInput "test_p00_s00_f00.vis" 1 1]
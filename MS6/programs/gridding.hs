@@ -96,7 +96,7 @@ gridderStrat cfg = do
   -- Compute the result by detiling & iFFT on result tiles
   bind createGrid (dkern $ gridInitDetile uvdoms)
   bind gridded (dkern $ gridDetiling gcfpar uvdom uvdoms gridded createGrid)
-  bindRule idft (dkern $ ifftKern gpar uvdoms)
+  bindRule idft (dkern $ ifftKern FFTKernelCPU gpar uvdoms)
   calculate result
 
   -- Write out
@@ -112,9 +112,15 @@ main = do
                      , gridFacets = 1
                      , gridTiles = 2
                      , gridBins = 10
+                     , gridWeighting = WeightNatural
+                     , gridBDASmear = 0
+                     , gridBDAMaxRun = 16
+                     , gridBDATimes = 0
                      }
       gcfpar = GCFPar { gcfFiles = [GCFFile "gcf0.dat" 16 0]
                       , gcfOver = 8
+                      , gcfGenerate = Nothing
+                      , gcfQuadrant = False
                       }
       config = defaultConfig
         { cfgInput  = [OskarInput "test_p00_s00_f00.vis" 1 1]
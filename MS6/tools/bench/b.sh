@@ -6,3 +6,60 @@ export HALIDE_OPTS="-I$HALIDE_LOC/../include -L$HALIDE_LOC"
 g++ $HALIDE_OPTS -Wall -std=c++11 -O2 -o generate_all_halide generate_all_halide.cpp scatter_halide.cpp -lHalide
 ./generate_all_halide kernels_halide
 g++ $HALIDE_OPTS -Wall -std=c++11 -O2 -o bin_gridder bin_gridder.cpp kernels_halide_gpu.o -lHalide -ldl -lpthread
+
+# Mixed precision CPU kernels: accuracy vs. speed
+export GRIDDING=../../kernel/cpu/gridding
+g++ $HALIDE_OPTS -Wall -std=c++11 -O2 -I$GRIDDING -o gen_scatter $GRIDDING/scatter.cpp -lHalide -ldl -lpthread
+g++ $HALIDE_OPTS -Wall -std=c++11 -O2 -I$GRIDDING -o gen_degrid $GRIDDING/degrid.cpp -lHalide -ldl -lpthread
+./gen_scatter kern_scatters.o
+./gen_degrid kern_degrids.o
+g++ -Wall -std=c++11 -O2 -I../../kernel/common -o mixed_precision mixed_precision.cpp $GRIDDING/scatter1.cpp $GRIDDING/degrid1.cpp kern_scatters.o kern_degrids.o -ldl -lpthread
+./mixed_precision
+
+# Parallel degridder vs. sequential one
+g++ -Wall -std=c++11 -O2 -I../../kernel/common -o degrid_par degrid_par.cpp $GRIDDING/scatter1.cpp $GRIDDING/degrid1.cpp kern_scatters.o kern_degrids.o -ldl -lpthread
+for t in 1 2 4 8 16; do HL_NUM_THREADS=$t ./degrid_par; done
+
+# Full polarisation kernels vs. one pass per polarisation
+g++ -Wall -std=c++11 -O2 -I../../kernel/common -o pol4 pol4.cpp $GRIDDING/scatter1.cpp $GRIDDING/degrid1.cpp kern_scatters.o kern_degrids.o -ldl -lpthread
+./pol4
+
+# Fused residual gridder vs. degridding and gridding separately
+g++ -Wall -std=c++11 -O2 -I../../kernel/common -o resid resid.cpp $GRIDDING/scatter1.cpp $GRIDDING/degrid1.cpp kern_scatters.o kern_degrids.o -ldl -lpthread
+./resid
+
+# Quadrant GCF gridder vs. plain one
+g++ -Wall -std=c++11 -O2 -I../../kernel/common -o quadrant quadrant.cpp $GRIDDING/scatter1.cpp ../../kernel/cpu/gcf/gcf_cache.cpp kern_scatters.o -lfftw3_threads -lfftw3 -ldl -lpthread
+./quadrant
+
+# Image-domain gridder vs. convolutional one
+g++ -Wall -std=c++11 -O2 -I../../kernel/common -I$GRIDDING -o idg idg.cpp $GRIDDING/scatter1.cpp $GRIDDING/scatter_idg.cpp kern_scatters.o -lfftw3 -ldl -lpthread
+./idg
+
+# Overhead of uniform/Briggs weighting relative to gridding
+g++ $HALIDE_OPTS -Wall -std=c++11 -O2 -I$GRIDDING -o gen_weight_vis $GRIDDING/weight_vis.cpp -lHalide -ldl -lpthread
+./gen_weight_vis kern_weight_vis.o
+g++ -Wall -std=c++11 -O2 -I../../kernel/common -o weighting weighting.cpp $GRIDDING/scatter1.cpp $GRIDDING/weights.cpp kern_scatters.o kern_weight_vis.o -ldl -lpthread
+./weighting
+
+# Multi-threaded FFTs vs. single-threaded ones, scaling with threads
+g++ $HALIDE_OPTS -Wall -std=c++11 -O2 -o gen_fft $GRIDDING/fft.cpp -lHalide -ldl -lpthread
+./gen_fft kern_ffts.o
+g++ -Wall -std=c++11 -O2 -I../../kernel/common -o fft_par fft_par.cpp $GRIDDING/fft1.cpp $GRIDDING/fft_dyn.cpp kern_ffts.o -lfftw3_threads -lfftw3 -ldl -lpthread
+for t in 1 2 4 8 16; do HL_NUM_THREADS=$t ./fft_par 4096 8192; done
+
+# FFTW wisdom reuse: The second run has to find the plans of the first
+g++ -Wall -std=c++11 -O2 -I../../kernel/common -o fft_wisdom fft_wisdom.cpp $GRIDDING/fft_dyn.cpp -lfftw3_threads -lfftw3 -ldl -lpthread
+rm -f fft_wisdom.dat
+MS6_FFTW_WISDOM=$PWD/fft_wisdom.dat ./fft_wisdom 4096
+MS6_FFTW_WISDOM=$PWD/fft_wisdom.dat ./fft_wisdom 4096 0.5
+
+# W-stacking vs. w-projection
+g++ $HALIDE_OPTS -Wall -std=c++11 -O2 -o gen_wstack $GRIDDING/wstack.cpp -lHalide -ldl -lpthread
+./gen_wstack kern_wstack.o
+g++ -Wall -std=c++11 -O2 -I../../kernel/common -o wstack wstack.cpp $GRIDDING/scatter1.cpp $GRIDDING/fft1.cpp $GRIDDING/fft_dyn.cpp $GRIDDING/wstack1.cpp ../../kernel/cpu/gcf/gcf_cache.cpp kern_scatters.o kern_ffts.o kern_wstack.o -lfftw3_threads -lfftw3 -ldl -lpthread
+./wstack
+
+# Multi-frequency synthesis vs. gridding every channel on its own
+g++ -Wall -std=c++11 -O2 -I../../kernel/common -o mfs mfs.cpp $GRIDDING/scatter1.cpp $GRIDDING/scatter_mfs1.cpp ../../kernel/cpu/gcf/gcf_cache.cpp kern_scatters.o -lfftw3_threads -lfftw3 -ldl -lpthread
+./mfs
@@ -0,0 +1,111 @@
+// Speed and accuracy of the parallel degridder ("kern_degrid_par")
+// against the sequential one. Uses the same benchmark data as
+// bin_gridder. Set HL_NUM_THREADS to control the number of threads,
+// see b.sh for scaling.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <fstream>
+#include <chrono>
+
+#include <algorithm>
+#include <vector>
+#include <complex>
+
+#include "halide_buf.h"
+
+#include "mkHalideBuf.h"
+#include "cfg.h"
+
+extern "C" {
+int kern_scatter(const double, const int32_t, const int32_t, buffer_t *, buffer_t *, buffer_t *);
+#define __DEGRID(name) int name(const double, const int32_t, const int32_t, buffer_t *, buffer_t *, buffer_t *, buffer_t *);
+__DEGRID(kern_degrid)
+__DEGRID(kern_degrid_par)
+}
+
+using namespace std;
+
+typedef complex<double> complexd;
+
+const int over2 = over*over;
+const int gcf_storage_size = over2 * gcf_size * gcf_size;
+const int full_size = grid_size * grid_size;
+const int num_of_vis = num_baselines * num_times;
+const int vis_fields = 5;
+
+// v should be preallocated with right size
+template <typename T>
+int readFileToVector(vector<T> & v, const char * fname){
+  ifstream is(fname, ios::binary);
+  if (is.fail()) {
+    printf("Can't open %s.\n", fname);
+    return -1;
+  }
+  is.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(T));
+  if (is.fail()) {
+    printf("Can't read %s.\n", fname);
+    return -2;
+  }
+  return 0;
+}
+
+// Runs the given action, returns wall clock time in seconds
+template <typename F>
+double timeIt(F f) {
+  auto start = chrono::high_resolution_clock::now();
+  f();
+  chrono::duration<double> d = chrono::high_resolution_clock::now() - start;
+  return d.count();
+}
+
+#define __CK if (res < 0) { printf("Err: %d\n", res); return res; }
+
+int main(/* int argc, char * argv[] */)
+{
+  int res;
+
+  printf("Read visibilities and GCF!\n");
+  vector<double> vis(num_of_vis * vis_fields);
+  res = readFileToVector(vis, "vis.dat"); __CK
+  #define __STR(a) #a
+  #define __GCF_PATH(sz) "gcf" __STR(sz) ".dat"
+  vector<complexd> gcf(gcf_storage_size);
+  res = readFileToVector(gcf, __GCF_PATH(GCF_SIZE)); __CK
+
+  buffer_t
+      vis_buffer = mkHalideBuf<double>(num_of_vis, vis_fields)
+    , gcf_buffer = mkHalideBuf<double>(over2, gcf_size, gcf_size, 2)
+    , uvg_buffer = mkHalideBuf<double>(grid_size, grid_size, 2)
+    , out_buffer = mkHalideBuf<double>(num_of_vis, vis_fields)
+    ;
+  vis_buffer.host = tohost(vis.data());
+  gcf_buffer.host = tohost(gcf.data());
+
+  // Make a grid to degrid from
+  vector<double> uvg(2 * full_size, 0.0);
+  uvg_buffer.host = tohost(uvg.data());
+  res = kern_scatter(t2, grid_size, gcf_size, &vis_buffer, &gcf_buffer, &uvg_buffer); __CK
+
+  printf("Degridding %d visibilities, GCF size %d, grid size %d\n", num_of_vis, gcf_size, grid_size);
+  const char * threads = getenv("HL_NUM_THREADS");
+  printf("Threads: %s\n", threads ? threads : "default");
+  vector<double> ref(vis.size()), out(vis.size());
+  out_buffer.host = tohost(ref.data());
+  double tref = timeIt([&]{ res = kern_degrid(t2, grid_size, gcf_size, &gcf_buffer, &uvg_buffer, &vis_buffer, &out_buffer); }); __CK
+  out_buffer.host = tohost(out.data());
+  double t = timeIt([&]{ res = kern_degrid_par(t2, grid_size, gcf_size, &gcf_buffer, &uvg_buffer, &vis_buffer, &out_buffer); }); __CK
+
+  // Summation order differs, so compare relative to the largest
+  // residual of the reference.
+  double maxRef = 0, maxErr = 0;
+  for (size_t i = 0; i < ref.size(); i++) {
+    maxRef = max(maxRef, fabs(ref[i]));
+    maxErr = max(maxErr, fabs(out[i] - ref[i]));
+  }
+  if (maxRef == 0) maxRef = 1;
+  printf("%-16s %8.3f s\n", "kern_degrid", tref);
+  printf("%-16s %8.3f s  x%5.2f  max err %9.3e\n", "kern_degrid_par", t, tref / t, maxErr / maxRef);
+  return 0;
+}
@@ -0,0 +1,118 @@
+// Speed and accuracy of the multi-threaded FFT kernels
+// ("kern_ifft_par", "kern_fft_par") against the single-threaded
+// ones. Set HL_NUM_THREADS to control the number of threads, see b.sh
+// for a scaling run. Also checks inverse FFTs producing only a centred
+// window of half the image size (see "ifftPruned" in fft_dyn.cpp)
+// against the matching region of the full "kern_ifft" image.
+//
+// Usage: fft_par [grid size ...]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+
+#include <algorithm>
+#include <vector>
+
+#include "halide_buf.h"
+
+#include "mkHalideBuf.h"
+
+extern "C" {
+int kern_ifft(buffer_t *, buffer_t *);
+int kern_ifft_par(buffer_t *, buffer_t *);
+int kern_fft(buffer_t *, buffer_t *);
+int kern_fft_par(buffer_t *, buffer_t *);
+}
+
+using namespace std;
+
+// Runs the given action once to warm up (thread pools, page faults
+// on the output), then returns the best wall clock time in seconds
+// out of "runs" runs
+template <typename F>
+double timeBest(int runs, F f) {
+  f();
+  double best = 0;
+  for (int i = 0; i < runs; i++) {
+    auto start = chrono::high_resolution_clock::now();
+    f();
+    chrono::duration<double> d = chrono::high_resolution_clock::now() - start;
+    if (i == 0 || d.count() < best) best = d.count();
+  }
+  return best;
+}
+
+// Maximum difference relative to the largest value of the reference
+double relErr(const vector<double> & ref, const vector<double> & out) {
+  double maxRef = 0, maxErr = 0;
+  for (size_t i = 0; i < ref.size(); i++) {
+    maxRef = max(maxRef, fabs(ref[i]));
+    maxErr = max(maxErr, fabs(out[i] - ref[i]));
+  }
+  return maxErr / (maxRef == 0 ? 1 : maxRef);
+}
+
+#define __CK if (res < 0) { printf("Err: %d\n", res); return res; }
+
+int main(int argc, char * argv[])
+{
+  vector<int> sizes;
+  for (int i = 1; i < argc; i++) sizes.push_back(atoi(argv[i]));
+  if (sizes.empty()) sizes = { 2048, 4096, 8192 };
+  const int runs = 5;
+  const char * threads = getenv("HL_NUM_THREADS");
+  printf("Threads: %s\n", threads ? threads : "default");
+
+  for (int size : sizes) {
+    int res;
+    const size_t full_size = size_t(size) * size;
+    buffer_t
+        img_buffer = mkHalideBuf<double>(size, size)
+      , uvg_buffer = mkHalideBuf<double>(size, size, 2)
+      ;
+
+    // Random image, so every frequency contributes
+    vector<double> img(full_size);
+    srand48(size);
+    for (double & x : img) x = drand48() - 0.5;
+
+    vector<double> uvg_ref(2 * full_size), uvg(2 * full_size);
+    img_buffer.host = tohost(img.data());
+    uvg_buffer.host = tohost(uvg_ref.data());
+    double tfft_ref = timeBest(runs, [&]{ res = kern_fft(&img_buffer, &uvg_buffer); }); __CK
+    uvg_buffer.host = tohost(uvg.data());
+    double tfft = timeBest(runs, [&]{ res = kern_fft_par(&img_buffer, &uvg_buffer); }); __CK
+
+    vector<double> img_ref(full_size), img_out(full_size);
+    uvg_buffer.host = tohost(uvg_ref.data());
+    img_buffer.host = tohost(img_ref.data());
+    double tifft_ref = timeBest(runs, [&]{ res = kern_ifft(&uvg_buffer, &img_buffer); }); __CK
+    img_buffer.host = tohost(img_out.data());
+    double tifft = timeBest(runs, [&]{ res = kern_ifft_par(&uvg_buffer, &img_buffer); }); __CK
+
+    // Centred window of half the size in either direction
+    const int wsize = size / 2, woff = size / 4;
+    buffer_t win_buffer = mkHalideBuf<double>(wsize, wsize);
+    win_buffer.min[0] = win_buffer.min[1] = woff;
+    vector<double> win_ref(size_t(wsize) * wsize), win(size_t(wsize) * wsize);
+    for (int v = 0; v < wsize; v++)
+      for (int u = 0; u < wsize; u++)
+        win_ref[size_t(v) * wsize + u] = img_ref[size_t(v + woff) * size + u + woff];
+    win_buffer.host = tohost(win.data());
+    double twin = timeBest(runs, [&]{ res = kern_ifft(&uvg_buffer, &win_buffer); }); __CK
+    double ewin = relErr(win_ref, win);
+    double twin_par = timeBest(runs, [&]{ res = kern_ifft_par(&uvg_buffer, &win_buffer); }); __CK
+    double ewin_par = relErr(win_ref, win);
+
+    printf("%dx%d\n", size, size);
+    printf("  %-14s %8.3f s\n", "kern_fft", tfft_ref);
+    printf("  %-14s %8.3f s  x%5.2f  max err %9.3e\n", "kern_fft_par", tfft, tfft_ref / tfft, relErr(uvg_ref, uvg));
+    printf("  %-14s %8.3f s\n", "kern_ifft", tifft_ref);
+    printf("  %-14s %8.3f s  x%5.2f  max err %9.3e\n", "kern_ifft_par", tifft, tifft_ref / tifft, relErr(img_ref, img_out));
+    printf("  %-14s %8.3f s  x%5.2f  max err %9.3e  (%dx%d window)\n", "kern_ifft", twin, tifft_ref / twin, ewin, wsize, wsize);
+    printf("  %-14s %8.3f s  x%5.2f  max err %9.3e  (%dx%d window)\n", "kern_ifft_par", twin_par, tifft_ref / twin_par, ewin_par, wsize, wsize);
+  }
+  return 0;
+}
@@ -0,0 +1,86 @@
+// Planning time of the tuned FFTW kernels ("kern_ifft_fftw",
+// "kern_fft_fftw"). The first call of every kernel plans, later ones
+// only execute, so the difference is the planning time. Run it twice
+// with the same MS6_FFTW_WISDOM file (see fft_dyn.cpp): The first run
+// pays for measuring and writes wisdom, the second one should reuse
+// it and plan in next to no time. Given a limit in seconds, we fail if
+// planning took longer than that.
+//
+// Usage: fft_wisdom <grid size> [max planning seconds]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+
+#include <algorithm>
+#include <vector>
+
+#include "halide_buf.h"
+
+#include "mkHalideBuf.h"
+
+extern "C" {
+int kern_ifft_fftw(buffer_t *, buffer_t *);
+int kern_fft_fftw(buffer_t *, buffer_t *);
+}
+
+using namespace std;
+
+// Runs the given action, returns wall clock time in seconds
+template <typename F>
+double timeIt(F f) {
+  auto start = chrono::high_resolution_clock::now();
+  f();
+  chrono::duration<double> d = chrono::high_resolution_clock::now() - start;
+  return d.count();
+}
+
+// Time of the first call minus the best of the following ones
+template <typename F>
+double planTime(F f) {
+  const int runs = 3;
+  double first = timeIt(f), best = 0;
+  for (int i = 0; i < runs; i++) {
+    double t = timeIt(f);
+    if (i == 0 || t < best) best = t;
+  }
+  return max(0.0, first - best);
+}
+
+#define __CK if (res < 0) { printf("Err: %d\n", res); return res; }
+
+int main(int argc, char * argv[])
+{
+  if (argc < 2) {
+    printf("Usage: %s <grid size> [max planning seconds]\n", argv[0]);
+    return 1;
+  }
+  const int size = atoi(argv[1]);
+  const double maxPlan = argc > 2 ? atof(argv[2]) : -1;
+  const size_t full_size = size_t(size) * size;
+  int res = 0;
+
+  buffer_t
+      img_buffer = mkHalideBuf<double>(size, size)
+    , uvg_buffer = mkHalideBuf<double>(size, size, 2)
+    ;
+  vector<double> img(full_size), uvg(2 * full_size);
+  srand48(size);
+  for (double & x : img) x = drand48() - 0.5;
+  img_buffer.host = tohost(img.data());
+  uvg_buffer.host = tohost(uvg.data());
+
+  double tfft = planTime([&]{ res = kern_fft_fftw(&img_buffer, &uvg_buffer); }); __CK
+  double tifft = planTime([&]{ res = kern_ifft_fftw(&uvg_buffer, &img_buffer); }); __CK
+
+  const char * wisdom = getenv("MS6_FFTW_WISDOM");
+  printf("%dx%d, wisdom %s\n", size, size, wisdom ? wisdom : "default");
+  printf("  %-14s planning %8.3f s\n", "kern_fft_fftw", tfft);
+  printf("  %-14s planning %8.3f s\n", "kern_ifft_fftw", tifft);
+  if (maxPlan >= 0 && tfft + tifft > maxPlan) {
+    printf("Planning took longer than %g s, wisdom was not reused!\n", maxPlan);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,119 @@
+// Checks the image-domain gridder ("kern_scatter_idg") against the
+// convolutional one ("kern_scatter"). We grid clusters of
+// visibilities at integer grid positions with w = 0, using a Gaussian
+// GCF, so both kernels should produce the same grid: IDG has to place
+// every visibility at the right cell and apply the GCF taper. IDG only
+// uses the amplitude of the taper, so expect errors about as large as
+// the negative ripples of the truncated Gaussian's taper. Visibilities
+// scattered all over the grid can not share subgrids, so IDG falls
+// back to "kern_scatter" for them.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+#include <algorithm>
+#include <vector>
+#include <complex>
+
+#include "halide_buf.h"
+
+#include "mkHalideBuf.h"
+#include "cfg.h"
+
+extern "C" {
+#define __SCATTER(name) int name(const double, const int32_t, const int32_t, buffer_t *, buffer_t *, buffer_t *);
+__SCATTER(kern_scatter)
+__SCATTER(kern_scatter_idg)
+}
+
+using namespace std;
+
+typedef complex<double> complexd;
+
+const int over2 = over*over;
+const int gcf_storage_size = over2 * gcf_size * gcf_size;
+const int full_size = grid_size * grid_size;
+const int num_of_clusters = 16;
+const int cluster_size = 16;
+const int num_of_vis = num_of_clusters * cluster_size;
+const int vis_fields = 5;
+
+#define __CK if (res < 0) { printf("Err: %d\n", res); return res; }
+
+int main(/* int argc, char * argv[] */)
+{
+  int res;
+
+  // Gaussian GCF, every layer normalised to sum up to one. Layout
+  // is [over][over][support][support], see gcf_cache.cpp.
+  vector<complexd> gcf(gcf_storage_size);
+  const double sigma = gcf_size / 10.0;
+  for (int ov = 0; ov < over; ov++)
+  for (int ou = 0; ou < over; ou++) {
+    complexd * layer = gcf.data() + (ov * over + ou) * gcf_size * gcf_size;
+    double sum = 0;
+    for (int b = 0; b < gcf_size; b++)
+      for (int a = 0; a < gcf_size; a++) {
+        double x = a - gcf_size / 2 - double(ou) / over, y = b - gcf_size / 2 - double(ov) / over;
+        layer[b * gcf_size + a] = exp(-(x * x + y * y) / (2 * sigma * sigma));
+        sum += layer[b * gcf_size + a].real();
+      }
+    for (int i = 0; i < gcf_size * gcf_size; i++) layer[i] /= sum;
+  }
+
+  // Visibilities at integer grid positions, well clear of the grid
+  // edges. Either in clusters a few cells across, or all over the grid.
+  vector<double> clustered(num_of_vis * vis_fields), scattered(num_of_vis * vis_fields);
+  srand(1);
+  for (int c = 0; c < num_of_clusters; c++) {
+    int cu = 2 * gcf_size + rand() % (grid_size - 4 * gcf_size);
+    int cv = 2 * gcf_size + rand() % (grid_size - 4 * gcf_size);
+    for (int i = 0; i < cluster_size; i++) {
+      double * v = clustered.data() + (c * cluster_size + i) * vis_fields;
+      v[0] = (cu + rand() % 13 - 6 - grid_size / 2) / t2;
+      v[1] = (cv + rand() % 13 - 6 - grid_size / 2) / t2;
+      v[2] = 0;
+      v[3] = double(rand()) / RAND_MAX - 0.5;
+      v[4] = double(rand()) / RAND_MAX - 0.5;
+    }
+  }
+  for (int i = 0; i < num_of_vis; i++) {
+    double * v = scattered.data() + i * vis_fields;
+    v[0] = (2 * gcf_size + rand() % (grid_size - 4 * gcf_size) - grid_size / 2) / t2;
+    v[1] = (2 * gcf_size + rand() % (grid_size - 4 * gcf_size) - grid_size / 2) / t2;
+    v[2] = 0;
+    v[3] = double(rand()) / RAND_MAX - 0.5;
+    v[4] = double(rand()) / RAND_MAX - 0.5;
+  }
+
+  buffer_t
+      vis_buffer = mkHalideBuf<double>(num_of_vis, vis_fields)
+    , gcf_buffer = mkHalideBuf<double>(over2, gcf_size, gcf_size, 2)
+    , uvg_buffer = mkHalideBuf<double>(grid_size, grid_size, 2)
+    ;
+  gcf_buffer.host = tohost(gcf.data());
+
+  printf("Gridding %d visibilities, GCF size %d, grid size %d\n", num_of_vis, gcf_size, grid_size);
+  const struct { const char * name; const vector<double> & vis; } runs[] = {
+    { "clustered", clustered },
+    { "scattered", scattered },
+  };
+  for (const auto & r : runs) {
+    vis_buffer.host = tohost(r.vis.data());
+    vector<double> ref(2 * full_size, 0.0), out(2 * full_size, 0.0);
+    uvg_buffer.host = tohost(ref.data());
+    res = kern_scatter(t2, grid_size, gcf_size, &vis_buffer, &gcf_buffer, &uvg_buffer); __CK
+    uvg_buffer.host = tohost(out.data());
+    res = kern_scatter_idg(t2, grid_size, gcf_size, &vis_buffer, &gcf_buffer, &uvg_buffer); __CK
+
+    double maxRef = 0, maxErr = 0;
+    for (size_t i = 0; i < ref.size(); i++) {
+      maxRef = max(maxRef, fabs(ref[i]));
+      maxErr = max(maxErr, fabs(out[i] - ref[i]));
+    }
+    if (maxRef == 0) maxRef = 1;
+    printf("%-16s %-10s max err %9.3e\n", "kern_scatter_idg", r.name, maxErr / maxRef);
+  }
+  return 0;
+}
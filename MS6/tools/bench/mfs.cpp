@@ -0,0 +1,154 @@
+// Checks the multi-frequency synthesis gridder ("kern_scatter_mfs",
+// see scatter_mfs1.cpp) against gridding every channel on its own.
+// Visibilities have UVW in metres and unevenly spaced channels. For
+// the reference we scale them to wavelengths per channel and grid
+// them with "kern_scatter", using the GCF of the w-plane closest to
+// the channel's w (conjugated for negative w). Both should produce
+// the same grid. Finally, we check that a channel falling off the
+// grid gets rejected instead of silently dropped.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+
+#include <algorithm>
+#include <vector>
+#include <complex>
+
+#include "halide_buf.h"
+
+#include "mkHalideBuf.h"
+#include "cfg.h"
+
+extern "C" {
+int kern_scatter(const double, const int32_t, const int32_t, buffer_t *, buffer_t *, buffer_t *);
+int kern_scatter_mfs(const double, const int32_t, const int32_t, const double, buffer_t *, buffer_t *, buffer_t *, buffer_t *);
+int gcf_get(const double, const int32_t, const int32_t, const double, const char *, const int32_t, double *);
+}
+
+using namespace std;
+
+typedef complex<double> complexd;
+
+// Same as in OskarBinReader.h
+#define SPEED_OF_LIGHT 299792458.0
+
+const int over2 = over*over;
+const int gcf_storage_size = over2 * gcf_size * gcf_size;
+const int full_size = grid_size * grid_size;
+const int num_of_vis = 20000;
+const int num_of_planes = 4;
+const double w_step = 250;
+// Unevenly spaced channels (Hz)
+const vector<double> freqs = { 100e6, 103e6, 111e6, 120e6 };
+const int num_of_chans = 4;
+const int vis_fields = 3 + 2 * num_of_chans;
+
+// Runs the given action, returns wall clock time in seconds
+template <typename F>
+double timeIt(F f) {
+  auto start = chrono::high_resolution_clock::now();
+  f();
+  chrono::duration<double> d = chrono::high_resolution_clock::now() - start;
+  return d.count();
+}
+
+#define __CK if (res < 0) { printf("Err: %d\n", res); return res; }
+
+int main(/* int argc, char * argv[] */)
+{
+  int res;
+
+  // Visibilities in metres. Size them for the shortest wavelength, so
+  // every channel stays on the grid and below the last w-plane.
+  const double lambda_min = SPEED_OF_LIGHT / *max_element(freqs.begin(), freqs.end());
+  vector<double> vis(num_of_vis * vis_fields);
+  srand48(1);
+  for (int i = 0; i < num_of_vis; i++) {
+    double * v = vis.data() + i * vis_fields;
+    v[0] = (drand48() - 0.5) * (grid_size - 4 * gcf_size) / t2 * lambda_min;
+    v[1] = (drand48() - 0.5) * (grid_size - 4 * gcf_size) / t2 * lambda_min;
+    v[2] = (drand48() - 0.5) * 2 * (num_of_planes - 1) * w_step * lambda_min;
+    for (int c = 0; c < num_of_chans; c++) {
+      v[3 + 2 * c] = drand48() - 0.5;
+      v[4 + 2 * c] = drand48() - 0.5;
+    }
+  }
+
+  // GCF stack, plane p for |w| = p * w_step
+  vector<complexd> gcfs(num_of_planes * gcf_storage_size);
+  for (int p = 0; p < num_of_planes; p++) {
+    res = gcf_get(p * w_step, gcf_size, over, t2 / 2, "", num_of_planes,
+                  reinterpret_cast<double *>(gcfs.data() + p * gcf_storage_size)); __CK
+  }
+
+  buffer_t
+      vis_buffer = mkHalideBuf<double>(num_of_vis, vis_fields)
+    , freqs_buffer = mkHalideBuf<double>(num_of_chans)
+    , stack_buffer = mkHalideBuf<double>(num_of_planes * over2, gcf_size, gcf_size, 2)
+    , uvg_buffer = mkHalideBuf<double>(grid_size, grid_size, 2)
+    ;
+  vis_buffer.host = tohost(vis.data());
+  freqs_buffer.host = tohost(const_cast<double *>(freqs.data()));
+  stack_buffer.host = tohost(gcfs.data());
+
+  printf("Gridding %d visibilities of %d channels, %d w-planes, GCF size %d, grid size %d\n",
+         num_of_vis, num_of_chans, num_of_planes, gcf_size, grid_size);
+
+  // Reference: Every channel on its own, sorted by w-plane and sign
+  // of w, as "kern_scatter" takes one GCF per call.
+  vector<double> ref(2 * full_size, 0.0);
+  uvg_buffer.host = tohost(ref.data());
+  double tref = timeIt([&]{
+    vector<complexd> gcf(gcf_storage_size);
+    buffer_t gcf_buffer = mkHalideBuf<double>(over2, gcf_size, gcf_size, 2);
+    gcf_buffer.host = tohost(gcf.data());
+    for (int c = 0; c < num_of_chans && res >= 0; c++) {
+      const double inv_lambda = freqs[c] / SPEED_OF_LIGHT;
+      for (int p = 0; p < num_of_planes && res >= 0; p++) {
+        for (int sign : { 1, -1 }) {
+          vector<double> cvis;
+          for (int i = 0; i < num_of_vis; i++) {
+            const double * v = vis.data() + i * vis_fields;
+            const double w = v[2] * inv_lambda;
+            if (nearbyint(fabs(w) / w_step) != p || (w < 0) != (sign < 0)) continue;
+            cvis.insert(cvis.end(), { v[0] * inv_lambda, v[1] * inv_lambda, w,
+                                      v[3 + 2 * c], v[4 + 2 * c] });
+          }
+          if (cvis.empty()) continue;
+          for (int i = 0; i < gcf_storage_size; i++) {
+            complexd g = gcfs[p * gcf_storage_size + i];
+            gcf[i] = sign > 0 ? g : conj(g);
+          }
+          buffer_t cvis_buffer = mkHalideBuf<double>(int(cvis.size()) / 5, 5);
+          cvis_buffer.host = tohost(cvis.data());
+          res = kern_scatter(t2, grid_size, gcf_size, &cvis_buffer, &gcf_buffer, &uvg_buffer);
+          if (res < 0) break;
+        }
+      }
+    }
+  }); __CK
+
+  vector<double> out(2 * full_size, 0.0);
+  uvg_buffer.host = tohost(out.data());
+  double tmfs = timeIt([&]{
+    res = kern_scatter_mfs(t2, grid_size, gcf_size, w_step, &freqs_buffer, &vis_buffer, &stack_buffer, &uvg_buffer);
+  }); __CK
+
+  // Summation order differs, so compare relative to the largest value
+  double maxRef = 0, maxErr = 0;
+  for (size_t i = 0; i < ref.size(); i++) {
+    maxRef = max(maxRef, fabs(ref[i]));
+    maxErr = max(maxErr, fabs(out[i] - ref[i]));
+  }
+  if (maxRef == 0) maxRef = 1;
+  printf("%-18s %8.3f s\n", "per channel", tref);
+  printf("%-18s %8.3f s  x%5.2f  max err %9.3e\n", "kern_scatter_mfs", tmfs, tref / tmfs, maxErr / maxRef);
+
+  // Move the last visibility off the grid for its highest channel
+  vis[(num_of_vis - 1) * vis_fields] = (grid_size / 2 + gcf_size) / t2 * lambda_min;
+  res = kern_scatter_mfs(t2, grid_size, gcf_size, w_step, &freqs_buffer, &vis_buffer, &stack_buffer, &uvg_buffer);
+  printf("Channel off the grid: %s\n", res < 0 ? "rejected" : "NOT rejected");
+  return res < 0 ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+// Accuracy vs. speed comparison of the mixed-precision CPU gridder
+// and degridder kernels against their double-precision
+// counterparts. Uses the same benchmark data as bin_gridder.
+//
+// The f32 kernels are bench-only: nothing in the Haskell flow calls
+// them, so this is the only place their accuracy is checked.
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <chrono>
+
+#include <algorithm>
+#include <vector>
+#include <complex>
+
+#include "halide_buf.h"
+
+#include "mkHalideBuf.h"
+#include "cfg.h"
+
+extern "C" {
+#define __SCATTER(name) int name(const double, const int32_t, const int32_t, buffer_t *, buffer_t *, buffer_t *);
+__SCATTER(kern_scatter)
+__SCATTER(kern_scatter_f32)
+__SCATTER(kern_scatter_f32g)
+#define __DEGRID(name) int name(const double, const int32_t, const int32_t, buffer_t *, buffer_t *, buffer_t *, buffer_t *);
+__DEGRID(kern_degrid)
+__DEGRID(kern_degrid_f32)
+}
+
+using namespace std;
+
+typedef complex<double> complexd;
+
+const int over2 = over*over;
+const int gcf_storage_size = over2 * gcf_size * gcf_size;
+const int full_size = grid_size * grid_size;
+const int num_of_vis = num_baselines * num_times;
+const int vis_fields = 5;
+
+// v should be preallocated with right size
+template <typename T>
+int readFileToVector(vector<T> & v, const char * fname){
+  ifstream is(fname, ios::binary);
+  if (is.fail()) {
+    printf("Can't open %s.\n", fname);
+    return -1;
+  }
+  is.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(T));
+  if (is.fail()) {
+    printf("Can't read %s.\n", fname);
+    return -2;
+  }
+  return 0;
+}
+
+template <typename T>
+vector<float> toFloat(const vector<T> & v) {
+  vector<float> r(v.size());
+  transform(v.begin(), v.end(), r.begin(), [](T x) { return float(x); });
+  return r;
+}
+
+// Runs the given action, returns wall clock time in seconds
+template <typename F>
+double timeIt(F f) {
+  auto start = chrono::high_resolution_clock::now();
+  f();
+  chrono::duration<double> d = chrono::high_resolution_clock::now() - start;
+  return d.count();
+}
+
+// Error of "v" relative to reference "ref". Reports the maximum
+// absolute error as well as RMS error, both relative to the largest
+// absolute value in the reference.
+template <typename T>
+void report(const char * name, double t, double tref, const vector<double> & ref, const vector<T> & v) {
+  double maxRef = 0, maxErr = 0, sqErr = 0;
+  for (size_t i = 0; i < ref.size(); i++) {
+    double err = fabs(double(v[i]) - ref[i]);
+    maxRef = max(maxRef, fabs(ref[i]));
+    maxErr = max(maxErr, err);
+    sqErr += err * err;
+  }
+  if (maxRef == 0) maxRef = 1;
+  printf("%-18s %8.3f s  x%5.2f  max err %9.3e  rms err %9.3e\n",
+         name, t, tref / t, maxErr / maxRef, sqrt(sqErr / ref.size()) / maxRef);
+}
+
+#define __CK if (res < 0) { printf("Err: %d\n", res); return res; }
+
+int main(/* int argc, char * argv[] */)
+{
+  int res;
+
+  printf("Read visibilities and GCF!\n");
+  vector<double> vis(num_of_vis * vis_fields);
+  res = readFileToVector(vis, "vis.dat"); __CK
+  #define __STR(a) #a
+  #define __GCF_PATH(sz) "gcf" __STR(sz) ".dat"
+  vector<complexd> gcf(gcf_storage_size);
+  res = readFileToVector(gcf, __GCF_PATH(GCF_SIZE)); __CK
+
+  vector<float>
+      visf = toFloat(vis)
+    , gcff(2 * gcf_storage_size)
+    ;
+  for (int i = 0; i < gcf_storage_size; i++) {
+    gcff[2*i] = float(gcf[i].real()); gcff[2*i+1] = float(gcf[i].imag());
+  }
+
+  buffer_t
+      vis_buffer  = mkHalideBuf<double>(num_of_vis, vis_fields)
+    , visf_buffer = mkHalideBuf<float>(num_of_vis, vis_fields)
+    , gcf_buffer  = mkHalideBuf<double>(over2, gcf_size, gcf_size, 2)
+    , gcff_buffer = mkHalideBuf<float>(over2, gcf_size, gcf_size, 2)
+    , uvg_buffer  = mkHalideBuf<double>(grid_size, grid_size, 2)
+    , uvgf_buffer = mkHalideBuf<float>(grid_size, grid_size, 2)
+    ;
+  vis_buffer.host = tohost(vis.data());
+  visf_buffer.host = tohost(visf.data());
+  gcf_buffer.host = tohost(gcf.data());
+  gcff_buffer.host = tohost(gcff.data());
+
+  printf("Gridding %d visibilities, GCF size %d, grid size %d\n", num_of_vis, gcf_size, grid_size);
+
+  // Gridding. Note that the double-precision grid produced by the
+  // reference run is re-used as input for degridding below.
+  vector<double>
+      uvg(2 * full_size, 0.0)
+    , uvg_f32(2 * full_size, 0.0)
+    ;
+  vector<float> uvg_f32g(2 * full_size, 0.0f);
+  double tref, t;
+  uvg_buffer.host = tohost(uvg.data());
+  tref = timeIt([&]{ res = kern_scatter(t2, grid_size, gcf_size, &vis_buffer, &gcf_buffer, &uvg_buffer); }); __CK
+  report("kern_scatter", tref, tref, uvg, uvg);
+  uvg_buffer.host = tohost(uvg_f32.data());
+  t = timeIt([&]{ res = kern_scatter_f32(t2, grid_size, gcf_size, &visf_buffer, &gcff_buffer, &uvg_buffer); }); __CK
+  report("kern_scatter_f32", t, tref, uvg, uvg_f32);
+  uvgf_buffer.host = tohost(uvg_f32g.data());
+  t = timeIt([&]{ res = kern_scatter_f32g(t2, grid_size, gcf_size, &visf_buffer, &gcff_buffer, &uvgf_buffer); }); __CK
+  report("kern_scatter_f32g", t, tref, uvg, uvg_f32g);
+
+  // Degridding. We compare the residuals against each other, but
+  // relative to the largest visibility in the reference.
+  vector<double> res_vis(vis.size());
+  vector<float> res_visf(vis.size());
+  buffer_t
+      out_buffer  = mkHalideBuf<double>(num_of_vis, vis_fields)
+    , outf_buffer = mkHalideBuf<float>(num_of_vis, vis_fields)
+    ;
+  out_buffer.host = tohost(res_vis.data());
+  outf_buffer.host = tohost(res_visf.data());
+  uvg_buffer.host = tohost(uvg.data());
+  tref = timeIt([&]{ res = kern_degrid(t2, grid_size, gcf_size, &gcf_buffer, &uvg_buffer, &vis_buffer, &out_buffer); }); __CK
+  report("kern_degrid", tref, tref, res_vis, res_vis);
+  t = timeIt([&]{ res = kern_degrid_f32(t2, grid_size, gcf_size, &gcff_buffer, &uvg_buffer, &visf_buffer, &outf_buffer); }); __CK
+  report("kern_degrid_f32", t, tref, res_vis, res_visf);
+
+  return 0;
+}
@@ -0,0 +1,174 @@
+// Full polarisation gridder and degridder ("kern_scatter_pol4",
+// "kern_degrid_pol4") against one "kern_scatter"/"kern_degrid" call
+// per polarisation. The single-pass kernels compute coordinates and
+// look up the GCF once for all four polarisations, which is what
+// should make them faster. Both ways should produce the same grids
+// and residuals. Uses the same benchmark data as bin_gridder, with
+// differently scaled amplitudes for every polarisation.
+
+#include <cstdio>
+#include <cmath>
+#include <fstream>
+#include <chrono>
+
+#include <algorithm>
+#include <vector>
+#include <complex>
+
+#include "halide_buf.h"
+
+#include "mkHalideBuf.h"
+#include "cfg.h"
+
+extern "C" {
+int kern_scatter(const double, const int32_t, const int32_t, buffer_t *, buffer_t *, buffer_t *);
+int kern_scatter_pol4(const double, const int32_t, const int32_t, buffer_t *, buffer_t *, buffer_t *);
+int kern_degrid(const double, const int32_t, const int32_t, buffer_t *, buffer_t *, buffer_t *, buffer_t *);
+int kern_degrid_pol4(const double, const int32_t, const int32_t, buffer_t *, buffer_t *, buffer_t *, buffer_t *);
+}
+
+using namespace std;
+
+typedef complex<double> complexd;
+
+const int over2 = over*over;
+const int gcf_storage_size = over2 * gcf_size * gcf_size;
+const int full_size = grid_size * grid_size;
+const int num_of_vis = num_baselines * num_times;
+const int num_of_pols = 4;
+const int vis_fields = 5;
+const int vis_pol_fields = 3 + 2 * num_of_pols;
+
+// v should be preallocated with right size
+template <typename T>
+int readFileToVector(vector<T> & v, const char * fname){
+  ifstream is(fname, ios::binary);
+  if (is.fail()) {
+    printf("Can't open %s.\n", fname);
+    return -1;
+  }
+  is.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(T));
+  if (is.fail()) {
+    printf("Can't read %s.\n", fname);
+    return -2;
+  }
+  return 0;
+}
+
+// Runs the given action, returns wall clock time in seconds
+template <typename F>
+double timeIt(F f) {
+  auto start = chrono::high_resolution_clock::now();
+  f();
+  chrono::duration<double> d = chrono::high_resolution_clock::now() - start;
+  return d.count();
+}
+
+// Largest difference between polarisation "p" of "pol4" and "single",
+// relative to the largest value of "single". Records are "stride"
+// doubles apart in "pol4" and "single_stride" in "single", and their
+// complex values start at "offset".
+double polErr(const vector<double> & pol4, int stride, int p,
+              const vector<double> & single, int single_stride, int offset, size_t n) {
+  double maxRef = 0, maxErr = 0;
+  for (size_t i = 0; i < n; i++) {
+    for (int f = 0; f < 2; f++) {
+      double ref = single[i * single_stride + offset + f];
+      maxRef = max(maxRef, fabs(ref));
+      maxErr = max(maxErr, fabs(pol4[i * stride + offset + 2 * p + f] - ref));
+    }
+  }
+  return maxErr / (maxRef == 0 ? 1 : maxRef);
+}
+
+#define __CK if (res < 0) { printf("Err: %d\n", res); return res; }
+
+int main(/* int argc, char * argv[] */)
+{
+  int res = 0;
+
+  printf("Read visibilities and GCF!\n");
+  vector<double> vis(num_of_vis * vis_fields);
+  res = readFileToVector(vis, "vis.dat"); __CK
+  #define __STR(a) #a
+  #define __GCF_PATH(sz) "gcf" __STR(sz) ".dat"
+  vector<complexd> gcf(gcf_storage_size);
+  res = readFileToVector(gcf, __GCF_PATH(GCF_SIZE)); __CK
+
+  // Full polarisation visibilities, polarisation p scaled by p+1
+  vector<double> visPol(size_t(num_of_vis) * vis_pol_fields);
+  for (int i = 0; i < num_of_vis; i++) {
+    const double * v = vis.data() + size_t(i) * vis_fields;
+    double * vp = visPol.data() + size_t(i) * vis_pol_fields;
+    vp[0] = v[0]; vp[1] = v[1]; vp[2] = v[2];
+    for (int p = 0; p < num_of_pols; p++) {
+      vp[3 + 2 * p] = v[3] * (p + 1);
+      vp[4 + 2 * p] = v[4] * (p + 1);
+    }
+  }
+  // Polarisation p of "visPol" in the single polarisation layout
+  auto selectPol = [&](int p) {
+    for (int i = 0; i < num_of_vis; i++) {
+      double * v = vis.data() + size_t(i) * vis_fields;
+      const double * vp = visPol.data() + size_t(i) * vis_pol_fields;
+      v[3] = vp[3 + 2 * p]; v[4] = vp[4 + 2 * p];
+    }
+  };
+
+  buffer_t
+      vis_buffer = mkHalideBuf<double>(num_of_vis, vis_fields)
+    , out_buffer = mkHalideBuf<double>(num_of_vis, vis_fields)
+    , vis_pol_buffer = mkHalideBuf<double>(num_of_vis, vis_pol_fields)
+    , out_pol_buffer = mkHalideBuf<double>(num_of_vis, vis_pol_fields)
+    , gcf_buffer = mkHalideBuf<double>(over2, gcf_size, gcf_size, 2)
+    , uvg_buffer = mkHalideBuf<double>(grid_size, grid_size, 2)
+    , uvg_pol_buffer = mkHalideBuf<double>(grid_size, grid_size, 2 * num_of_pols)
+    ;
+  vis_buffer.host = tohost(vis.data());
+  vis_pol_buffer.host = tohost(visPol.data());
+  gcf_buffer.host = tohost(gcf.data());
+
+  printf("%d polarisations of %d visibilities, GCF size %d, grid size %d\n",
+         num_of_pols, num_of_vis, gcf_size, grid_size);
+
+  // Gridding: One pass per polarisation vs. a single one. Only the
+  // kernel calls are timed, not selecting polarisations.
+  vector<double> uvgPol(2 * num_of_pols * size_t(full_size), 0.0);
+  uvg_pol_buffer.host = tohost(uvgPol.data());
+  double tpol4 = timeIt([&]{
+    res = kern_scatter_pol4(t2, grid_size, gcf_size, &vis_pol_buffer, &gcf_buffer, &uvg_pol_buffer);
+  }); __CK
+  vector<vector<double>> uvgs(num_of_pols, vector<double>(2 * full_size, 0.0));
+  double tsingle = 0, maxErr = 0;
+  for (int p = 0; p < num_of_pols; p++) {
+    selectPol(p);
+    uvg_buffer.host = tohost(uvgs[p].data());
+    tsingle += timeIt([&]{
+      res = kern_scatter(t2, grid_size, gcf_size, &vis_buffer, &gcf_buffer, &uvg_buffer);
+    }); __CK
+    maxErr = max(maxErr, polErr(uvgPol, 2 * num_of_pols, p, uvgs[p], 2, 0, full_size));
+  }
+  printf("%-20s %8.3f s\n", "4x kern_scatter", tsingle);
+  printf("%-20s %8.3f s  x%5.2f  max err %9.3e\n", "kern_scatter_pol4", tpol4, tsingle / tpol4, maxErr);
+
+  // Degridding the grids we just made. Residuals are compared
+  // relative to the largest one of the polarisation.
+  vector<double> outPol(visPol.size()), out(vis.size());
+  out_pol_buffer.host = tohost(outPol.data());
+  out_buffer.host = tohost(out.data());
+  tpol4 = timeIt([&]{
+    res = kern_degrid_pol4(t2, grid_size, gcf_size, &gcf_buffer, &uvg_pol_buffer, &vis_pol_buffer, &out_pol_buffer);
+  }); __CK
+  tsingle = 0; maxErr = 0;
+  for (int p = 0; p < num_of_pols; p++) {
+    selectPol(p);
+    uvg_buffer.host = tohost(uvgs[p].data());
+    tsingle += timeIt([&]{
+      res = kern_degrid(t2, grid_size, gcf_size, &gcf_buffer, &uvg_buffer, &vis_buffer, &out_buffer);
+    }); __CK
+    maxErr = max(maxErr, polErr(outPol, vis_pol_fields, p, out, vis_fields, 3, num_of_vis));
+  }
+  printf("%-20s %8.3f s\n", "4x kern_degrid", tsingle);
+  printf("%-20s %8.3f s  x%5.2f  max err %9.3e\n", "kern_degrid_pol4", tpol4, tsingle / tpol4, maxErr);
+  return 0;
+}
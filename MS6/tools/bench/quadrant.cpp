@@ -0,0 +1,125 @@
+// Quadrant GCF gridder ("kern_scatter_q", see gcf_halide.h) against
+// the plain one ("kern_scatter"). The quadrant GCF only holds layers
+// for oversampling offsets up to OVER/2 and mirrors rows for the
+// others, which should cost next to nothing in speed while needing
+// less than half the GCF memory. Both should produce the same grid.
+// Uses the same visibilities as bin_gridder, and a GCF for w = 0
+// from the GCF cache, as the mirroring only holds for real w-kernels.
+
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <chrono>
+
+#include <algorithm>
+#include <vector>
+#include <complex>
+
+#include "halide_buf.h"
+
+#include "mkHalideBuf.h"
+#include "cfg.h"
+
+extern "C" {
+int kern_scatter(const double, const int32_t, const int32_t, buffer_t *, buffer_t *, buffer_t *);
+int gcf_get(const double, const int32_t, const int32_t, const double, const char *, const int32_t, double *);
+}
+
+using namespace std;
+
+typedef complex<double> complexd;
+
+const int over2 = over*over;
+const int overq = over/2 + 1;
+const int layer_size = gcf_size * gcf_size;
+const int full_size = grid_size * grid_size;
+const int num_of_vis = num_baselines * num_times;
+const int vis_fields = 5;
+
+// v should be preallocated with right size
+template <typename T>
+int readFileToVector(vector<T> & v, const char * fname){
+  ifstream is(fname, ios::binary);
+  if (is.fail()) {
+    printf("Can't open %s.\n", fname);
+    return -1;
+  }
+  is.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(T));
+  if (is.fail()) {
+    printf("Can't read %s.\n", fname);
+    return -2;
+  }
+  return 0;
+}
+
+// Runs the given action, returns wall clock time in seconds
+template <typename F>
+double timeIt(F f) {
+  auto start = chrono::high_resolution_clock::now();
+  f();
+  chrono::duration<double> d = chrono::high_resolution_clock::now() - start;
+  return d.count();
+}
+
+#define __CK if (res < 0) { printf("Err: %d\n", res); return res; }
+
+int main(/* int argc, char * argv[] */)
+{
+  int res;
+
+  printf("Read visibilities!\n");
+  vector<double> vis(num_of_vis * vis_fields);
+  res = readFileToVector(vis, "vis.dat"); __CK
+
+  // Full GCF, and the quadrant of it with offsets 0..OVER/2 in either
+  // direction, in the same layer order (as gcfKernel does).
+  vector<complexd> gcf(over2 * layer_size), gcfq(overq * overq * layer_size);
+  res = gcf_get(0, gcf_size, over, t2 / 2, "", 1, reinterpret_cast<double *>(gcf.data())); __CK
+  for (int ov = 0; ov < overq; ov++)
+    for (int ou = 0; ou < overq; ou++)
+      memcpy(gcfq.data() + (ou + overq * ov) * layer_size,
+             gcf.data() + (ou + over * ov) * layer_size,
+             layer_size * sizeof(complexd));
+
+  buffer_t
+      vis_buffer = mkHalideBuf<double>(num_of_vis, vis_fields)
+    , gcf_buffer = mkHalideBuf<double>(over2, gcf_size, gcf_size, 2)
+    , gcfq_buffer = mkHalideBuf<double>(overq * overq, gcf_size, gcf_size, 2)
+    , uvg_buffer = mkHalideBuf<double>(grid_size, grid_size, 2)
+    ;
+  vis_buffer.host = tohost(vis.data());
+  gcf_buffer.host = tohost(gcf.data());
+  gcfq_buffer.host = tohost(gcfq.data());
+
+  printf("Gridding %d visibilities, GCF size %d, over %d, grid size %d\n",
+         num_of_vis, gcf_size, over, grid_size);
+
+  vector<double> ref(2 * full_size, 0.0);
+  uvg_buffer.host = tohost(ref.data());
+  double tplain = timeIt([&]{
+    res = kern_scatter(t2, grid_size, gcf_size, &vis_buffer, &gcf_buffer, &uvg_buffer);
+  }); __CK
+
+  // "kern_scatter" dispatches to "kern_scatter_q" for quadrant GCFs
+  vector<double> out(2 * full_size, 0.0);
+  uvg_buffer.host = tohost(out.data());
+  double tq = timeIt([&]{
+    res = kern_scatter(t2, grid_size, gcf_size, &vis_buffer, &gcfq_buffer, &uvg_buffer);
+  }); __CK
+
+  // Mirrored GCF values are only equal up to rounding of the GCF
+  // generation, so compare relative to the largest grid value.
+  double maxRef = 0, maxErr = 0;
+  for (size_t i = 0; i < ref.size(); i++) {
+    maxRef = max(maxRef, fabs(ref[i]));
+    maxErr = max(maxErr, fabs(out[i] - ref[i]));
+  }
+  if (maxRef == 0) maxRef = 1;
+
+  printf("%-16s %8.3f s  GCF %6.2f MB\n", "kern_scatter", tplain,
+         gcf.size() * sizeof(complexd) / 1e6);
+  printf("%-16s %8.3f s  GCF %6.2f MB  x%5.2f  max err %9.3e\n", "kern_scatter_q", tq,
+         gcfq.size() * sizeof(complexd) / 1e6, tplain / tq, maxErr / maxRef);
+  return 0;
+}
@@ -0,0 +1,132 @@
+// Fused residual gridder ("kern_scatter_resid") against degridding
+// and gridding separately ("kern_degrid" followed by "kern_scatter").
+// Both should produce the same residual grid. The fused kernel never
+// writes the degridded visibilities and reads them back, which is
+// what it saves in memory traffic. Uses the same benchmark data as
+// bin_gridder.
+
+#include <cstdio>
+#include <cmath>
+#include <fstream>
+#include <chrono>
+
+#include <algorithm>
+#include <vector>
+#include <complex>
+
+#include "halide_buf.h"
+
+#include "mkHalideBuf.h"
+#include "cfg.h"
+
+extern "C" {
+int kern_scatter(const double, const int32_t, const int32_t, buffer_t *, buffer_t *, buffer_t *);
+int kern_degrid(const double, const int32_t, const int32_t, buffer_t *, buffer_t *, buffer_t *, buffer_t *);
+int kern_scatter_resid(const double, const int32_t, const int32_t, buffer_t *, buffer_t *, buffer_t *, buffer_t *);
+}
+
+using namespace std;
+
+typedef complex<double> complexd;
+
+const int over2 = over*over;
+const int gcf_storage_size = over2 * gcf_size * gcf_size;
+const int full_size = grid_size * grid_size;
+const int num_of_vis = num_baselines * num_times;
+const int vis_fields = 5;
+
+// v should be preallocated with right size
+template <typename T>
+int readFileToVector(vector<T> & v, const char * fname){
+  ifstream is(fname, ios::binary);
+  if (is.fail()) {
+    printf("Can't open %s.\n", fname);
+    return -1;
+  }
+  is.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(T));
+  if (is.fail()) {
+    printf("Can't read %s.\n", fname);
+    return -2;
+  }
+  return 0;
+}
+
+// Runs the given action, returns wall clock time in seconds
+template <typename F>
+double timeIt(F f) {
+  auto start = chrono::high_resolution_clock::now();
+  f();
+  chrono::duration<double> d = chrono::high_resolution_clock::now() - start;
+  return d.count();
+}
+
+#define __CK if (res < 0) { printf("Err: %d\n", res); return res; }
+
+int main(/* int argc, char * argv[] */)
+{
+  int res;
+
+  printf("Read visibilities and GCF!\n");
+  vector<double> vis(num_of_vis * vis_fields);
+  res = readFileToVector(vis, "vis.dat"); __CK
+  #define __STR(a) #a
+  #define __GCF_PATH(sz) "gcf" __STR(sz) ".dat"
+  vector<complexd> gcf(gcf_storage_size);
+  res = readFileToVector(gcf, __GCF_PATH(GCF_SIZE)); __CK
+
+  buffer_t
+      vis_buffer = mkHalideBuf<double>(num_of_vis, vis_fields)
+    , res_buffer = mkHalideBuf<double>(num_of_vis, vis_fields)
+    , gcf_buffer = mkHalideBuf<double>(over2, gcf_size, gcf_size, 2)
+    , model_buffer = mkHalideBuf<double>(grid_size, grid_size, 2)
+    , uvg_buffer = mkHalideBuf<double>(grid_size, grid_size, 2)
+    ;
+  vis_buffer.host = tohost(vis.data());
+  gcf_buffer.host = tohost(gcf.data());
+
+  // Model grid: Half of the visibilities, so the residuals are
+  // neither zero nor the visibilities themselves.
+  vector<double> half(vis);
+  for (size_t i = 0; i < half.size(); i += vis_fields) {
+    half[i+3] *= 0.5; half[i+4] *= 0.5;
+  }
+  vector<double> model(2 * full_size, 0.0);
+  res_buffer.host = tohost(half.data());
+  model_buffer.host = tohost(model.data());
+  res = kern_scatter(t2, grid_size, gcf_size, &res_buffer, &gcf_buffer, &model_buffer); __CK
+
+  printf("Residuals of %d visibilities, GCF size %d, grid size %d\n", num_of_vis, gcf_size, grid_size);
+
+  // Separately: Degridded visibilities go through memory
+  vector<double> resVis(vis.size()), ref(2 * full_size, 0.0);
+  res_buffer.host = tohost(resVis.data());
+  uvg_buffer.host = tohost(ref.data());
+  double tsep = timeIt([&]{
+    res = kern_degrid(t2, grid_size, gcf_size, &gcf_buffer, &model_buffer, &vis_buffer, &res_buffer);
+    if (res >= 0) res = kern_scatter(t2, grid_size, gcf_size, &res_buffer, &gcf_buffer, &uvg_buffer);
+  }); __CK
+
+  // Fused
+  vector<double> out(2 * full_size, 0.0);
+  uvg_buffer.host = tohost(out.data());
+  double tfused = timeIt([&]{
+    res = kern_scatter_resid(t2, grid_size, gcf_size, &gcf_buffer, &model_buffer, &vis_buffer, &uvg_buffer);
+  }); __CK
+
+  // Summation order is the same, but the compiler might contract
+  // differently, so compare relative to the largest grid value.
+  double maxRef = 0, maxErr = 0;
+  for (size_t i = 0; i < ref.size(); i++) {
+    maxRef = max(maxRef, fabs(ref[i]));
+    maxErr = max(maxErr, fabs(out[i] - ref[i]));
+  }
+  if (maxRef == 0) maxRef = 1;
+
+  // The separate path writes the residual visibilities and reads
+  // them back in full.
+  const double saved = 2.0 * vis.size() * sizeof(double) / 1e6;
+  printf("%-24s %8.3f s\n", "kern_degrid+kern_scatter", tsep);
+  printf("%-24s %8.3f s  x%5.2f  max err %9.3e  saves %.0f MB of visibility traffic\n",
+         "kern_scatter_resid", tfused, tsep / tfused, maxErr / maxRef, saved);
+  return 0;
+}
@@ -0,0 +1,113 @@
+// Overhead of uniform and Briggs weighting ("kern_weights" plus
+// "kern_weight_vis") relative to gridding the visibilities with
+// "kern_scatter". Uses the same benchmark data as bin_gridder. Set
+// HL_NUM_THREADS to control the number of threads.
+
+#include <cstdio>
+#include <cmath>
+#include <fstream>
+#include <chrono>
+
+#include <algorithm>
+#include <vector>
+#include <complex>
+
+#include "halide_buf.h"
+
+#include "mkHalideBuf.h"
+#include "cfg.h"
+
+extern "C" {
+int kern_scatter(const double, const int32_t, const int32_t, buffer_t *, buffer_t *, buffer_t *);
+int kern_weights(const double, const int32_t, const double, buffer_t *, buffer_t *);
+int kern_weight_vis(const double, buffer_t *, buffer_t *, buffer_t *);
+}
+
+using namespace std;
+
+typedef complex<double> complexd;
+
+const int over2 = over*over;
+const int gcf_storage_size = over2 * gcf_size * gcf_size;
+const int full_size = grid_size * grid_size;
+const int num_of_vis = num_baselines * num_times;
+const int vis_fields = 5;
+
+// Must match "Weighting" in weights.cpp
+const int WEIGHT_UNIFORM = 1, WEIGHT_BRIGGS = 2;
+
+// v should be preallocated with right size
+template <typename T>
+int readFileToVector(vector<T> & v, const char * fname){
+  ifstream is(fname, ios::binary);
+  if (is.fail()) {
+    printf("Can't open %s.\n", fname);
+    return -1;
+  }
+  is.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(T));
+  if (is.fail()) {
+    printf("Can't read %s.\n", fname);
+    return -2;
+  }
+  return 0;
+}
+
+// Runs the given action once to warm up, then returns the best wall
+// clock time in seconds out of "runs" runs
+template <typename F>
+double timeBest(int runs, F f) {
+  f();
+  double best = 0;
+  for (int i = 0; i < runs; i++) {
+    auto start = chrono::high_resolution_clock::now();
+    f();
+    chrono::duration<double> d = chrono::high_resolution_clock::now() - start;
+    if (i == 0 || d.count() < best) best = d.count();
+  }
+  return best;
+}
+
+#define __CK if (res < 0) { printf("Err: %d\n", res); return res; }
+
+int main(/* int argc, char * argv[] */)
+{
+  int res = 0;
+  const int runs = 5;
+
+  printf("Read visibilities and GCF!\n");
+  vector<double> vis(num_of_vis * vis_fields);
+  res = readFileToVector(vis, "vis.dat"); __CK
+  #define __STR(a) #a
+  #define __GCF_PATH(sz) "gcf" __STR(sz) ".dat"
+  vector<complexd> gcf(gcf_storage_size);
+  res = readFileToVector(gcf, __GCF_PATH(GCF_SIZE)); __CK
+
+  buffer_t
+      vis_buffer = mkHalideBuf<double>(num_of_vis, vis_fields)
+    , wvis_buffer = mkHalideBuf<double>(num_of_vis, vis_fields)
+    , gcf_buffer = mkHalideBuf<double>(over2, gcf_size, gcf_size, 2)
+    , uvg_buffer = mkHalideBuf<double>(grid_size, grid_size, 2)
+    , wgt_buffer = mkHalideBuf<double>(grid_size, grid_size)
+    ;
+  vector<double> wvis(vis.size()), uvg(2 * full_size, 0.0), wgt(full_size);
+  vis_buffer.host = tohost(vis.data());
+  wvis_buffer.host = tohost(wvis.data());
+  gcf_buffer.host = tohost(gcf.data());
+  uvg_buffer.host = tohost(uvg.data());
+  wgt_buffer.host = tohost(wgt.data());
+
+  printf("Weighting %d visibilities, GCF size %d, grid size %d\n", num_of_vis, gcf_size, grid_size);
+  double tscatter = timeBest(runs, [&]{ res = kern_scatter(t2, grid_size, gcf_size, &vis_buffer, &gcf_buffer, &uvg_buffer); }); __CK
+  printf("%-16s %8.3f s\n", "kern_scatter", tscatter);
+
+  const struct { const char * name; int mode; double robust; } modes[] = {
+    { "uniform", WEIGHT_UNIFORM, 0 },
+    { "briggs", WEIGHT_BRIGGS, 0.5 },
+  };
+  for (const auto & m : modes) {
+    double tw = timeBest(runs, [&]{ res = kern_weights(t2, m.mode, m.robust, &vis_buffer, &wgt_buffer); }); __CK
+    double tv = timeBest(runs, [&]{ res = kern_weight_vis(t2, &wgt_buffer, &vis_buffer, &wvis_buffer); }); __CK
+    printf("%-16s %8.3f s + %8.3f s  overhead %5.1f%%\n", m.name, tw, tv, 100 * (tw + tv) / tscatter);
+  }
+  return 0;
+}
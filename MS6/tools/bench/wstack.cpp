@@ -0,0 +1,123 @@
+// Checks w-stacking ("kern_wstack_grid") against w-projection. We
+// grid a few planes of visibilities sharing a w each, once with the
+// w-kernel for every plane (see "gcf_get" in gcf_cache.cpp) followed
+// by a single inverse FFT, and once with the w = 0 kernel, leaving the
+// w-term to the image-domain correction. Both should produce the same
+// image. The generated kernels are not tapered, so truncating them
+// to the GCF size aliases, mostly into the edges of the image. We
+// therefore only compare the centre half of the image, where the
+// remaining difference grows with w. For comparison, we also show
+// what happens when the correction assumes twice the field of view,
+// as it would for one of two facets if given the full field of view.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+#include <algorithm>
+#include <vector>
+#include <complex>
+
+#include "halide_buf.h"
+
+#include "mkHalideBuf.h"
+#include "cfg.h"
+
+extern "C" {
+int kern_scatter(const double, const int32_t, const int32_t, buffer_t *, buffer_t *, buffer_t *);
+int kern_ifft_c2c(buffer_t *, buffer_t *);
+int kern_wstack_grid(const double, const int32_t, const int32_t, const double, buffer_t *, buffer_t *, buffer_t *);
+int gcf_get(const double, const int32_t, const int32_t, const double, const char *, const int32_t, double *);
+}
+
+using namespace std;
+
+typedef complex<double> complexd;
+
+const int over2 = over*over;
+const int gcf_storage_size = over2 * gcf_size * gcf_size;
+const int full_size = grid_size * grid_size;
+const int num_of_planes = 4;
+const int vis_per_plane = 8;
+const int vis_fields = 5;
+// Largest w, chosen so that the w-kernel still fits the GCF size
+const double max_w = 1000;
+
+// Maximum difference relative to the largest value of the reference,
+// within the centre half of the image
+double relErr(const vector<double> & ref, const vector<double> & out) {
+  double maxRef = 0, maxErr = 0;
+  for (int y = grid_size / 4; y < 3 * grid_size / 4; y++)
+    for (int x = grid_size / 4; x < 3 * grid_size / 4; x++) {
+      size_t i = size_t(y) * grid_size + x;
+      maxRef = max(maxRef, fabs(ref[i]));
+      maxErr = max(maxErr, fabs(out[i] - ref[i]));
+    }
+  return maxErr / (maxRef == 0 ? 1 : maxRef);
+}
+
+#define __CK if (res < 0) { printf("Err: %d\n", res); return res; }
+
+int main(/* int argc, char * argv[] */)
+{
+  int res;
+
+  // Visibilities of every plane, away from the grid edges
+  vector<vector<double> > vis(num_of_planes, vector<double>(vis_per_plane * vis_fields));
+  vector<double> ws(num_of_planes);
+  srand48(1);
+  for (int p = 0; p < num_of_planes; p++) {
+    ws[p] = max_w * (2 * double(p) / (num_of_planes - 1) - 1);
+    for (int i = 0; i < vis_per_plane; i++) {
+      double * v = vis[p].data() + i * vis_fields;
+      v[0] = (drand48() - 0.5) * (grid_size - 4 * gcf_size) / t2;
+      v[1] = (drand48() - 0.5) * (grid_size - 4 * gcf_size) / t2;
+      v[2] = ws[p];
+      v[3] = drand48() - 0.5;
+      v[4] = drand48() - 0.5;
+    }
+  }
+
+  buffer_t
+      vis_buffer = mkHalideBuf<double>(vis_per_plane, vis_fields)
+    , gcf_buffer = mkHalideBuf<double>(over2, gcf_size, gcf_size, 2)
+    , uvg_buffer = mkHalideBuf<double>(grid_size, grid_size, 2)
+    , cimg_buffer = mkHalideBuf<double>(grid_size, grid_size, 2)
+    , img_buffer = mkHalideBuf<double>(grid_size, grid_size)
+    ;
+  vector<complexd> gcf(gcf_storage_size);
+  gcf_buffer.host = tohost(gcf.data());
+
+  printf("Gridding %d planes of %d visibilities, |w| <= %g, GCF size %d, grid size %d\n",
+         num_of_planes, vis_per_plane, max_w, gcf_size, grid_size);
+
+  // W-projection: Every plane gets its own w-kernel
+  vector<double> uvg(2 * full_size, 0.0), cimg(2 * full_size);
+  uvg_buffer.host = tohost(uvg.data());
+  for (int p = 0; p < num_of_planes; p++) {
+    res = gcf_get(ws[p], gcf_size, over, t2 / 2, "", num_of_planes, reinterpret_cast<double *>(gcf.data())); __CK
+    vis_buffer.host = tohost(vis[p].data());
+    res = kern_scatter(t2, grid_size, gcf_size, &vis_buffer, &gcf_buffer, &uvg_buffer); __CK
+  }
+  cimg_buffer.host = tohost(cimg.data());
+  res = kern_ifft_c2c(&uvg_buffer, &cimg_buffer); __CK
+  vector<double> ref(full_size);
+  for (int i = 0; i < full_size; i++) ref[i] = cimg[2 * i];
+
+  // W-stacking: The w = 0 kernel for all planes
+  res = gcf_get(0, gcf_size, over, t2 / 2, "", num_of_planes, reinterpret_cast<double *>(gcf.data())); __CK
+  const struct { const char * name; double theta; } runs[] = {
+    { "kern_wstack_grid", t2 },
+    { "(2x field)", 2 * t2 },
+  };
+  for (const auto & r : runs) {
+    vector<double> img(full_size, 0.0);
+    img_buffer.host = tohost(img.data());
+    for (int p = 0; p < num_of_planes; p++) {
+      vis_buffer.host = tohost(vis[p].data());
+      res = kern_wstack_grid(t2, grid_size, gcf_size, r.theta, &vis_buffer, &gcf_buffer, &img_buffer); __CK
+    }
+    printf("%-16s max err %9.3e\n", r.name, relErr(ref, img));
+  }
+  return 0;
+}